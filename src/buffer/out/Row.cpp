@@ -80,6 +80,26 @@ constexpr OutIt copy_n_small(InIt first, Diff count, OutIt dest)
     return dest;
 }
 
+template<typename T>
+static void packValue(std::vector<uint8_t>& out, const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto beg = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), beg, beg + sizeof(T));
+}
+
+// Unlike packValue(), this validates the input, because ROW::Unpack() may be given data from disk.
+template<typename T>
+static T unpackValue(std::span<const uint8_t>& in)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), in.size() < sizeof(T));
+    T value;
+    memcpy(&value, in.data(), sizeof(T));
+    in = in.subspan(sizeof(T));
+    return value;
+}
+
 CharToColumnMapper::CharToColumnMapper(const wchar_t* chars, const uint16_t* charOffsets, ptrdiff_t lastCharOffset, til::CoordType currentColumn) noexcept :
     _chars{ chars },
     _charOffsets{ charOffsets },
@@ -199,6 +219,16 @@ LineRendition ROW::GetLineRendition() const noexcept
     return _lineRendition;
 }
 
+uint64_t ROW::GetMutationId() const noexcept
+{
+    return _mutationId;
+}
+
+void ROW::SetMutationId(const uint64_t id) noexcept
+{
+    _mutationId = id;
+}
+
 // Returns the index 1 past the last (technically) valid column in the row.
 // The interplay between the old console and newer VT APIs which support line renditions is
 // still unclear so it might be necessary to add two kinds of this function in the future.
@@ -348,6 +378,124 @@ void ROW::_init() noexcept
 #pragma warning(push)
 }
 
+// Appends a compact representation of this row to `out`, which can be turned back into a ROW via Unpack().
+// The _charOffsets are stored as differences between successive columns, which turns the
+// typical 0, 1, 2, 3, ... sequence into a repeating pattern that compresses well.
+// Image slices are not supported and must be checked for by the caller.
+void ROW::Pack(std::vector<uint8_t>& out) const
+{
+    const auto textLength = _charSize();
+    const uint8_t flags = (_wrapForced ? 1 : 0) | (_doubleBytePadded ? 2 : 0) | (_promptData ? 4 : 0);
+
+    packValue(out, flags);
+    packValue(out, _lineRendition);
+    packValue(out, _mutationId);
+
+    if (_promptData)
+    {
+        packValue(out, _promptData->category);
+        packValue(out, gsl::narrow_cast<uint8_t>(_promptData->color.has_value()));
+        packValue(out, _promptData->color.value_or(til::color{}));
+        packValue(out, gsl::narrow_cast<uint8_t>(_promptData->exitCode.has_value()));
+        packValue(out, _promptData->exitCode.value_or(0));
+    }
+
+    packValue(out, textLength);
+    const auto text = reinterpret_cast<const uint8_t*>(_chars.data());
+    out.insert(out.end(), text, text + textLength * sizeof(wchar_t));
+
+    uint16_t previous = 0;
+    for (const auto offset : _charOffsets)
+    {
+        packValue(out, gsl::narrow_cast<uint16_t>(offset - previous));
+        previous = offset;
+    }
+
+    const auto& runs = _attr.runs();
+    packValue(out, gsl::narrow_cast<uint16_t>(runs.size()));
+    for (const auto& run : runs)
+    {
+        packValue(out, run.value);
+        packValue(out, run.length);
+    }
+}
+
+// Restores the contents of a row from the data written by Pack(), which must have been a row of the same width.
+// Advances `in` past the consumed data and throws if it's malformed, in which case the row contents are unspecified.
+void ROW::Unpack(std::span<const uint8_t>& in)
+{
+    const auto flags = unpackValue<uint8_t>(in);
+    const auto lineRendition = unpackValue<LineRendition>(in);
+    _mutationId = unpackValue<uint64_t>(in);
+
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), flags > 7 || lineRendition > LineRendition::DoubleHeightBottom);
+    _wrapForced = (flags & 1) != 0;
+    _doubleBytePadded = (flags & 2) != 0;
+    _lineRendition = lineRendition;
+    _imageSlice = nullptr;
+    _promptData = std::nullopt;
+
+    if (flags & 4)
+    {
+        auto& data = _promptData.emplace();
+        data.category = unpackValue<MarkCategory>(in);
+        const auto hasColor = unpackValue<uint8_t>(in) != 0;
+        const auto color = unpackValue<til::color>(in);
+        const auto hasExitCode = unpackValue<uint8_t>(in) != 0;
+        const auto exitCode = unpackValue<uint32_t>(in);
+        if (hasColor)
+        {
+            data.color = color;
+        }
+        if (hasExitCode)
+        {
+            data.exitCode = exitCode;
+        }
+    }
+
+    const auto textLength = unpackValue<uint16_t>(in);
+    const auto textBytes = size_t{ textLength } * sizeof(wchar_t);
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), in.size() < textBytes || textLength > CharOffsetsMask);
+
+    if (textLength > _columnCount)
+    {
+        _charsHeap = std::make_unique_for_overwrite<wchar_t[]>(textLength);
+        _chars = { _charsHeap.get(), textLength };
+    }
+    else
+    {
+        _charsHeap.reset();
+        _chars = { _charsBuffer, _columnCount };
+    }
+    memcpy(_chars.data(), in.data(), textBytes);
+    in = in.subspan(textBytes);
+
+    uint16_t offset = 0;
+    uint16_t previous = 0;
+    for (auto& dst : _charOffsets)
+    {
+        offset += unpackValue<uint16_t>(in);
+        // Every offset needs to be within the text and they must be ascending, or all the
+        // unchecked accessors like _uncheckedCharOffset() would read out of bounds.
+        THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), (offset & CharOffsetsMask) > textLength || (offset & CharOffsetsMask) < previous);
+        previous = offset & CharOffsetsMask;
+        dst = offset;
+    }
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), _charOffsets.front() != 0 || _charSize() != textLength);
+
+    decltype(_attr)::container runs;
+    size_t totalLength = 0;
+    for (auto count = unpackValue<uint16_t>(in); count; --count)
+    {
+        const auto value = unpackValue<TextAttribute>(in);
+        const auto length = unpackValue<uint16_t>(in);
+        runs.emplace_back(value, length);
+        totalLength += length;
+    }
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), totalLength != _columnCount);
+    _attr = decltype(_attr){ std::move(runs) };
+}
+
 void ROW::CopyFrom(const ROW& source)
 {
     _lineRendition = source._lineRendition;
@@ -536,14 +684,31 @@ OutputCellIterator ROW::WriteCells(OutputCellIterator it, const til::CoordType c
 
 void ROW::SetAttrToEnd(const til::CoordType columnBegin, const TextAttribute attr)
 {
+    if (_isUniformlyAttributed(attr))
+    {
+        return;
+    }
     _attr.replace(_clampedColumnInclusive(columnBegin), _attr.size(), attr);
 }
 
 void ROW::ReplaceAttributes(const til::CoordType beginIndex, const til::CoordType endIndex, const TextAttribute& newAttr)
 {
+    if (_isUniformlyAttributed(newAttr))
+    {
+        return;
+    }
     _attr.replace(_clampedColumnInclusive(beginIndex), _clampedColumnInclusive(endIndex), newAttr);
 }
 
+// Returns true if every column of the row already has the given attributes.
+// Most text is written into rows that consist of a single run of the same attributes it's written with
+// (plain output into a freshly reset row, for instance), and this turns replacing them into a single comparison.
+bool ROW::_isUniformlyAttributed(const TextAttribute& attr) const noexcept
+{
+    const auto& runs = _attr.runs();
+    return runs.size() == 1 && runs.front().value == attr;
+}
+
 [[msvc::forceinline]] ROW::WriteHelper::WriteHelper(ROW& row, til::CoordType columnBegin, til::CoordType columnLimit, const std::wstring_view& chars) noexcept :
     row{ row },
     chars{ chars }
@@ -646,6 +811,58 @@ catch (...)
     const auto end = it + std::min<size_t>(chars.size(), colLimit - colBeg);
     size_t ch = chBeg;
 
+#pragma warning(push)
+#pragma warning(disable : 26490) // Don't use reinterpret_cast (type.1).
+    // The vectorized part of the fast-pass checks 8 characters at a time for being ASCII and if they are,
+    // writes their char offsets as an identity sequence (ch, ch+1, ...) with a single store.
+    // The text itself gets copied in one go by Finish(). The first chunk that contains a non-ASCII
+    // character is left to the scalar loop below, which then hands off to _replaceTextUnicode().
+#if defined(TIL_SSE_INTRINSICS)
+    {
+        const auto nonAsciiMask = _mm_set1_epi16(static_cast<short>(0xff80));
+        const auto increment = _mm_set1_epi16(8);
+        auto offsets = _mm_add_epi16(_mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7), _mm_set1_epi16(gsl::narrow_cast<short>(ch)));
+
+        for (const auto vecEnd = it + ((end - it) & ~ptrdiff_t{ 7 }); it != vecEnd; it += 8)
+        {
+            const auto wch = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&*it));
+            const auto isAscii = _mm_cmpeq_epi16(_mm_and_si128(wch, nonAsciiMask), _mm_setzero_si128());
+            if (_mm_movemask_epi8(isAscii) != 0xffff)
+            {
+                break;
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row._charOffsets.data() + colEnd), offsets);
+            offsets = _mm_add_epi16(offsets, increment);
+            colEnd += 8;
+            ch += 8;
+        }
+    }
+#elif defined(TIL_ARM_NEON_INTRINSICS)
+    {
+        alignas(uint16x8_t) static constexpr uint16_t offsetsData[]{ 0, 1, 2, 3, 4, 5, 6, 7 };
+        const auto nonAsciiMask = vdupq_n_u16(0xff80);
+        const auto increment = vdupq_n_u16(8);
+        auto offsets = vaddq_u16(vld1q_u16(&offsetsData[0]), vdupq_n_u16(gsl::narrow_cast<uint16_t>(ch)));
+
+        for (const auto vecEnd = it + ((end - it) & ~ptrdiff_t{ 7 }); it != vecEnd; it += 8)
+        {
+            const auto wch = vld1q_u16(reinterpret_cast<const uint16_t*>(&*it));
+            const auto nonAscii = vreinterpretq_u64_u16(vandq_u16(wch, nonAsciiMask));
+            if (vgetq_lane_u64(nonAscii, 0) | vgetq_lane_u64(nonAscii, 1))
+            {
+                break;
+            }
+
+            vst1q_u16(row._charOffsets.data() + colEnd, offsets);
+            offsets = vaddq_u16(offsets, increment);
+            colEnd += 8;
+            ch += 8;
+        }
+    }
+#endif
+#pragma warning(pop)
+
     while (it != end)
     {
         if (*it >= 0x80) [[unlikely]]
@@ -131,9 +131,13 @@ public:
     void SetLineRendition(const LineRendition lineRendition) noexcept;
     LineRendition GetLineRendition() const noexcept;
     til::CoordType GetReadableColumnCount() const noexcept;
+    uint64_t GetMutationId() const noexcept;
+    void SetMutationId(uint64_t id) noexcept;
 
     void Reset(const TextAttribute& attr) noexcept;
     void CopyFrom(const ROW& source);
+    void Pack(std::vector<uint8_t>& out) const;
+    void Unpack(std::span<const uint8_t>& in);
 
     til::CoordType NavigateToPrevious(til::CoordType column) const noexcept;
     til::CoordType NavigateToNext(til::CoordType column) const noexcept;
@@ -252,6 +256,7 @@ private:
     T _adjustForward(T column) const noexcept;
 
     void _init() noexcept;
+    bool _isUniformlyAttributed(const TextAttribute& attr) const noexcept;
     void _resizeChars(uint16_t colEndDirty, uint16_t chBegDirty, size_t chEndDirty, uint16_t chEndDirtyOld);
     CharToColumnMapper _createCharToColumnMapper(ptrdiff_t offset) const noexcept;
 
@@ -311,6 +316,11 @@ private:
 
     // Stores any image content covering the row.
     ImageSlice::Pointer _imageSlice;
+
+    // The value of TextBuffer::_lastMutationId when this row was last handed out for modification.
+    // It's 0 for rows that were never modified since they were constructed (= blank rows).
+    // This allows callers like TextBuffer::SearchText() to cache per-row results.
+    uint64_t _mutationId = 0;
 };
 
 #ifdef UNIT_TESTING
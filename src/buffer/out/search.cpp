@@ -20,12 +20,18 @@ bool Search::Reset(Microsoft::Console::Render::IRenderData& renderData, const st
 {
     const auto& textBuffer = renderData.GetTextBuffer();
 
+    // The cached results are only meaningful for the rows of the buffer they were computed from.
+    if (_renderData != &renderData)
+    {
+        _cache = {};
+    }
+
     _renderData = &renderData;
     _needle = needle;
     _flags = flags;
     _lastMutationId = textBuffer.GetLastMutationId();
 
-    auto result = textBuffer.SearchText(needle, _flags);
+    auto result = textBuffer.SearchText(needle, _flags, _cache);
     _ok = result.has_value();
     _results = std::move(result).value_or(std::vector<til::point_span>{});
     _index = reverse ? gsl::narrow_cast<ptrdiff_t>(_results.size()) - 1 : 0;
@@ -57,6 +57,8 @@ private:
     std::wstring _needle;
     SearchFlag _flags{};
     uint64_t _lastMutationId = 0;
+    // Allows Reset() to only search the lines that changed since the previous call.
+    TextBuffer::SearchCache _cache;
 
     bool _ok{ false };
     std::vector<til::point_span> _results;
@@ -5,6 +5,9 @@
 #include "textBuffer.hpp"
 
 #include <til/hash.h>
+#include <til/latch.h>
+#include <til/lz4.h>
+#include <til/unicode.h>
 
 #include "UTextAdapter.h"
 #include "../../types/inc/CodepointWidthDetector.hpp"
@@ -114,6 +117,8 @@ void TextBuffer::_reserve(til::size screenBufferSize, const TextAttribute& defau
     _bufferOffsetCharOffsets = rowSize + charsBufferSize;
     _width = w;
     _height = h;
+    // Blocks of at least 64KiB make sure that most of a frozen block's pages can be decommitted.
+    _frozenBlockRows = std::max<size_t>(32, 64 * 1024 / rowStride);
 }
 
 // MEM_COMMITs the memory and constructs all ROWs up to and including the given row pointer.
@@ -144,6 +149,10 @@ void TextBuffer::_decommit() noexcept
     _destroy();
     VirtualFree(_buffer.get(), 0, MEM_DECOMMIT);
     _commitWatermark = _buffer.get();
+    _frozenBlocks.clear();
+    _frozenBlockCount = 0;
+    _thawedBlocks.clear();
+    _markIndex.clear();
 }
 
 // Constructs ROWs between [_commitWatermark,until).
@@ -158,12 +167,16 @@ void TextBuffer::_construct(const std::byte* until) noexcept
     }
 }
 
-// Destructs ROWs between [_buffer,_commitWatermark).
+// Destructs ROWs between [_buffer,_commitWatermark), except for those that are frozen (and thus already destroyed).
 void TextBuffer::_destroy() const noexcept
 {
-    for (auto it = _buffer.get(); it < _commitWatermark; it += _bufferRowStride)
+    size_t offset = 0;
+    for (auto it = _buffer.get(); it < _commitWatermark; it += _bufferRowStride, ++offset)
     {
-        std::destroy_at(reinterpret_cast<ROW*>(it));
+        if (!_isFrozen(offset))
+        {
+            std::destroy_at(reinterpret_cast<ROW*>(it));
+        }
     }
 }
 
@@ -178,6 +191,10 @@ ROW& TextBuffer::_getRowByOffsetDirect(size_t offset)
     {
         _commit(row);
     }
+    else if (_frozenBlockCount != 0 && _isFrozen(offset))
+    {
+        _thaw(offset);
+    }
 
     return *reinterpret_cast<ROW*>(row);
 }
@@ -214,6 +231,127 @@ til::CoordType TextBuffer::_estimateOffsetOfLastCommittedRow() const noexcept
     return std::max(0, gsl::narrow_cast<til::CoordType>(lastRowOffset - 2));
 }
 
+bool TextBuffer::_isFrozen(const size_t offset) const noexcept
+{
+    if (offset == 0)
+    {
+        return false;
+    }
+    const auto index = (offset - 1) / _frozenBlockRows;
+    return index < _frozenBlocks.size() && til::at(_frozenBlocks, index).frozen;
+}
+
+// Returns the [beg,end) range of memory occupied by the ROWs of the given block.
+std::pair<std::byte*, std::byte*> TextBuffer::_frozenBlockRange(const size_t block) const noexcept
+{
+    const auto first = 1 + block * _frozenBlockRows;
+    const auto last = std::min(first + _frozenBlockRows, size_t{ _height } + 1);
+    return { _buffer.get() + first * _bufferRowStride, _buffer.get() + last * _bufferRowStride };
+}
+
+// Restores all ROWs of the frozen block that contains the row at the given offset. See FreezeColdRows().
+// Just like _commit() this is noinline to keep _getRowByOffsetDirect() small.
+__declspec(noinline) void TextBuffer::_thaw(const size_t offset)
+{
+    const auto index = (offset - 1) / _frozenBlockRows;
+    auto& block = til::at(_frozenBlocks, index);
+    const auto [beg, end] = _frozenBlockRange(index);
+
+    THROW_LAST_ERROR_IF_NULL(VirtualAlloc(beg, end - beg, MEM_COMMIT, PAGE_READWRITE));
+
+    const auto data = std::move(block.data);
+    const auto size = block.size;
+    _thawedBlocks.emplace_back(index);
+
+    // Construct all ROWs first, so that the block is in a valid state, even if unpacking them throws.
+    for (auto it = beg; it < end; it += _bufferRowStride)
+    {
+        const auto chars = reinterpret_cast<wchar_t*>(it + _bufferOffsetChars);
+        const auto indices = reinterpret_cast<uint16_t*>(it + _bufferOffsetCharOffsets);
+        std::construct_at(reinterpret_cast<ROW*>(it), chars, indices, _width, _initialAttributes);
+    }
+
+    block = {};
+    _frozenBlockCount--;
+
+    const auto packed = std::make_unique_for_overwrite<uint8_t[]>(size);
+    // The data was compressed by _freeze() and is never touched by anyone else, so this can only fail if memory got corrupted.
+    FAIL_FAST_IF(!til::lz4::decompress(data, { packed.get(), size }));
+
+    std::span<const uint8_t> in{ packed.get(), size };
+    for (auto it = beg; it < end; it += _bufferRowStride)
+    {
+        reinterpret_cast<ROW*>(it)->Unpack(in);
+    }
+}
+
+// Packs and compresses all ROWs of the given block, destroys them and decommits their memory.
+// Blocks containing images are skipped, because ROW::Pack() doesn't support them.
+void TextBuffer::_freeze(const size_t index)
+{
+    const auto [beg, end] = _frozenBlockRange(index);
+
+    for (auto it = beg; it < end; it += _bufferRowStride)
+    {
+        if (reinterpret_cast<const ROW*>(it)->GetImageSlice())
+        {
+            return;
+        }
+    }
+
+    auto& block = til::at(_frozenBlocks, index);
+
+    std::vector<uint8_t> packed;
+    packed.reserve(gsl::narrow_cast<size_t>(end - beg));
+    for (auto it = beg; it < end; it += _bufferRowStride)
+    {
+        const auto row = reinterpret_cast<const ROW*>(it);
+        row->Pack(packed);
+
+        const auto hyperlinks = row->GetHyperlinks();
+        block.hyperlinks.insert(block.hyperlinks.end(), hyperlinks.begin(), hyperlinks.end());
+    }
+
+    std::sort(block.hyperlinks.begin(), block.hyperlinks.end());
+    block.hyperlinks.erase(std::unique(block.hyperlinks.begin(), block.hyperlinks.end()), block.hyperlinks.end());
+    block.hyperlinks.shrink_to_fit();
+    til::lz4::compress(packed, block.data);
+    block.data.shrink_to_fit();
+    block.size = packed.size();
+
+    // While the rows are frozen, _collectMarks() relies on the copy of their ScrollbarData in the index.
+    const auto rowBeg = gsl::narrow_cast<til::CoordType>(index * _frozenBlockRows);
+    const auto rowEnd = rowBeg + gsl::narrow_cast<til::CoordType>((end - beg) / _bufferRowStride);
+    for (auto& entry : _markIndex)
+    {
+        if (entry.row >= rowBeg && entry.row < rowEnd)
+        {
+            const auto& data = reinterpret_cast<const ROW*>(beg + (entry.row - rowBeg) * _bufferRowStride)->GetScrollbarData();
+            entry.row = data ? entry.row : -1;
+            entry.data = data.value_or(ScrollbarData{});
+        }
+    }
+    std::erase_if(_markIndex, [](const auto& entry) { return entry.row < 0; });
+
+    for (auto it = beg; it < end; it += _bufferRowStride)
+    {
+        std::destroy_at(reinterpret_cast<ROW*>(it));
+    }
+
+    // Only the pages that are entirely covered by this block can be decommitted.
+    // The ones at the edges are shared with the neighboring blocks. (4KiB is the page size on all Windows platforms.)
+    static constexpr uintptr_t pageSize = 4096;
+    const auto pageBeg = (reinterpret_cast<uintptr_t>(beg) + pageSize - 1) & ~(pageSize - 1);
+    const auto pageEnd = reinterpret_cast<uintptr_t>(end) & ~(pageSize - 1);
+    if (pageBeg < pageEnd)
+    {
+        VirtualFree(reinterpret_cast<void*>(pageBeg), pageEnd - pageBeg, MEM_DECOMMIT);
+    }
+
+    block.frozen = true;
+    _frozenBlockCount++;
+}
+
 // Retrieves a row from the buffer by its offset from the first row of the text buffer
 // (what corresponds to the top row of the screen buffer).
 const ROW& TextBuffer::GetRowByOffset(const til::CoordType index) const
@@ -226,7 +364,9 @@ const ROW& TextBuffer::GetRowByOffset(const til::CoordType index) const
 ROW& TextBuffer::GetMutableRowByOffset(const til::CoordType index)
 {
     _lastMutationId++;
-    return _getRow(index);
+    auto& row = _getRow(index);
+    row.SetMutationId(_lastMutationId);
+    return row;
 }
 
 // Returns a row filled with whitespace and the current attributes, for you to freely use.
@@ -531,7 +671,7 @@ void TextBuffer::Replace(til::CoordType row, const TextAttribute& attributes, Ro
     r.ReplaceText(state);
     r.ReplaceAttributes(state.columnBegin, state.columnEnd, attributes);
     ImageSlice::EraseCells(r, state.columnBegin, state.columnEnd);
-    TriggerRedraw(Viewport::FromExclusive({ state.columnBeginDirty, row, state.columnEndDirty, row + 1 }));
+    NotifyPaintFrame();
 }
 
 void TextBuffer::Insert(til::CoordType row, const TextAttribute& attributes, RowWriteState& state)
@@ -565,7 +705,7 @@ void TextBuffer::Insert(til::CoordType row, const TextAttribute& attributes, Row
     // Image content at the insert position needs to be erased.
     ImageSlice::EraseCells(r, state.columnBegin, restoreState.columnBegin);
 
-    TriggerRedraw(Viewport::FromExclusive({ state.columnBeginDirty, row, restoreState.columnEndDirty, row + 1 }));
+    NotifyPaintFrame();
 }
 
 // Fills an area of the buffer with a given fill character(s) and attributes.
@@ -619,9 +759,10 @@ void TextBuffer::FillRect(const til::rect& rect, const std::wstring_view& fill,
             r.CopyTextFrom(state);
             r.ReplaceAttributes(rect.left, rect.right, attributes);
             ImageSlice::EraseCells(r, rect.left, rect.right);
-            TriggerRedraw(Viewport::FromExclusive({ state.columnBeginDirty, y, state.columnEndDirty, y + 1 }));
         }
     }
+
+    NotifyPaintFrame();
 }
 
 // Routine Description:
@@ -699,11 +840,7 @@ OutputCellIterator TextBuffer::WriteLine(const OutputCellIterator givenIt,
     //  Get the row and write the cells
     auto& row = GetMutableRowByOffset(target.y);
     const auto newIt = row.WriteCells(givenIt, target.x, wrap, limitRight);
-
-    // Take the cell distance written and notify that it needs to be repainted.
-    const auto written = newIt.GetCellDistance(givenIt);
-    const auto paint = Viewport::FromDimensions(target, { written, 1 });
-    TriggerRedraw(paint);
+    NotifyPaintFrame();
 
     return newIt;
 }
@@ -716,10 +853,7 @@ OutputCellIterator TextBuffer::WriteLine(const OutputCellIterator givenIt,
 // - true if we successfully incremented the buffer.
 void TextBuffer::IncrementCircularBuffer(const TextAttribute& fillAttributes)
 {
-    // Prune hyperlinks to delete obsolete references
-    _PruneHyperlinks();
-
-    // Second, clean out the old "first row" as it will become the "last row" of the buffer after the circle is performed.
+    // Clean out the old "first row" as it will become the "last row" of the buffer after the circle is performed.
     GetMutableRowByOffset(0).Reset(fillAttributes);
     {
         // Now proceed to increment.
@@ -868,6 +1002,11 @@ void TextBuffer::CopyRow(const til::CoordType srcRowIndex, const til::CoordType
     const auto& srcRow = GetRowByOffset(srcRowIndex);
     dstRow.CopyFrom(srcRow);
     ImageSlice::CopyRow(srcRow, dstRow);
+
+    if (srcRow.GetScrollbarData())
+    {
+        dstBuffer._indexMark(dstRowIndex);
+    }
 }
 
 Cursor& TextBuffer::GetCursor() noexcept
@@ -920,7 +1059,7 @@ void TextBuffer::SetCurrentLineRendition(const LineRendition lineRendition, cons
             // We also need to make sure the cursor is clamped within the new width.
             GetCursor().SetPosition(ClampPositionWithinLine(cursorPosition));
         }
-        TriggerRedraw(Viewport::FromDimensions({ 0, rowIndex }, { GetSize().Width(), 1 }));
+        NotifyPaintFrame();
     }
 }
 
@@ -1014,6 +1153,63 @@ void TextBuffer::ClearScrollback(const til::CoordType newFirstRow, const til::Co
     }
 }
 
+// Freezes the blocks of rows that are more than hotRowCount rows above the cursor, which reduces the memory usage
+// of large scrollbacks to a fraction. Frozen rows are transparently thawed when they're accessed again.
+// Since this destroys ROWs, it must not be called while anyone holds on to a ROW reference.
+void TextBuffer::FreezeColdRows(const til::CoordType hotRowCount)
+{
+    // This walks all blocks, so it's only worth doing once enough rows changed to make another block cold.
+    if (_lastMutationId - _lastFreezeMutationId < _frozenBlockRows)
+    {
+        return;
+    }
+    _lastFreezeMutationId = _lastMutationId;
+
+    // Rows with a y below this are cold.
+    const auto coldEnd = _cursor.GetPosition().y - hotRowCount;
+    if (coldEnd <= 0)
+    {
+        return;
+    }
+
+    const auto height = size_t{ _height };
+    const auto blockCount = (height + _frozenBlockRows - 1) / _frozenBlockRows;
+    const auto committedOffsetEnd = gsl::narrow_cast<size_t>((_commitWatermark - _buffer.get()) / _bufferRowStride);
+
+    _frozenBlocks.resize(blockCount);
+
+    // The oldest thawed blocks beyond the limit may be frozen again.
+    if (_thawedBlocks.size() > _thawedBlocksLimit)
+    {
+        _thawedBlocks.erase(_thawedBlocks.begin(), _thawedBlocks.end() - _thawedBlocksLimit);
+    }
+
+    for (size_t index = 0; index < blockCount; ++index)
+    {
+        const auto first = 1 + index * _frozenBlockRows;
+        const auto last = std::min(first + _frozenBlockRows, height + 1);
+
+        // All ROWs need to have been constructed.
+        if (last > committedOffsetEnd)
+        {
+            break;
+        }
+        if (til::at(_frozenBlocks, index).frozen || std::ranges::find(_thawedBlocks, index) != _thawedBlocks.end())
+        {
+            continue;
+        }
+
+        // Turn the offsets into y coordinates. If yLast < yFirst, the block contains the wrap-around
+        // point of the circular buffer and thus both the first and last row of the buffer.
+        const auto yFirst = (first - 1 + height - _firstRow) % height;
+        const auto yLast = (last - 2 + height - _firstRow) % height;
+        if (yFirst <= yLast && yLast < gsl::narrow_cast<size_t>(coldEnd))
+        {
+            _freeze(index);
+        }
+    }
+}
+
 // Routine Description:
 // - This is the legacy screen resize with minimal changes
 // Arguments:
@@ -1052,6 +1248,11 @@ void TextBuffer::ResizeTraditional(til::size newSize)
     _bufferOffsetCharOffsets = newBuffer._bufferOffsetCharOffsets;
     _width = newBuffer._width;
     _height = newBuffer._height;
+    _frozenBlocks = std::move(newBuffer._frozenBlocks);
+    _frozenBlockCount = newBuffer._frozenBlockCount;
+    _frozenBlockRows = newBuffer._frozenBlockRows;
+    _thawedBlocks = std::move(newBuffer._thawedBlocks);
+    _markIndex = std::move(newBuffer._markIndex);
 
     _SetFirstRowIndex(0);
 }
@@ -1410,50 +1611,62 @@ til::point TextBuffer::_GetWordEndForSelection(const til::point target, const st
     return result;
 }
 
+// Frees the entries of all hyperlinks that are neither used by any row nor by the current attributes,
+// so that their IDs can be reused. See _hyperlinks for how this is amortized.
 void TextBuffer::_PruneHyperlinks()
 {
-    // Check the old first row for hyperlink references
-    // If there are any, search the entire buffer for the same reference
-    // If the buffer does not contain the same reference, we can remove that hyperlink from our map
-    // This way, obsolete hyperlink references are cleared from our hyperlink map instead of hanging around
-    // Get all the hyperlink references in the row we're erasing
-    const auto hyperlinks = GetRowByOffset(0).GetHyperlinks();
+    std::vector<bool> referenced(_hyperlinks.size());
+    const auto mark = [&](const uint16_t id) {
+        if (id < referenced.size())
+        {
+            referenced[id] = true;
+        }
+    };
 
-    if (!hyperlinks.empty())
+    mark(_currentAttributes.GetHyperlinkId());
+
+    for (const auto id : _pinnedHyperlinks)
     {
-        // Move to unordered set so we can use hashed lookup of IDs instead of linear search.
-        // Only make it an unordered set now because set always heap allocates but vector
-        // doesn't when the set is empty (saving an allocation in the common case of no links.)
-        std::unordered_set<uint16_t> firstRowRefs{ hyperlinks.cbegin(), hyperlinks.cend() };
+        mark(id);
+    }
 
-        const auto total = TotalRowCount();
-        // Loop through all the rows in the buffer except the first row -
-        // we have found all hyperlink references in the first row and put them in refs,
-        // now we need to search the rest of the buffer (i.e. all the rows except the first)
-        // to see if those references are anywhere else
-        for (til::CoordType i = 1; i < total; ++i)
+    // Frozen blocks remember their hyperlinks, so that we don't need to thaw them here.
+    for (const auto& block : _frozenBlocks)
+    {
+        for (const auto id : block.hyperlinks)
         {
-            const auto nextRowRefs = GetRowByOffset(i).GetHyperlinks();
-            for (auto id : nextRowRefs)
-            {
-                if (firstRowRefs.find(id) != firstRowRefs.end())
-                {
-                    firstRowRefs.erase(id);
-                }
-            }
-            if (firstRowRefs.empty())
+            mark(id);
+        }
+    }
+
+    // Rows that haven't been committed yet can't contain any hyperlinks.
+    size_t offset = 0;
+    for (auto it = _buffer.get(); it < _commitWatermark; it += _bufferRowStride, ++offset)
+    {
+        if (!_isFrozen(offset))
+        {
+            for (const auto id : reinterpret_cast<const ROW*>(it)->GetHyperlinks())
             {
-                // No more hyperlink references left to search for, terminate early
-                break;
+                mark(id);
             }
         }
+    }
 
-        // Now delete obsolete references from our map
-        for (auto hyperlinkReference : firstRowRefs)
+    // Rebuilding the free list also picks up the gaps that AddHyperlinkToMap() may have left behind.
+    _freeHyperlinkIds.clear();
+    for (size_t id = 1; id < _hyperlinks.size(); ++id)
+    {
+        if (_hyperlinks[id].uri.empty())
+        {
+            _freeHyperlinkIds.emplace_back(gsl::narrow_cast<uint16_t>(id));
+        }
+        else if (!referenced[id])
         {
-            RemoveHyperlinkFromMap(hyperlinkReference);
+            RemoveHyperlinkFromMap(gsl::narrow_cast<uint16_t>(id));
         }
     }
+
+    _hyperlinkPruneThreshold = std::clamp<size_t>(_hyperlinkCount * 2, _hyperlinkPruneMinimum, UINT16_MAX);
 }
 
 // Method Description:
@@ -1919,66 +2132,242 @@ std::wstring TextBuffer::GetPlainText(const CopyRequest& req) const
 }
 
 // Routine Description:
-// - Generates a CF_HTML compliant structure from the selected region of the buffer
+// - Generates the plain text, and optionally the CF_HTML and RTF representations, of the selected region of the buffer.
+// - All formats are generated in a single pass over the selection and written straight into their final strings.
+//   The colors of each distinct TextAttribute are only retrieved and formatted once, not once per run.
 // Arguments:
 // - req - the copy request having the bounds of the selected region and other related configuration flags.
+// - html - whether to generate CF_HTML
+// - rtf - whether to generate RTF (1.5 Spec: https://www.biblioscape.com/rtf15_spec.htm,
+//   1.9.1 Spec: https://msopenspecs.azureedge.net/files/Archive_References/[MSFT-RTF].pdf)
 // - fontHeightPoints - the unscaled font height
 // - fontFaceName - the name of the font used
 // - backgroundColor - default background color for characters, also used in padding
 // - isIntenseBold - true if being intense is treated as being bold
 // - GetAttributeColors - function to get the colors of the text attributes as they're rendered
 // Return Value:
-// - string containing the generated HTML. Empty if the copy request is invalid.
-std::string TextBuffer::GenHTML(const CopyRequest& req,
-                                const int fontHeightPoints,
-                                const std::wstring_view fontFaceName,
-                                const COLORREF backgroundColor,
-                                const bool isIntenseBold,
-                                std::function<std::tuple<COLORREF, COLORREF, COLORREF>(const TextAttribute&)> GetAttributeColors) const noexcept
-{
-    // GH#5347 - Don't provide a title for the generated HTML, as many
-    // web applications will paste the title first, followed by the HTML
-    // content, which is unexpected.
+// - The generated formats. They're all empty if the copy request is invalid. The html and rtf strings are
+//   also empty if they weren't requested, or if generating them failed. The html string is CF_HTML compliant, including its header.
+TextBuffer::CopyFormats TextBuffer::GenCopyFormats(const CopyRequest& req,
+                                                   const bool html,
+                                                   const bool rtf,
+                                                   const int fontHeightPoints,
+                                                   const std::wstring_view fontFaceName,
+                                                   const COLORREF backgroundColor,
+                                                   const bool isIntenseBold,
+                                                   const std::function<std::tuple<COLORREF, COLORREF, COLORREF>(const TextAttribute&)>& GetAttributeColors) const
+{
+    CopyFormats formats;
 
     if (req.beg > req.end)
     {
-        return {};
+        return formats;
     }
 
-    try
+    auto& plainBuilder = formats.plainText;
+    auto& htmlBuilder = formats.html;
+    auto& rtfBuilder = formats.rtf;
+
+    // Failing to generate HTML or RTF shouldn't prevent the plain text from being copied.
+    // In that case both of them are discarded and only the plain text is generated.
+    auto formatted = html || rtf;
+    const auto abandonFormatting = [&]() noexcept {
+        formatted = false;
+        htmlBuilder = {};
+        rtfBuilder = {};
+    };
+
+    // These are used by CF_HTML to locate the fragment, see the end of this function.
+    // Once filled with values, there will be exactly 157 bytes in the clipboard header.
+    constexpr size_t ClipboardHeaderSize = 157;
+    constexpr std::string_view HtmlHeader = "<!DOCTYPE><HTML><HEAD></HEAD><BODY>";
+    constexpr std::string_view HtmlFooter = "</BODY></HTML>";
+
+    // map to keep track of colors:
+    // keys are colors represented by COLORREF
+    // values are indices of the corresponding colors in the color table
+    std::unordered_map<COLORREF, size_t> rtfColorMap;
+
+    // RTF color table. It precedes the content, but it's only known once all of it has been generated.
+    // It gets inserted at rtfColorTableOffset at the end.
+    std::string rtfColorTable;
+    size_t rtfColorTableOffset = 0;
+
+    const auto getColorTableIndex = [&](const COLORREF color) -> size_t {
+        // Exclude the 0 index for the default color, and start with 1.
+
+        const auto [it, inserted] = rtfColorMap.emplace(color, rtfColorMap.size() + 1);
+        if (inserted)
+        {
+            const auto red = static_cast<int>(GetRValue(color));
+            const auto green = static_cast<int>(GetGValue(color));
+            const auto blue = static_cast<int>(GetBValue(color));
+            fmt::format_to(std::back_inserter(rtfColorTable), FMT_COMPILE("\\red{}\\green{}\\blue{};"), red, green, blue);
+        }
+        return it->second;
+    };
+
+    // The formatted colors of a TextAttribute, for the formats that were requested.
+    struct RunColors
+    {
+        std::string fgHex;
+        std::string bgHex;
+        std::string ulHex;
+        size_t fgIdx = 0;
+        size_t bgIdx = 0;
+        size_t ulIdx = 0;
+    };
+    struct AttributeHasher
+    {
+        size_t operator()(const TextAttribute& attr) const noexcept
+        {
+            return til::hash(&attr, sizeof(attr));
+        }
+    };
+    std::unordered_map<TextAttribute, RunColors, AttributeHasher> colorCache;
+
+    const auto getRunColors = [&](const TextAttribute& attr) -> const RunColors& {
+        auto it = colorCache.find(attr);
+        if (it == colorCache.end())
+        {
+            const auto [fg, bg, ul] = GetAttributeColors(attr);
+            RunColors colors;
+            if (html)
+            {
+                colors.fgHex = Utils::ColorToHexString(fg);
+                colors.bgHex = Utils::ColorToHexString(bg);
+                colors.ulHex = Utils::ColorToHexString(ul);
+            }
+            if (rtf)
+            {
+                colors.fgIdx = getColorTableIndex(fg);
+                colors.bgIdx = getColorTableIndex(bg);
+                colors.ulIdx = getColorTableIndex(ul);
+            }
+            it = colorCache.emplace(attr, std::move(colors)).first;
+        }
+        return it->second;
+    };
+
+    if (formatted)
     {
-        std::string htmlBuilder;
+        try
+        {
+            if (html)
+            {
+                // GH#5347 - Don't provide a title for the generated HTML, as many
+                // web applications will paste the title first, followed by the HTML
+                // content, which is unexpected.
+
+                // Reserve the space for the clipboard header, which is filled in at the end.
+                htmlBuilder.append(ClipboardHeaderSize, ' ');
+
+                // First we have to add some standard HTML boiler plate required for
+                // CF_HTML as part of the HTML Clipboard format
+                htmlBuilder += HtmlHeader;
+
+                htmlBuilder += "<!--StartFragment -->";
+
+                // apply global style in div element
+                {
+                    htmlBuilder += "<DIV STYLE=\"";
+                    htmlBuilder += "display:inline-block;";
+                    htmlBuilder += "white-space:pre;";
+                    fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("background-color:{};"), Utils::ColorToHexString(backgroundColor));
 
-        // First we have to add some standard HTML boiler plate required for
-        // CF_HTML as part of the HTML Clipboard format
-        constexpr std::string_view htmlHeader = "<!DOCTYPE><HTML><HEAD></HEAD><BODY>";
-        htmlBuilder += htmlHeader;
+                    // even with different font, add monospace as fallback
+                    fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("font-family:'{}',monospace;"), til::u16u8(fontFaceName));
 
-        htmlBuilder += "<!--StartFragment -->";
+                    fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("font-size:{}pt;"), fontHeightPoints);
 
-        // apply global style in div element
+                    // note: MS Word doesn't support padding (in this way at least)
+                    // todo: customizable padding
+                    htmlBuilder += "padding:4px;";
+
+                    htmlBuilder += "\">";
+                }
+            }
+
+            if (rtf)
+            {
+                // start rtf
+                rtfBuilder += "{";
+
+                // Standard RTF header.
+                // This is similar to the header generated by WordPad.
+                // \ansi:
+                //   Specifies that the ANSI char set is used in the current doc.
+                // \ansicpg1252:
+                //   Represents the ANSI code page which is used to perform
+                //   the Unicode to ANSI conversion when writing RTF text.
+                // \deff0:
+                //   Specifies that the default font for the document is the one
+                //   at index 0 in the font table.
+                // \nouicompat:
+                //   Some features are blocked by default to maintain compatibility
+                //   with older programs (Eg. Word 97-2003). `nouicompat` disables this
+                //   behavior, and unblocks these features. See: Spec 1.9.1, Pg. 51.
+                rtfBuilder += "\\rtf1\\ansi\\ansicpg1252\\deff0\\nouicompat";
+
+                // font table
+                // Brace escape: add an extra brace (of same kind) after a brace to escape it within the format string.
+                fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("{{\\fonttbl{{\\f0\\fmodern\\fcharset0 {};}}}}"), til::u16u8(fontFaceName));
+
+                rtfColorTableOffset = rtfBuilder.size();
+                rtfColorTable += "{\\colortbl ;";
+
+                // \viewkindN: View mode of the document to be used. N=4 specifies that the document is in Normal view. (maybe unnecessary?)
+                // \ucN: Number of unicode fallback characters after each codepoint. (global)
+                rtfBuilder += "\\viewkind4\\uc1";
+
+                // paragraph styles
+                // \pard: paragraph description
+                // \slmultN: line-spacing multiple
+                // \fN: font to be used for the paragraph, where N is the font index in the font table
+                rtfBuilder += "\\pard\\slmult1\\f0";
+
+                // \fsN: specifies font size in half-points. E.g. \fs20 results in a font
+                // size of 10 pts. That's why, font size is multiplied by 2 here.
+                fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\fs{}"), 2 * fontHeightPoints);
+
+                // Set the background color for the page. But the standard way (\cbN) to do
+                // this isn't supported in Word. However, the following control words sequence
+                // works in Word (and other RTF editors also) for applying the text background
+                // color. See: Spec 1.9.1, Pg. 23.
+                fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\chshdng0\\chcbpat{}"), getColorTableIndex(backgroundColor));
+            }
+        }
+        catch (...)
         {
-            htmlBuilder += "<DIV STYLE=\"";
-            htmlBuilder += "display:inline-block;";
-            htmlBuilder += "white-space:pre;";
-            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("background-color:{};"), Utils::ColorToHexString(backgroundColor));
+            LOG_CAUGHT_EXCEPTION();
+            abandonFormatting();
+        }
+    }
 
-            // even with different font, add monospace as fallback
-            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("font-family:'{}',monospace;"), til::u16u8(fontFaceName));
+    // Reused for the UTF-8 conversion of each run of HTML text.
+    std::string unescapedText;
 
-            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("font-size:{}pt;"), fontHeightPoints);
+    for (auto iRow = req.beg.y; iRow <= req.end.y; ++iRow)
+    {
+        const auto& row = GetRowByOffset(iRow);
+        const auto [rowBeg, rowEnd, addLineBreak] = _RowCopyHelper(req, iRow, row);
+        // never add line break to the last row.
+        const auto lineBreak = addLineBreak && iRow < req.end.y;
 
-            // note: MS Word doesn't support padding (in this way at least)
-            // todo: customizable padding
-            htmlBuilder += "padding:4px;";
+        // save selected text
+        plainBuilder += row.GetText(rowBeg, rowEnd);
+        if (lineBreak)
+        {
+            plainBuilder += L"\r\n";
+        }
 
-            htmlBuilder += "\">";
+        if (!formatted)
+        {
+            continue;
         }
 
-        for (auto iRow = req.beg.y; iRow <= req.end.y; ++iRow)
+        try
         {
-            const auto& row = GetRowByOffset(iRow);
-            const auto [rowBeg, rowEnd, addLineBreak] = _RowCopyHelper(req, iRow, row);
             const auto rowBegU16 = gsl::narrow_cast<uint16_t>(rowBeg);
             const auto rowEndU16 = gsl::narrow_cast<uint16_t>(rowEnd);
             const auto runs = row.Attributes().slice(rowBegU16, rowEndU16).runs();
@@ -1987,653 +2376,848 @@ std::string TextBuffer::GenHTML(const CopyRequest& req,
             for (const auto& [attr, length] : runs)
             {
                 const auto nextX = gsl::narrow_cast<uint16_t>(x + length);
-                const auto [fg, bg, ul] = GetAttributeColors(attr);
-                const auto fgHex = Utils::ColorToHexString(fg);
-                const auto bgHex = Utils::ColorToHexString(bg);
-                const auto ulHex = Utils::ColorToHexString(ul);
+                const auto& colors = getRunColors(attr);
+                const auto text = row.GetText(x, nextX);
                 const auto ulStyle = attr.GetUnderlineStyle();
-                const auto isUnderlined = ulStyle != UnderlineStyle::NoUnderline;
-                const auto isCrossedOut = attr.IsCrossedOut();
-                const auto isOverlined = attr.IsOverlined();
-
-                htmlBuilder += "<SPAN STYLE=\"";
-                fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("color:{};"), fgHex);
-                fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("background-color:{};"), bgHex);
 
-                if (isIntenseBold && attr.IsIntense())
+                if (html)
                 {
-                    htmlBuilder += "font-weight:bold;";
-                }
+                    const auto isUnderlined = ulStyle != UnderlineStyle::NoUnderline;
+                    const auto isCrossedOut = attr.IsCrossedOut();
+                    const auto isOverlined = attr.IsOverlined();
 
-                if (attr.IsItalic())
-                {
-                    htmlBuilder += "font-style:italic;";
-                }
+                    htmlBuilder += "<SPAN STYLE=\"";
+                    fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("color:{};"), colors.fgHex);
+                    fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("background-color:{};"), colors.bgHex);
 
-                if (isCrossedOut || isOverlined)
-                {
-                    fmt::format_to(std::back_inserter(htmlBuilder),
-                                   FMT_COMPILE("text-decoration:{} {} {};"),
-                                   isCrossedOut ? "line-through" : "",
-                                   isOverlined ? "overline" : "",
-                                   fgHex);
+                    if (isIntenseBold && attr.IsIntense())
+                    {
+                        htmlBuilder += "font-weight:bold;";
+                    }
+
+                    if (attr.IsItalic())
+                    {
+                        htmlBuilder += "font-style:italic;";
+                    }
+
+                    if (isCrossedOut || isOverlined)
+                    {
+                        fmt::format_to(std::back_inserter(htmlBuilder),
+                                       FMT_COMPILE("text-decoration:{} {} {};"),
+                                       isCrossedOut ? "line-through" : "",
+                                       isOverlined ? "overline" : "",
+                                       colors.fgHex);
+                    }
+
+                    if (isUnderlined)
+                    {
+                        // Since underline, overline and strikethrough use the same css property,
+                        // we cannot apply different colors to them at the same time. However, we
+                        // can achieve the desired result by creating a nested <span> and applying
+                        // underline style and color to it.
+                        htmlBuilder += "\"><SPAN STYLE=\"";
+
+                        switch (ulStyle)
+                        {
+                        case UnderlineStyle::NoUnderline:
+                            break;
+                        case UnderlineStyle::DoublyUnderlined:
+                            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline double {};"), colors.ulHex);
+                            break;
+                        case UnderlineStyle::CurlyUnderlined:
+                            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline wavy {};"), colors.ulHex);
+                            break;
+                        case UnderlineStyle::DottedUnderlined:
+                            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline dotted {};"), colors.ulHex);
+                            break;
+                        case UnderlineStyle::DashedUnderlined:
+                            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline dashed {};"), colors.ulHex);
+                            break;
+                        case UnderlineStyle::SinglyUnderlined:
+                        default:
+                            fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline {};"), colors.ulHex);
+                            break;
+                        }
+                    }
+
+                    htmlBuilder += "\">";
+
+                    // text
+                    THROW_IF_FAILED(til::u16u8(text, unescapedText));
+                    for (const auto c : unescapedText)
+                    {
+                        switch (c)
+                        {
+                        case '<':
+                            htmlBuilder += "&lt;";
+                            break;
+                        case '>':
+                            htmlBuilder += "&gt;";
+                            break;
+                        case '&':
+                            htmlBuilder += "&amp;";
+                            break;
+                        default:
+                            htmlBuilder += c;
+                        }
+                    }
+
+                    if (isUnderlined)
+                    {
+                        // close the nested span we created for underline
+                        htmlBuilder += "</SPAN>";
+                    }
+
+                    htmlBuilder += "</SPAN>";
                 }
 
-                if (isUnderlined)
+                if (rtf)
                 {
-                    // Since underline, overline and strikethrough use the same css property,
-                    // we cannot apply different colors to them at the same time. However, we
-                    // can achieve the desired result by creating a nested <span> and applying
-                    // underline style and color to it.
-                    htmlBuilder += "\"><SPAN STYLE=\"";
+                    // start an RTF group that can be closed later to restore the
+                    // default attribute.
+                    rtfBuilder += "{";
+
+                    fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\cf{}"), colors.fgIdx);
+                    fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\chshdng0\\chcbpat{}"), colors.bgIdx);
+
+                    if (isIntenseBold && attr.IsIntense())
+                    {
+                        rtfBuilder += "\\b";
+                    }
+
+                    if (attr.IsItalic())
+                    {
+                        rtfBuilder += "\\i";
+                    }
+
+                    if (attr.IsCrossedOut())
+                    {
+                        rtfBuilder += "\\strike";
+                    }
 
                     switch (ulStyle)
                     {
                     case UnderlineStyle::NoUnderline:
                         break;
                     case UnderlineStyle::DoublyUnderlined:
-                        fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline double {};"), ulHex);
+                        fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\uldb\\ulc{}"), colors.ulIdx);
                         break;
                     case UnderlineStyle::CurlyUnderlined:
-                        fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline wavy {};"), ulHex);
+                        fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\ulwave\\ulc{}"), colors.ulIdx);
                         break;
                     case UnderlineStyle::DottedUnderlined:
-                        fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline dotted {};"), ulHex);
+                        fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\uld\\ulc{}"), colors.ulIdx);
                         break;
                     case UnderlineStyle::DashedUnderlined:
-                        fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline dashed {};"), ulHex);
+                        fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\uldash\\ulc{}"), colors.ulIdx);
                         break;
                     case UnderlineStyle::SinglyUnderlined:
                     default:
-                        fmt::format_to(std::back_inserter(htmlBuilder), FMT_COMPILE("text-decoration:underline {};"), ulHex);
+                        fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("\\ul\\ulc{}"), colors.ulIdx);
                         break;
                     }
-                }
 
-                htmlBuilder += "\">";
+                    // RTF commands and the text data must be separated by a space.
+                    // Otherwise, if the text begins with a space then that space will
+                    // be interpreted as part of the last command, and will be lost.
+                    rtfBuilder += " ";
 
-                // text
-                std::string unescapedText;
-                THROW_IF_FAILED(til::u16u8(row.GetText(x, nextX), unescapedText));
-                for (const auto c : unescapedText)
-                {
-                    switch (c)
-                    {
-                    case '<':
-                        htmlBuilder += "&lt;";
-                        break;
-                    case '>':
-                        htmlBuilder += "&gt;";
-                        break;
-                    case '&':
-                        htmlBuilder += "&amp;";
-                        break;
-                    default:
-                        htmlBuilder += c;
-                    }
-                }
+                    _AppendRTFText(rtfBuilder, text);
 
-                if (isUnderlined)
-                {
-                    // close the nested span we created for underline
-                    htmlBuilder += "</SPAN>";
+                    rtfBuilder += "}"; // close RTF group
                 }
 
-                htmlBuilder += "</SPAN>";
-
                 // advance to next run of text
                 x = nextX;
             }
 
-            // never add line break to the last row.
-            if (addLineBreak && iRow < req.end.y)
+            if (lineBreak)
             {
-                htmlBuilder += "<BR>";
+                if (html)
+                {
+                    htmlBuilder += "<BR>";
+                }
+                if (rtf)
+                {
+                    rtfBuilder += "\\line";
+                }
             }
         }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            abandonFormatting();
+        }
+    }
 
-        htmlBuilder += "</DIV>";
-
-        htmlBuilder += "<!--EndFragment -->";
-
-        constexpr std::string_view HtmlFooter = "</BODY></HTML>";
-        htmlBuilder += HtmlFooter;
-
-        // once filled with values, there will be exactly 157 bytes in the clipboard header
-        constexpr size_t ClipboardHeaderSize = 157;
-
-        // these values are byte offsets from start of clipboard
-        const auto htmlStartPos = ClipboardHeaderSize;
-        const auto htmlEndPos = ClipboardHeaderSize + gsl::narrow<size_t>(htmlBuilder.length());
-        const auto fragStartPos = ClipboardHeaderSize + gsl::narrow<size_t>(htmlHeader.length());
-        const auto fragEndPos = htmlEndPos - HtmlFooter.length();
+    if (formatted)
+    {
+        try
+        {
+            if (html)
+            {
+                htmlBuilder += "</DIV>";
+
+                htmlBuilder += "<!--EndFragment -->";
+
+                htmlBuilder += HtmlFooter;
+
+                // these values are byte offsets from start of clipboard
+                const auto htmlStartPos = ClipboardHeaderSize;
+                const auto htmlEndPos = htmlBuilder.size();
+                const auto fragStartPos = ClipboardHeaderSize + HtmlHeader.size();
+                const auto fragEndPos = htmlEndPos - HtmlFooter.size();
+
+                // header required by HTML 0.9 format, written into the space reserved at the start
+                const auto result = fmt::format_to_n(htmlBuilder.data(),
+                                                     ClipboardHeaderSize,
+                                                     FMT_COMPILE("Version:0.9\r\n"
+                                                                 "StartHTML:{:0>10}\r\n"
+                                                                 "EndHTML:{:0>10}\r\n"
+                                                                 "StartFragment:{:0>10}\r\n"
+                                                                 "EndFragment:{:0>10}\r\n"
+                                                                 "StartSelection:{:0>10}\r\n"
+                                                                 "EndSelection:{:0>10}\r\n"),
+                                                     htmlStartPos,
+                                                     htmlEndPos,
+                                                     fragStartPos,
+                                                     fragEndPos,
+                                                     fragStartPos,
+                                                     fragEndPos);
+                THROW_HR_IF(E_UNEXPECTED, result.size != ClipboardHeaderSize);
+            }
 
-        // header required by HTML 0.9 format
-        std::string clipHeaderBuilder;
-        clipHeaderBuilder += "Version:0.9\r\n";
-        fmt::format_to(std::back_inserter(clipHeaderBuilder), FMT_COMPILE("StartHTML:{:0>10}\r\n"), htmlStartPos);
-        fmt::format_to(std::back_inserter(clipHeaderBuilder), FMT_COMPILE("EndHTML:{:0>10}\r\n"), htmlEndPos);
-        fmt::format_to(std::back_inserter(clipHeaderBuilder), FMT_COMPILE("StartFragment:{:0>10}\r\n"), fragStartPos);
-        fmt::format_to(std::back_inserter(clipHeaderBuilder), FMT_COMPILE("EndFragment:{:0>10}\r\n"), fragEndPos);
-        fmt::format_to(std::back_inserter(clipHeaderBuilder), FMT_COMPILE("StartSelection:{:0>10}\r\n"), fragStartPos);
-        fmt::format_to(std::back_inserter(clipHeaderBuilder), FMT_COMPILE("EndSelection:{:0>10}\r\n"), fragEndPos);
+            if (rtf)
+            {
+                // add color table to the final RTF
+                rtfColorTable += "}";
+                rtfBuilder.insert(rtfColorTableOffset, rtfColorTable);
 
-        return clipHeaderBuilder + htmlBuilder;
-    }
-    catch (...)
-    {
-        LOG_HR(wil::ResultFromCaughtException());
-        return {};
+                // close the document
+                rtfBuilder += "}";
+            }
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            abandonFormatting();
+        }
     }
+
+    return formats;
 }
 
-// Routine Description:
-// - Generates an RTF document from the selected region of the buffer
-//   RTF 1.5 Spec: https://www.biblioscape.com/rtf15_spec.htm
-//   RTF 1.9.1 Spec: https://msopenspecs.azureedge.net/files/Archive_References/[MSFT-RTF].pdf
-// Arguments:
-// - req - the copy request having the bounds of the selected region and other related configuration flags.
-// - fontHeightPoints - the unscaled font height
-// - fontFaceName - the name of the font used
-// - backgroundColor - default background color for characters, also used in padding
-// - isIntenseBold - true if being intense is treated as being bold
-// - GetAttributeColors - function to get the colors of the text attributes as they're rendered
-// Return Value:
-// - string containing the generated RTF. Empty if the copy request is invalid.
-std::string TextBuffer::GenRTF(const CopyRequest& req,
-                               const int fontHeightPoints,
-                               const std::wstring_view fontFaceName,
-                               const COLORREF backgroundColor,
-                               const bool isIntenseBold,
-                               std::function<std::tuple<COLORREF, COLORREF, COLORREF>(const TextAttribute&)> GetAttributeColors) const noexcept
+void TextBuffer::_AppendRTFText(std::string& contentBuilder, const std::wstring_view& text)
 {
-    if (req.beg > req.end)
-    {
-        return {};
-    }
-
-    try
+    for (const auto codeUnit : text)
     {
-        std::string rtfBuilder;
-
-        // start rtf
-        rtfBuilder += "{";
-
-        // Standard RTF header.
-        // This is similar to the header generated by WordPad.
-        // \ansi:
-        //   Specifies that the ANSI char set is used in the current doc.
-        // \ansicpg1252:
-        //   Represents the ANSI code page which is used to perform
-        //   the Unicode to ANSI conversion when writing RTF text.
-        // \deff0:
-        //   Specifies that the default font for the document is the one
-        //   at index 0 in the font table.
-        // \nouicompat:
-        //   Some features are blocked by default to maintain compatibility
-        //   with older programs (Eg. Word 97-2003). `nouicompat` disables this
-        //   behavior, and unblocks these features. See: Spec 1.9.1, Pg. 51.
-        rtfBuilder += "\\rtf1\\ansi\\ansicpg1252\\deff0\\nouicompat";
-
-        // font table
-        // Brace escape: add an extra brace (of same kind) after a brace to escape it within the format string.
-        fmt::format_to(std::back_inserter(rtfBuilder), FMT_COMPILE("{{\\fonttbl{{\\f0\\fmodern\\fcharset0 {};}}}}"), til::u16u8(fontFaceName));
+        if (codeUnit <= 127)
+        {
+            switch (codeUnit)
+            {
+            case L'\\':
+            case L'{':
+            case L'}':
+                contentBuilder += "\\";
+                [[fallthrough]];
+            default:
+                contentBuilder += gsl::narrow_cast<char>(codeUnit);
+            }
+        }
+        else
+        {
+            // Windows uses unsigned wchar_t - RTF uses signed ones.
+            // '?' is the fallback ascii character.
+            fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\u{}?"), std::bit_cast<int16_t>(codeUnit));
+        }
+    }
+}
 
-        // map to keep track of colors:
-        // keys are colors represented by COLORREF
-        // values are indices of the corresponding colors in the color table
-        std::unordered_map<COLORREF, size_t> colorMap;
+// The binary format written by SerializeSnapshot(). All values are stored in native byte order:
+// * SnapshotHeader
+// * SnapshotHeader::hyperlinkCount times: uint16_t id, uint32_t length, wchar_t uri[length]
+// * SnapshotChunk followed by SnapshotChunk::compressedSize bytes of data, until all rows are stored
+// The data of a chunk is the ROW::Pack() output of SnapshotChunk::rows consecutive rows, compressed with
+// til::lz4. If compression didn't make it any smaller, it's stored as is and compressedSize == uncompressedSize.
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // ROW::Pack() stores TextAttributes as is. This guards against their layout changing between versions.
+    uint32_t attributeSize;
+    int32_t width;
+    int32_t rows;
+    uint32_t hyperlinkCount;
+};
+
+struct SnapshotChunk
+{
+    uint32_t rows;
+    uint32_t uncompressedSize;
+    uint32_t compressedSize;
+};
+
+// "WTBS" in a hex editor. Unlike the VT text that older versions persisted, this doesn't start with a UTF-16 BOM.
+static constexpr uint32_t snapshotMagic = 0x53425457;
+static constexpr uint32_t snapshotVersion = 1;
+// Chunks are compressed and written once they reach this size.
+static constexpr size_t snapshotChunkSize = 256 * 1024;
+// Guards against malformed files making us allocate absurd amounts of memory.
+static constexpr size_t snapshotMaxChunkSize = 16 * 1024 * 1024;
+
+template<typename T>
+static void appendSnapshotValue(std::vector<uint8_t>& out, const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto beg = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), beg, beg + sizeof(T));
+}
 
-        // RTF color table
-        std::string colorTableBuilder;
-        colorTableBuilder += "{\\colortbl ;";
+template<typename T>
+static T readSnapshotValue(std::span<const uint8_t>& in)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), in.size() < sizeof(T));
+    T value;
+    memcpy(&value, in.data(), sizeof(T));
+    in = in.subspan(sizeof(T));
+    return value;
+}
 
-        const auto getColorTableIndex = [&](const COLORREF color) -> size_t {
-            // Exclude the 0 index for the default color, and start with 1.
+// Writes the rows up to the last one with text into a compact binary file, which DeserializeSnapshot() can restore.
+// The rows are stored verbatim, including their marks, which is both faster to write
+// than VT sequences and avoids having to parse them when restoring it.
+void TextBuffer::SerializeSnapshot(const wchar_t* destination) const
+{
+    const wil::unique_handle file{ CreateFileW(destination, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+    THROW_LAST_ERROR_IF(!file);
 
-            const auto [it, inserted] = colorMap.emplace(color, colorMap.size() + 1);
-            if (inserted)
-            {
-                const auto red = static_cast<int>(GetRValue(color));
-                const auto green = static_cast<int>(GetGValue(color));
-                const auto blue = static_cast<int>(GetBValue(color));
-                fmt::format_to(std::back_inserter(colorTableBuilder), FMT_COMPILE("\\red{}\\green{}\\blue{};"), red, green, blue);
-            }
-            return it->second;
-        };
+    const auto write = [&](const std::vector<uint8_t>& data) {
+        const auto size = gsl::narrow<DWORD>(data.size());
+        DWORD bytesWritten = 0;
+        THROW_IF_WIN32_BOOL_FALSE(WriteFile(file.get(), data.data(), size, &bytesWritten, nullptr));
+        THROW_WIN32_IF_MSG(ERROR_WRITE_FAULT, bytesWritten != size, "failed to write");
+    };
 
-        // content
-        std::string contentBuilder;
+    const auto rows = GetLastNonSpaceCharacter(nullptr).y + 1;
+    std::vector<uint8_t> packed;
+    std::vector<uint8_t> output;
+    packed.reserve(snapshotChunkSize * 2);
+    output.reserve(snapshotChunkSize * 2);
 
-        // \viewkindN: View mode of the document to be used. N=4 specifies that the document is in Normal view. (maybe unnecessary?)
-        // \ucN: Number of unicode fallback characters after each codepoint. (global)
-        contentBuilder += "\\viewkind4\\uc1";
+    appendSnapshotValue(output, SnapshotHeader{ snapshotMagic, snapshotVersion, sizeof(TextAttribute), _width, rows, gsl::narrow<uint32_t>(_hyperlinkCount) });
+    for (size_t id = 1; id < _hyperlinks.size(); ++id)
+    {
+        const auto& uri = _hyperlinks[id].uri;
+        if (uri.empty())
+        {
+            continue;
+        }
+        appendSnapshotValue(output, gsl::narrow_cast<uint16_t>(id));
+        appendSnapshotValue(output, gsl::narrow<uint32_t>(uri.size()));
+        const auto beg = reinterpret_cast<const uint8_t*>(uri.data());
+        output.insert(output.end(), beg, beg + uri.size() * sizeof(wchar_t));
+    }
+    write(output);
 
-        // paragraph styles
-        // \pard: paragraph description
-        // \slmultN: line-spacing multiple
-        // \fN: font to be used for the paragraph, where N is the font index in the font table
-        contentBuilder += "\\pard\\slmult1\\f0";
+    uint32_t chunkRows = 0;
+    for (til::CoordType y = 0; y < rows; ++y)
+    {
+        GetRowByOffset(y).Pack(packed);
+        chunkRows++;
 
-        // \fsN: specifies font size in half-points. E.g. \fs20 results in a font
-        // size of 10 pts. That's why, font size is multiplied by 2 here.
-        fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\fs{}"), 2 * fontHeightPoints);
+        if (packed.size() < snapshotChunkSize && y + 1 < rows)
+        {
+            continue;
+        }
 
-        // Set the background color for the page. But the standard way (\cbN) to do
-        // this isn't supported in Word. However, the following control words sequence
-        // works in Word (and other RTF editors also) for applying the text background
-        // color. See: Spec 1.9.1, Pg. 23.
-        fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\chshdng0\\chcbpat{}"), getColorTableIndex(backgroundColor));
+        output.clear();
+        output.resize(sizeof(SnapshotChunk));
+        til::lz4::compress(packed, output);
 
-        for (auto iRow = req.beg.y; iRow <= req.end.y; ++iRow)
+        SnapshotChunk chunk{ chunkRows, gsl::narrow<uint32_t>(packed.size()), gsl::narrow<uint32_t>(output.size() - sizeof(SnapshotChunk)) };
+        if (chunk.compressedSize >= chunk.uncompressedSize)
         {
-            const auto& row = GetRowByOffset(iRow);
-            const auto [rowBeg, rowEnd, addLineBreak] = _RowCopyHelper(req, iRow, row);
-            const auto rowBegU16 = gsl::narrow_cast<uint16_t>(rowBeg);
-            const auto rowEndU16 = gsl::narrow_cast<uint16_t>(rowEnd);
-            const auto runs = row.Attributes().slice(rowBegU16, rowEndU16).runs();
+            output.resize(sizeof(SnapshotChunk));
+            output.insert(output.end(), packed.begin(), packed.end());
+            chunk.compressedSize = chunk.uncompressedSize;
+        }
 
-            auto x = rowBegU16;
-            for (auto& [attr, length] : runs)
-            {
-                const auto nextX = gsl::narrow_cast<uint16_t>(x + length);
-                const auto [fg, bg, ul] = GetAttributeColors(attr);
-                const auto fgIdx = getColorTableIndex(fg);
-                const auto bgIdx = getColorTableIndex(bg);
-                const auto ulIdx = getColorTableIndex(ul);
-                const auto ulStyle = attr.GetUnderlineStyle();
+        memcpy(output.data(), &chunk, sizeof(chunk));
+        write(output);
 
-                // start an RTF group that can be closed later to restore the
-                // default attribute.
-                contentBuilder += "{";
+        packed.clear();
+        chunkRows = 0;
+    }
+}
 
-                fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\cf{}"), fgIdx);
-                fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\chshdng0\\chcbpat{}"), bgIdx);
+// Restores a file written by SerializeSnapshot(). The file is memory mapped and the rows are unpacked straight from it.
+// The returned buffer is as wide as the one that was serialized and has one more row than the snapshot. The cursor is
+// on that extra row, just like it would be after printing the contents. Reflow() it to adapt it to a different size.
+// Return Value:
+// - The restored buffer, or nullptr if the file isn't a snapshot. Throws if it is one, but it's malformed.
+std::unique_ptr<TextBuffer> TextBuffer::DeserializeSnapshot(const HANDLE file)
+{
+    LARGE_INTEGER fileSize{};
+    THROW_IF_WIN32_BOOL_FALSE(GetFileSizeEx(file, &fileSize));
+    if (fileSize.QuadPart < gsl::narrow_cast<LONGLONG>(sizeof(SnapshotHeader)))
+    {
+        return nullptr;
+    }
 
-                if (isIntenseBold && attr.IsIntense())
-                {
-                    contentBuilder += "\\b";
-                }
+    const wil::unique_handle mapping{ CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+    THROW_LAST_ERROR_IF(!mapping);
+    const wil::unique_mapview_ptr<uint8_t> view{ static_cast<uint8_t*>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0)) };
+    THROW_LAST_ERROR_IF(!view);
 
-                if (attr.IsItalic())
-                {
-                    contentBuilder += "\\i";
-                }
+    std::span<const uint8_t> in{ view.get(), gsl::narrow<size_t>(fileSize.QuadPart) };
 
-                if (attr.IsCrossedOut())
-                {
-                    contentBuilder += "\\strike";
-                }
+    const auto header = readSnapshotValue<SnapshotHeader>(in);
+    if (header.magic != snapshotMagic)
+    {
+        return nullptr;
+    }
 
-                switch (ulStyle)
-                {
-                case UnderlineStyle::NoUnderline:
-                    break;
-                case UnderlineStyle::DoublyUnderlined:
-                    fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\uldb\\ulc{}"), ulIdx);
-                    break;
-                case UnderlineStyle::CurlyUnderlined:
-                    fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\ulwave\\ulc{}"), ulIdx);
-                    break;
-                case UnderlineStyle::DottedUnderlined:
-                    fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\uld\\ulc{}"), ulIdx);
-                    break;
-                case UnderlineStyle::DashedUnderlined:
-                    fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\uldash\\ulc{}"), ulIdx);
-                    break;
-                case UnderlineStyle::SinglyUnderlined:
-                default:
-                    fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\ul\\ulc{}"), ulIdx);
-                    break;
-                }
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), header.version != snapshotVersion || header.attributeSize != sizeof(TextAttribute));
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), header.width <= 0 || header.width > SHRT_MAX || header.rows <= 0 || header.rows >= SHRT_MAX);
 
-                // RTF commands and the text data must be separated by a space.
-                // Otherwise, if the text begins with a space then that space will
-                // be interpreted as part of the last command, and will be lost.
-                contentBuilder += " ";
+    auto buffer = std::make_unique<TextBuffer>(til::size{ header.width, header.rows + 1 }, TextAttribute{}, 0, false, nullptr);
 
-                const auto unescapedText = row.GetText(x, nextX); // including character at nextX
-                _AppendRTFText(contentBuilder, unescapedText);
+    for (uint32_t i = 0; i < header.hyperlinkCount; ++i)
+    {
+        const auto id = readSnapshotValue<uint16_t>(in);
+        const auto length = readSnapshotValue<uint32_t>(in);
+        THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), id == 0 || in.size() / sizeof(wchar_t) < length);
 
-                contentBuilder += "}"; // close RTF group
+        std::wstring uri(length, L'\0');
+        memcpy(uri.data(), in.data(), length * sizeof(wchar_t));
+        in = in.subspan(length * sizeof(wchar_t));
 
-                // advance to next run of text
-                x = nextX;
-            }
+        buffer->AddHyperlinkToMap(uri, id);
+    }
+
+    std::vector<uint8_t> unpacked;
+    for (til::CoordType y = 0; y < header.rows;)
+    {
+        const auto chunk = readSnapshotValue<SnapshotChunk>(in);
+        THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), chunk.rows == 0 || chunk.rows > gsl::narrow_cast<uint32_t>(header.rows - y));
+        THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), chunk.compressedSize > in.size() || chunk.uncompressedSize > snapshotMaxChunkSize);
 
-            // never add line break to the last row.
-            if (addLineBreak && iRow < req.end.y)
+        auto data = in.first(chunk.compressedSize);
+        in = in.subspan(chunk.compressedSize);
+
+        if (chunk.compressedSize != chunk.uncompressedSize)
+        {
+            unpacked.resize(chunk.uncompressedSize);
+            THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), !til::lz4::decompress(data, unpacked));
+            data = unpacked;
+        }
+
+        for (uint32_t i = 0; i < chunk.rows; ++i, ++y)
+        {
+            buffer->GetMutableRowByOffset(y).Unpack(data);
+            // Unpack() restored the mutation ID the row had in the serialized buffer, which means nothing in this one.
+            const auto& row = buffer->GetMutableRowByOffset(y);
+            if (row.GetScrollbarData())
             {
-                contentBuilder += "\\line";
+                buffer->_indexMark(y);
             }
         }
 
-        // add color table to the final RTF
-        rtfBuilder += colorTableBuilder + "}";
-
-        // add the text content to the final RTF
-        rtfBuilder += contentBuilder + "}";
-
-        return rtfBuilder;
-    }
-    catch (...)
-    {
-        LOG_HR(wil::ResultFromCaughtException());
-        return {};
+        THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_INVALID_DATA), !data.empty());
     }
+
+    buffer->GetCursor().SetPosition({ 0, header.rows });
+    return buffer;
 }
 
-void TextBuffer::_AppendRTFText(std::string& contentBuilder, const std::wstring_view& text)
+// Calls func(i) for every i in [0,count) on the thread pool as well as the calling thread and returns once all calls finished.
+// The first exception thrown by any of the calls is rethrown on the calling thread.
+template<typename Func>
+static void parallelFor(const size_t count, const Func& func)
 {
-    for (const auto codeUnit : text)
+    struct Context
     {
-        if (codeUnit <= 127)
+        const Func& func;
+        const size_t count;
+        std::atomic<size_t> next{ 0 };
+        std::atomic<bool> failed{ false };
+        std::exception_ptr exception;
+        til::latch done;
+
+        void Run() noexcept
         {
-            switch (codeUnit)
+            for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed))
             {
-            case L'\\':
-            case L'{':
-            case L'}':
-                contentBuilder += "\\";
-                [[fallthrough]];
-            default:
-                contentBuilder += gsl::narrow_cast<char>(codeUnit);
+                try
+                {
+                    func(i);
+                }
+                catch (...)
+                {
+                    if (!failed.exchange(true, std::memory_order_relaxed))
+                    {
+                        exception = std::current_exception();
+                    }
+                }
             }
         }
-        else
+    };
+
+    const auto workers = count - 1;
+    Context context{ .func = func, .count = count, .done = til::latch{ gsl::narrow_cast<ptrdiff_t>(workers) } };
+
+    for (size_t i = 0; i < workers; ++i)
+    {
+        const auto ok = TrySubmitThreadpoolCallback(
+            [](PTP_CALLBACK_INSTANCE, void* ctx) noexcept {
+                const auto context = static_cast<Context*>(ctx);
+                context->Run();
+                context->done.count_down();
+            },
+            &context,
+            nullptr);
+        if (!ok)
         {
-            // Windows uses unsigned wchar_t - RTF uses signed ones.
-            // '?' is the fallback ascii character.
-            fmt::format_to(std::back_inserter(contentBuilder), FMT_COMPILE("\\u{}?"), std::bit_cast<int16_t>(codeUnit));
+            // The calling thread will pick up the work instead.
+            context.done.count_down();
         }
     }
+
+    context.Run();
+    context.done.wait();
+
+    if (context.exception)
+    {
+        std::rethrow_exception(context.exception);
+    }
 }
 
-void TextBuffer::Serialize(const wchar_t* destination) const
+// Used by _reflowParallel() as a stand-in for rows that don't exist (yet) in the new buffer.
+struct ReflowScratchRow
 {
-    const wil::unique_handle file{ CreateFileW(destination, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
-    THROW_LAST_ERROR_IF(!file);
+    ReflowScratchRow(const uint16_t width, const TextAttribute& fillAttribute) :
+        chars(width),
+        charOffsets(width + 1u),
+        row{ chars.data(), charOffsets.data(), width, fillAttribute }
+    {
+    }
 
-    static constexpr size_t writeThreshold = 32 * 1024;
-    std::wstring buffer;
-    buffer.reserve(writeThreshold + writeThreshold / 2);
-    buffer.push_back(L'\uFEFF');
+    std::vector<wchar_t> chars;
+    std::vector<uint16_t> charOffsets;
+    ROW row;
+};
 
-    const til::CoordType lastRowWithText = GetLastNonSpaceCharacter(nullptr).y;
-    CharacterAttributes previousAttr = CharacterAttributes::Unused1;
-    TextColor previousFg;
-    TextColor previousBg;
-    TextColor previousUl;
-    uint16_t previousHyperlinkId = 0;
-    bool delayedLineBreak = false;
+// A logical line in the old buffer consisting of the rows [oldBeg, oldEnd),
+// which is reflowed into the rows [newBeg, newBeg + newRows) of the new buffer.
+struct ReflowLine
+{
+    til::CoordType oldBeg = 0;
+    til::CoordType oldEnd = 0;
+    til::CoordType newBeg = 0;
+    til::CoordType newRows = 0;
+};
+
+// Everything _reflow() tracks about individual rows, relative to the start of their line in the new buffer.
+struct ReflowMeasurements
+{
+    // Indexed by the old y: The new y of the first cell of the old row and of the row's mark, if any.
+    std::vector<til::CoordType> rowStarts;
+    std::vector<til::CoordType> markRows;
+    std::optional<til::point> cursor;
+};
+
+// Copies the old rows of `line` into the rows getRow(0), getRow(1), ... and returns how many rows that took.
+// This is the same algorithm as the loop in _reflow(), just for a single line, and needs to be kept in sync with it.
+// Passing `measurements` additionally records the new positions of the rows, their marks and the cursor.
+template<typename GetRow>
+static til::CoordType reflowLine(const TextBuffer& oldBuffer, const ReflowLine& line, const til::CoordType newWidth, const til::point oldCursorPos, GetRow&& getRow, ReflowMeasurements* measurements)
+{
+    const auto newWidthU16 = gsl::narrow_cast<uint16_t>(newWidth);
+    til::CoordType newX = 0;
+    til::CoordType newY = 0;
+    auto newline = true;
 
-    // This iterates through each row. The exit condition is at the end
-    // of the for() loop so that we can properly handle file flushing.
-    for (til::CoordType currentRow = 0;; currentRow++)
+    for (auto oldY = line.oldBeg; oldY < line.oldEnd; ++oldY)
     {
-        const auto& row = GetRowByOffset(currentRow);
-
-        if (const auto lr = row.GetLineRendition(); lr != LineRendition::SingleWidth)
-        {
-            static constexpr std::wstring_view mappings[] = {
-                L"\x1b#6", // LineRendition::DoubleWidth
-                L"\x1b#3", // LineRendition::DoubleHeightTop
-                L"\x1b#4", // LineRendition::DoubleHeightBottom
-            };
-            const auto idx = std::clamp(static_cast<int>(lr) - 1, 0, 2);
-            buffer.append(til::at(mappings, idx));
-        }
-
-        const auto& runs = row.Attributes().runs();
-        const auto beg = runs.begin();
-        const auto end = runs.end();
-        auto it = beg;
-        const auto last = end - 1;
-        const auto lastCharX = row.MeasureRight();
-        til::CoordType oldX = 0;
+        const auto& oldRow = oldBuffer.GetRowByOffset(oldY);
 
-        for (; it != end; ++it)
+        // Rows with a non-standard line rendition are always a line of their own. See _reflow().
+        if (oldRow.GetLineRendition() != LineRendition::SingleWidth)
         {
-            const auto attr = it->value.GetCharacterAttributes();
-            const auto hyperlinkId = it->value.GetHyperlinkId();
-            const auto fg = it->value.GetForeground();
-            const auto bg = it->value.GetBackground();
-            const auto ul = it->value.GetUnderlineColor();
+            auto& newRow = getRow(newY);
+            newRow.CopyFrom(oldRow);
+            newRow.SetWrapForced(false);
 
-            if (previousAttr != attr)
+            if (measurements)
             {
-                auto attrDelta = attr ^ previousAttr;
-
-                // There's no escape sequence that only turns off either bold/intense or dim/faint. SGR 22 turns off both.
-                // This results in two issues in our generic "Mapping" code below. Assuming, both Intense and Faint were on...
-                // * ...and either turned off, it would emit SGR 22 which turns both attributes off = Wrong.
-                // * ...and both are now off, it would emit SGR 22 twice.
-                //
-                // This extra branch takes care of both issues. If both attributes turned off it'll emit a single \x1b[22m,
-                // if faint turned off \x1b[22;1m (intense is still on), and \x1b[22;2m if intense turned off (vice versa).
-                if (WI_AreAllFlagsSet(previousAttr, CharacterAttributes::Intense | CharacterAttributes::Faint) &&
-                    WI_IsAnyFlagSet(attrDelta, CharacterAttributes::Intense | CharacterAttributes::Faint))
+                til::at(measurements->rowStarts, oldY) = newY;
+                til::at(measurements->markRows, oldY) = newY;
+                if (oldY == oldCursorPos.y)
                 {
-                    wchar_t buf[8] = L"\x1b[22m";
-                    size_t len = 5;
-
-                    if (WI_IsAnyFlagSet(attr, CharacterAttributes::Intense | CharacterAttributes::Faint))
-                    {
-                        buf[4] = L';';
-                        buf[5] = WI_IsAnyFlagSet(attr, CharacterAttributes::Intense) ? L'1' : L'2';
-                        buf[6] = L'm';
-                        len = 7;
-                    }
-
-                    buffer.append(&buf[0], len);
-                    WI_ClearAllFlags(attrDelta, CharacterAttributes::Intense | CharacterAttributes::Faint);
+                    measurements->cursor = til::point{ newRow.AdjustToGlyphStart(oldCursorPos.x), newY };
                 }
+            }
 
-                {
-                    struct Mapping
-                    {
-                        CharacterAttributes attr;
-                        uint8_t change[2]; // [0] = off, [1] = on
-                    };
-                    static constexpr Mapping mappings[] = {
-                        { CharacterAttributes::Intense, { 22, 1 } },
-                        { CharacterAttributes::Italics, { 23, 3 } },
-                        { CharacterAttributes::Blinking, { 25, 5 } },
-                        { CharacterAttributes::Invisible, { 28, 8 } },
-                        { CharacterAttributes::CrossedOut, { 29, 9 } },
-                        { CharacterAttributes::Faint, { 22, 2 } },
-                        { CharacterAttributes::TopGridline, { 55, 53 } },
-                        { CharacterAttributes::ReverseVideo, { 27, 7 } },
-                    };
-                    for (const auto& mapping : mappings)
-                    {
-                        if (WI_IsAnyFlagSet(attrDelta, mapping.attr))
-                        {
-                            const auto n = til::at(mapping.change, WI_IsAnyFlagSet(attr, mapping.attr));
-                            fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[{}m"), n);
-                        }
-                    }
-                }
+            newY++;
+            newline = true;
+            continue;
+        }
 
-                if (WI_IsAnyFlagSet(attrDelta, CharacterAttributes::UnderlineStyle))
-                {
-                    static constexpr std::wstring_view mappings[] = {
-                        L"\x1b[24m", // UnderlineStyle::NoUnderline
-                        L"\x1b[4m", // UnderlineStyle::SinglyUnderlined
-                        L"\x1b[21m", // UnderlineStyle::DoublyUnderlined
-                        L"\x1b[4:3m", // UnderlineStyle::CurlyUnderlined
-                        L"\x1b[4:4m", // UnderlineStyle::DottedUnderlined
-                        L"\x1b[4:5m", // UnderlineStyle::DashedUnderlined
-                    };
-
-                    auto idx = WI_EnumValue(it->value.GetUnderlineStyle());
-                    if (idx >= std::size(mappings))
-                    {
-                        idx = 1; // UnderlineStyle::SinglyUnderlined
-                    }
+        // See REFLOW_JANK_CURSOR_WRAP.
+        auto oldRowLimit = oldRow.MeasureRight();
+        if (oldY == oldCursorPos.y)
+        {
+            oldRowLimit = std::max(oldRowLimit, oldCursorPos.x + 1);
+        }
 
-                    buffer.append(til::at(mappings, idx));
-                }
+        if (measurements)
+        {
+            til::at(measurements->markRows, oldY) = newY;
+        }
 
-                previousAttr = attr;
-            }
+        til::CoordType oldX = 0;
+        auto firstSegment = true;
 
-            if (previousFg != fg)
+        do
+        {
+            if (newX >= newWidth)
             {
-                switch (fg.GetType())
-                {
-                case ColorType::IsDefault:
-                    buffer.append(L"\x1b[39m");
-                    break;
-                case ColorType::IsIndex16:
-                {
-                    uint8_t index = WI_IsFlagSet(fg.GetIndex(), 8) ? 90 : 30;
-                    index += fg.GetIndex() & 7;
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[{}m"), index);
-                    break;
-                }
-                case ColorType::IsIndex256:
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[38;5;{}m"), fg.GetIndex());
-                    break;
-                case ColorType::IsRgb:
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[38;2;{};{};{}m"), fg.GetR(), fg.GetG(), fg.GetB());
-                    break;
-                default:
-                    break;
-                }
-                previousFg = fg;
+                getRow(newY).SetWrapForced(true);
+                newX = 0;
+                newY++;
             }
 
-            if (previousBg != bg)
-            {
-                switch (bg.GetType())
-                {
-                case ColorType::IsDefault:
-                    buffer.append(L"\x1b[49m");
-                    break;
-                case ColorType::IsIndex16:
-                {
-                    uint8_t index = WI_IsFlagSet(bg.GetIndex(), 8) ? 100 : 40;
-                    index += bg.GetIndex() & 7;
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[{}m"), index);
-                    break;
-                }
-                case ColorType::IsIndex256:
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[48;5;{}m"), bg.GetIndex());
-                    break;
-                case ColorType::IsRgb:
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[48;2;{};{};{}m"), bg.GetR(), bg.GetG(), bg.GetB());
-                    break;
-                default:
-                    break;
-                }
-                previousBg = bg;
-            }
+            auto& newRow = getRow(newY);
+
+            RowCopyTextFromState state{
+                .source = oldRow,
+                .columnBegin = newX,
+                .columnLimit = til::CoordTypeMax,
+                .sourceColumnBegin = oldX,
+                .sourceColumnLimit = oldRowLimit,
+            };
+            newRow.CopyTextFrom(state);
 
-            if (previousUl != ul)
+            if (oldX == 0)
             {
-                switch (fg.GetType())
-                {
-                case ColorType::IsDefault:
-                    buffer.append(L"\x1b[59m");
-                    break;
-                case ColorType::IsIndex256:
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[58:5:{}m"), ul.GetIndex());
-                    break;
-                case ColorType::IsRgb:
-                    fmt::format_to(std::back_inserter(buffer), FMT_COMPILE(L"\x1b[58:2::{}:{}:{}m"), ul.GetR(), ul.GetG(), ul.GetB());
-                    break;
-                default:
-                    break;
-                }
-                previousUl = ul;
+                ImageSlice::CopyRow(oldRow, newRow);
             }
-
-            if (previousHyperlinkId != hyperlinkId)
+            if (measurements && firstSegment)
             {
-                if (hyperlinkId)
-                {
-                    const auto uri = GetHyperlinkUriFromId(hyperlinkId);
-                    if (!uri.empty())
-                    {
-                        buffer.append(L"\x1b]8;;");
-                        buffer.append(uri);
-                        buffer.append(L"\x1b\\");
-                        previousHyperlinkId = hyperlinkId;
-                    }
-                }
-                else
-                {
-                    buffer.append(L"\x1b]8;;\x1b\\");
-                    previousHyperlinkId = 0;
-                }
+                til::at(measurements->rowStarts, oldY) = newY;
             }
+            firstSegment = false;
 
-            // Initially, the buffer is initialized with the default attributes, but once it begins to scroll,
-            // newly scrolled in rows are initialized with the current attributes. This means we need to set
-            // the current attributes to those of the upcoming row before the row comes up. Or inversely:
-            // We let the row come up, let it set its attributes and only then print the newline.
-            if (delayedLineBreak)
+            const auto& oldAttr = oldRow.Attributes();
+            auto& newAttr = newRow.Attributes();
+            const auto attributes = oldAttr.slice(gsl::narrow_cast<uint16_t>(oldX), oldAttr.size());
+            newAttr.replace(gsl::narrow_cast<uint16_t>(newX), newAttr.size(), attributes);
+            newAttr.resize_trailing_extent(newWidthU16);
+
+            if (measurements && oldY == oldCursorPos.y && oldCursorPos.x >= oldX)
             {
-                buffer.append(L"\r\n");
-                delayedLineBreak = false;
+                measurements->cursor = til::point{ newRow.AdjustToGlyphStart(oldCursorPos.x - oldX + newX), newY };
             }
 
-            auto newX = oldX + it->length;
+            oldX = state.sourceColumnEnd;
+            newX = state.columnEnd;
+        } while (oldX < oldRowLimit);
+
+        newline = !oldRow.WasWrapForced();
+        if (newline)
+        {
+            newX = 0;
+            newY++;
+        }
+    }
+
+    // A line that ends without a newline (before a row with a non-standard line rendition or at the end of the buffer)
+    // still occupies the row it ended in, just like the "if (newX != 0)" after the loop in _reflow() ensures.
+    // But if nothing was written into that row, the serial algorithm lets the next line overwrite it.
+    // This returns 0 in that case, which makes _reflowParallel() fall back to the serial algorithm.
+    if (!newline && newX == 0)
+    {
+        return 0;
+    }
+    return newY + (newX != 0 ? 1 : 0);
+}
 
-            // Since our text buffer doesn't store the original input text, the information over the amount of trailing
-            // whitespaces was lost. If we don't do anything here then a row that just says "Hello" would be serialized
-            // to "Hello                    ...". If the user restores the buffer dump with a different window size,
-            // this would result in some fairly ugly reflow. This code attempts to at least trim trailing whitespaces.
-            //
-            // As mentioned above for `delayedLineBreak`, rows are initialized with their first attribute, BUT
-            // only if the viewport has begun to scroll. Otherwise, they're initialized with the default attributes.
-            // In other words, we can only skip \x1b[K = Erase in Line, if both the first/last attribute are the default attribute.
-            static constexpr TextAttribute defaultAttr;
-            const auto trimTrailingWhitespaces = it == last && lastCharX < newX;
-            const auto clearToEndOfLine = trimTrailingWhitespaces && (beg->value != defaultAttr || last->value != defaultAttr);
+// Reflows large buffers on all CPU cores: The old buffer is split up into its logical lines, which are first
+// measured (reflowed into scratch rows) in parallel to determine where they start in the new buffer and then
+// reflowed into the new buffer, again in parallel. Returns false if the buffer isn't suitable for this,
+// in which case the caller needs to fall back to the serial algorithm. Otherwise this is equivalent to the
+// loop in _reflow() and returns the same newY and newCursorPos.
+bool TextBuffer::_reflowParallel(const TextBuffer& oldBuffer, TextBuffer& newBuffer, const til::point oldCursorPos, const til::CoordType oldHeight, PositionInformation* positionInfo, til::CoordType& newY, til::point& newCursorPos)
+{
+    static constexpr til::CoordType minRowsPerShard = 1024;
+    const auto shardCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), gsl::narrow_cast<size_t>(oldHeight / minRowsPerShard));
+    if (shardCount <= 1)
+    {
+        return false;
+    }
 
-            if (trimTrailingWhitespaces)
+    // This accesses every row serially first, which ensures that none of them are frozen or uncommitted,
+    // because thawing or committing them from multiple threads concurrently would be unsafe.
+    std::vector<ReflowLine> lines;
+    {
+        til::CoordType beg = 0;
+        for (til::CoordType y = 0; y < oldHeight; ++y)
+        {
+            const auto& row = oldBuffer.GetRowByOffset(y);
+            const auto singleWidth = row.GetLineRendition() == LineRendition::SingleWidth;
+            if (!singleWidth && beg != y)
+            {
+                lines.emplace_back(ReflowLine{ .oldBeg = beg, .oldEnd = y });
+                beg = y;
+            }
+            if (!singleWidth || !row.WasWrapForced())
             {
-                newX = lastCharX;
+                lines.emplace_back(ReflowLine{ .oldBeg = beg, .oldEnd = y + 1 });
+                beg = y + 1;
             }
+        }
+        if (beg != oldHeight)
+        {
+            lines.emplace_back(ReflowLine{ .oldBeg = beg, .oldEnd = oldHeight });
+        }
+    }
+
+    // Split the lines up into shards of roughly equal numbers of old rows.
+    std::vector<std::span<ReflowLine>> shards;
+    {
+        const auto rowsPerShard = (oldHeight + gsl::narrow_cast<til::CoordType>(shardCount) - 1) / gsl::narrow_cast<til::CoordType>(shardCount);
+        auto shardBeg = lines.begin();
+        for (auto it = lines.begin(); it != lines.end(); ++it)
+        {
+            if (it->oldEnd - shardBeg->oldBeg >= rowsPerShard)
+            {
+                shards.emplace_back(shardBeg, it + 1);
+                shardBeg = it + 1;
+            }
+        }
+        if (shardBeg != lines.end())
+        {
+            shards.emplace_back(shardBeg, lines.end());
+        }
+    }
 
-            buffer.append(row.GetText(oldX, newX));
+    const auto newWidth = newBuffer._width;
+    const auto newHeight = gsl::narrow_cast<til::CoordType>(newBuffer._height);
+    const auto& fillAttributes = newBuffer._initialAttributes;
 
-            if (clearToEndOfLine)
+    // Returns a getRow function for reflowLine() that returns a freshly reset scratch row for every new y.
+    const auto scratchRows = [&](ReflowScratchRow& scratch) {
+        return [&scratch, &fillAttributes, current = til::CoordType{ -1 }](const til::CoordType y) mutable -> ROW& {
+            if (y != current)
             {
-                buffer.append(L"\x1b[K");
+                scratch.row.Reset(fillAttributes);
+                current = y;
             }
+            return scratch.row;
+        };
+    };
+
+    ReflowMeasurements measurements{
+        .rowStarts = std::vector<til::CoordType>(gsl::narrow_cast<size_t>(oldHeight)),
+        .markRows = std::vector<til::CoordType>(gsl::narrow_cast<size_t>(oldHeight)),
+    };
 
-            oldX = newX;
+    parallelFor(shards.size(), [&](const size_t i) {
+        ReflowScratchRow scratch{ newWidth, fillAttributes };
+        for (auto& line : til::at(shards, i))
+        {
+            line.newRows = reflowLine(oldBuffer, line, newWidth, oldCursorPos, scratchRows(scratch), &measurements);
         }
+    });
+
+    til::CoordType total = 0;
+    for (auto& line : lines)
+    {
+        // See the end of reflowLine().
+        if (line.newRows == 0)
+        {
+            return false;
+        }
+        line.newBeg = total;
+        total += line.newRows;
+    }
+
+    const auto lineOf = [&](const til::CoordType oldY) -> const ReflowLine& {
+        return *std::prev(std::ranges::upper_bound(lines, oldY, {}, &ReflowLine::oldBeg));
+    };
+
+    if (!measurements.cursor)
+    {
+        return false;
+    }
+    newCursorPos = *measurements.cursor;
+    newCursorPos.y += lineOf(oldCursorPos.y).newBeg;
 
-        const auto moreRowsRemaining = currentRow < lastRowWithText;
-        delayedLineBreak = !row.WasWrapForced();
+    // The serial algorithm stops writing before it would overwrite the cursor row (see newYLimit).
+    // This only happens if there are more than newHeight rows below the cursor and is left to it.
+    if (oldBuffer.GetRowByOffset(oldCursorPos.y).GetLineRendition() == LineRendition::SingleWidth && total > newCursorPos.y + newHeight)
+    {
+        return false;
+    }
 
-        if (!moreRowsRemaining)
+    // If the reflowed text is taller than the new buffer, the serial algorithm writes the first rows twice,
+    // just like the circular buffer would. We skip the ones that would be overwritten and write the rest only once.
+    const auto windowBeg = std::max(0, total - newHeight);
+    std::vector<ROW*> rows;
+    rows.reserve(gsl::narrow_cast<size_t>(total - windowBeg));
+    for (auto y = windowBeg; y < total; ++y)
+    {
+        rows.emplace_back(&newBuffer.GetMutableRowByOffset(y));
+    }
+
+    parallelFor(shards.size(), [&](const size_t i) {
+        ReflowScratchRow scratch{ newWidth, fillAttributes };
+        for (const auto& line : til::at(shards, i))
         {
-            if (previousHyperlinkId)
+            // Lines that are entirely skipped don't need to be reflowed at all.
+            if (line.newBeg + line.newRows <= windowBeg)
             {
-                buffer.append(L"\x1b]8;;\x1b\\");
+                continue;
             }
-            buffer.append(L"\x1b[m\r\n");
+
+            auto getScratchRow = scratchRows(scratch);
+            reflowLine(oldBuffer, line, newWidth, oldCursorPos, [&](const til::CoordType y) -> ROW& {
+                const auto abs = line.newBeg + y;
+                return abs < windowBeg ? getScratchRow(y) : *til::at(rows, gsl::narrow_cast<size_t>(abs - windowBeg));
+            }, nullptr);
         }
+    });
 
-        if (buffer.size() >= writeThreshold || !moreRowsRemaining)
+    for (const auto& line : lines)
+    {
+        for (auto oldY = line.oldBeg; oldY < line.oldEnd; ++oldY)
         {
-            const auto fileSize = gsl::narrow<DWORD>(buffer.size() * sizeof(wchar_t));
-            DWORD bytesWritten = 0;
-            THROW_IF_WIN32_BOOL_FALSE(WriteFile(file.get(), buffer.data(), fileSize, &bytesWritten, nullptr));
-            THROW_WIN32_IF_MSG(ERROR_WRITE_FAULT, bytesWritten != fileSize, "failed to write");
-            buffer.clear();
+            if (const auto& data = oldBuffer.GetRowByOffset(oldY).GetScrollbarData())
+            {
+                const auto y = line.newBeg + til::at(measurements.markRows, oldY);
+                if (y >= windowBeg)
+                {
+                    newBuffer.SetScrollbarData(*data, y);
+                }
+            }
         }
+    }
 
-        if (!moreRowsRemaining)
+    if (positionInfo)
+    {
+        for (const auto top : { &positionInfo->mutableViewportTop, &positionInfo->visibleViewportTop })
         {
-            break;
+            const auto oldY = std::max(0, *top);
+            if (oldY < oldHeight)
+            {
+                *top = lineOf(oldY).newBeg + til::at(measurements.rowStarts, oldY);
+            }
         }
     }
+
+    newY = total;
+    return true;
 }
 
 // Function Description:
@@ -2653,6 +3237,26 @@ void TextBuffer::Serialize(const wchar_t* destination) const
 // Return Value:
 // - S_OK if we successfully copied the contents to the new buffer, otherwise an appropriate HRESULT.
 void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const Viewport* lastCharacterViewport, PositionInformation* positionInfo)
+{
+    _reflow(oldBuffer, newBuffer, lastCharacterViewport, positionInfo, true);
+}
+
+// Function Description:
+// - Same as Reflow(), but only for the rows [oldRowBegin, oldRowEnd) of the old buffer, which are written
+//   into the new buffer starting at row newRowBegin. This allows a buffer to be reflowed in parts:
+//   The first part is written into a new, empty buffer. The next part then starts at the returned row,
+//   or at the new buffer's height, whichever is smaller. oldRowBegin must be the start of a line.
+// Return Value:
+// - The row after the last one that was written. If it's larger than the new buffer's height,
+//   the buffer was circled around and the rows at the top have been discarded.
+//   The rows in positionInfo are relative to the new buffer before it was circled around, just like in Reflow().
+til::CoordType TextBuffer::ReflowRows(TextBuffer& oldBuffer, TextBuffer& newBuffer, const til::CoordType oldRowBegin, const til::CoordType oldRowEnd, const til::CoordType newRowBegin, const Viewport* lastCharacterViewport, PositionInformation* positionInfo)
+{
+    return _reflow(oldBuffer, newBuffer, lastCharacterViewport, positionInfo, true, oldRowBegin, oldRowEnd, newRowBegin);
+}
+
+// The implementation of Reflow(). allowParallel exists so that tests can compare the serial and parallel algorithm.
+til::CoordType TextBuffer::_reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const Viewport* lastCharacterViewport, PositionInformation* positionInfo, const bool allowParallel, const til::CoordType oldRowBegin, const til::CoordType oldRowEnd, const til::CoordType newRowBegin)
 {
     const auto& oldCursor = oldBuffer.GetCursor();
     auto& newCursor = newBuffer.GetCursor();
@@ -2669,21 +3273,31 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
     oldCursorPos.x = std::clamp(oldCursorPos.x, 0, oldBuffer._width - 1);
     oldCursorPos.y = std::clamp(oldCursorPos.y, 0, oldBuffer._height - 1);
 
-    const auto lastRowWithText = oldBuffer.GetLastNonSpaceCharacter(lastCharacterViewport).y;
+    // If the cursor is past the end of the range we're reflowing, all rows up to oldRowEnd
+    // are going to be copied anyway and searching for the last character is unnecessary.
+    const auto lastRowWithText = oldCursorPos.y >= oldRowEnd ? 0 : oldBuffer.GetLastNonSpaceCharacter(lastCharacterViewport).y;
 
     auto mutableViewportTop = positionInfo ? positionInfo->mutableViewportTop : til::CoordTypeMax;
     auto visibleViewportTop = positionInfo ? positionInfo->visibleViewportTop : til::CoordTypeMax;
 
-    til::CoordType oldY = 0;
-    til::CoordType newY = 0;
+    til::CoordType oldY = oldRowBegin;
+    til::CoordType newY = newRowBegin;
     til::CoordType newX = 0;
     til::CoordType newWidth = newBuffer.GetSize().Width();
     til::CoordType newYLimit = til::CoordTypeMax;
+    til::CoordType lastResetY = -1;
 
-    const auto oldHeight = std::max(lastRowWithText, oldCursorPos.y) + 1;
+    const auto oldHeight = std::min(std::max(lastRowWithText, oldCursorPos.y) + 1, oldRowEnd);
     const auto newHeight = newBuffer.GetSize().Height();
     const auto newWidthU16 = gsl::narrow_cast<uint16_t>(newWidth);
 
+    // Large buffers are reflowed on all CPU cores if possible, which consumes all of oldBuffer and skips the loop below.
+    static constexpr til::CoordType parallelMinRows = 4096;
+    if (allowParallel && oldRowBegin == 0 && newRowBegin == 0 && oldHeight >= parallelMinRows && _reflowParallel(oldBuffer, newBuffer, oldCursorPos, oldHeight, positionInfo, newY, newCursorPos))
+    {
+        oldY = oldHeight;
+    }
+
     // Copy oldBuffer into newBuffer until oldBuffer has been fully consumed.
     for (; oldY < oldHeight && newY < newYLimit; ++oldY)
     {
@@ -2712,6 +3326,10 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
 
             newRow.CopyFrom(oldRow);
             newRow.SetWrapForced(false);
+            if (newRow.GetScrollbarData())
+            {
+                newBuffer._indexMark(newY);
+            }
 
             if (oldY == oldCursorPos.y)
             {
@@ -2745,17 +3363,15 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
             oldRowLimit = std::max(oldRowLimit, oldCursorPos.x + 1);
         }
 
-        // Immediately copy this mark over to our new row. The positions of the
+        // Copy this mark over to our new row after the loop below. The positions of the
         // marks themselves will be preserved, since they're just text
         // attributes. But the "bookmark" needs to get moved to the new row too.
         // * If a row wraps as it reflows, that's fine - we want to leave the
         //   mark on the row it started on.
         // * If the second row of a wrapped row had a mark, and it de-flows onto a
         //   single row, that's fine! The mark was on that logical row.
-        if (oldRow.GetScrollbarData().has_value())
-        {
-            newBuffer.GetMutableRowByOffset(newY).SetScrollbarData(oldRow.GetScrollbarData());
-        }
+        // It's set after the loop, because REFLOW_RESET may reset the row first.
+        const auto markY = newY;
 
         til::CoordType oldX = 0;
 
@@ -2779,7 +3395,9 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
             // If we shrink the buffer vertically, for instance from 100 rows to 90 rows, we will write 10 rows in the
             // new buffer twice. We need to reset them before copying text, or otherwise we'll see the previous contents.
             // We don't need to be smart about this. Reset() is fast and shrinking doesn't occur often.
-            if (newY >= newHeight && newX == 0)
+            // We do need to make sure to reset each row only once however, because empty wrapped rows
+            // don't advance newX and would otherwise reset their own row again, including its mark.
+            if (newY >= newHeight && newX == 0 && newY != lastResetY)
             {
                 // We need to ensure not to overwrite the row the cursor is on.
                 if (newY >= newYLimit)
@@ -2787,6 +3405,7 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
                     break;
                 }
                 newBuffer.GetMutableRowByOffset(newY).Reset(newBuffer._initialAttributes);
+                lastResetY = newY;
             }
 
             auto& newRow = newBuffer.GetMutableRowByOffset(newY);
@@ -2840,6 +3459,12 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
             newX = state.columnEnd;
         } while (oldX < oldRowLimit);
 
+        // The row may have been overwritten by the loop above already, if the buffer shrunk.
+        if (const auto& data = oldRow.GetScrollbarData(); data && markY < newYLimit && markY + newHeight > newY)
+        {
+            newBuffer.SetScrollbarData(*data, markY);
+        }
+
         // If the row had an explicit newline we also need to newline. :)
         if (!oldRow.WasWrapForced())
         {
@@ -2861,7 +3486,7 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
     // printable character. This is to fix the `color 2f` scenario, where you
     // change the buffer colors then resize and everything below the last
     // printable char gets reset. See GH #12567
-    const auto initializedRowsEnd = oldBuffer._estimateOffsetOfLastCommittedRow() + 1;
+    const auto initializedRowsEnd = std::min(oldBuffer._estimateOffsetOfLastCommittedRow() + 1, oldRowEnd);
     for (; oldY < initializedRowsEnd && newY < newHeight; oldY++, newY++)
     {
         auto& oldRow = oldBuffer.GetRowByOffset(oldY);
@@ -2874,14 +3499,16 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
     // Since we didn't use IncrementCircularBuffer() we need to compute the proper
     // _firstRow offset now, in a way that replicates IncrementCircularBuffer().
     // We need to do the same for newCursorPos.y for basically the same reason.
+    // _firstRow is only non-zero here, if ReflowRows() already filled the buffer with a previous part.
     if (newY > newHeight)
     {
-        newBuffer._firstRow = newY % newHeight;
+        const auto oldFirstRow = newBuffer._firstRow;
+        newBuffer._firstRow = (oldFirstRow + newY) % newHeight;
         // _firstRow maps from API coordinates that always start at 0,0 in the top left corner of the
         // terminal's scrollback, to the underlying buffer Y coordinate via `(y + _firstRow) % height`.
         // Here, we need to un-map the `newCursorPos.y` from the underlying Y coordinate to the API coordinate
         // and so we do `(y - _firstRow) % height`, but we add `+ newHeight` to avoid getting negative results.
-        newCursorPos.y = (newCursorPos.y - newBuffer._firstRow + newHeight) % newHeight;
+        newCursorPos.y = (oldFirstRow + newCursorPos.y - newBuffer._firstRow + newHeight) % newHeight;
     }
 
     newBuffer.CopyProperties(oldBuffer);
@@ -2891,6 +3518,7 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
     assert(newCursorPos.y >= 0 && newCursorPos.y < newHeight);
     newCursor.SetSize(oldCursor.GetSize());
     newCursor.SetPosition(newCursorPos);
+    return newY;
 }
 
 // Method Description:
@@ -2899,105 +3527,422 @@ void TextBuffer::Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const View
 // - The hyperlink URI, the hyperlink id (could be new or old)
 void TextBuffer::AddHyperlinkToMap(std::wstring_view uri, uint16_t id)
 {
-    _hyperlinkMap[id] = uri;
+    if (id == 0 || uri.empty())
+    {
+        return;
+    }
+    if (id >= _hyperlinks.size())
+    {
+        _hyperlinks.resize(size_t{ id } + 1);
+    }
+
+    auto& entry = _hyperlinks[id];
+    if (entry.uri.empty())
+    {
+        ++_hyperlinkCount;
+    }
+    entry.uri = uri;
+}
+
+// Method Description:
+// - Retrieves the URI associated with a particular hyperlink ID
+// Arguments:
+// - The hyperlink ID
+// Return Value:
+// - The URI
+std::wstring TextBuffer::GetHyperlinkUriFromId(uint16_t id) const
+{
+    return _hyperlinks.at(id).uri;
+}
+
+// Method description:
+// - Provides the hyperlink ID to be assigned as a text attribute, based on the optional custom id provided
+//   and records the URI for it. Hyperlinks with the same custom id and URI share their ID.
+// Arguments:
+// - The hyperlink URI, the user-defined id
+// Return value:
+// - The internal hyperlink ID, or 0 if all IDs are in use
+uint16_t TextBuffer::GetHyperlinkId(std::wstring_view uri, std::wstring_view id)
+{
+    // hash the URL and add it to the custom ID - GH#7698
+    fmt::basic_memory_buffer<wchar_t, 128> customIdKey;
+    if (!id.empty())
+    {
+        fmt::format_to(std::back_inserter(customIdKey), FMT_COMPILE(L"{}%{}"), id, til::hash(uri));
+        if (const auto it = _hyperlinkCustomIdMap.find(std::wstring_view{ customIdKey.data(), customIdKey.size() }); it != _hyperlinkCustomIdMap.end())
+        {
+            return it->second;
+        }
+    }
+
+    if (_hyperlinkCount >= _hyperlinkPruneThreshold || (_freeHyperlinkIds.empty() && _hyperlinks.size() > UINT16_MAX))
+    {
+        _PruneHyperlinks();
+    }
+
+    uint16_t numericId = 0;
+    // The free list may contain IDs that AddHyperlinkToMap() has since been called with.
+    while (!_freeHyperlinkIds.empty() && !numericId)
+    {
+        const auto candidate = _freeHyperlinkIds.back();
+        _freeHyperlinkIds.pop_back();
+        if (candidate < _hyperlinks.size() && _hyperlinks[candidate].uri.empty())
+        {
+            numericId = candidate;
+        }
+    }
+    if (!numericId)
+    {
+        if (_hyperlinks.size() > UINT16_MAX)
+        {
+            // Every single ID is referenced by the buffer. The text simply won't be a hyperlink.
+            return 0;
+        }
+        // ID 0 means "no hyperlink", so the table starts at 1.
+        _hyperlinks.resize(std::max<size_t>(_hyperlinks.size(), 1) + 1);
+        numericId = gsl::narrow_cast<uint16_t>(_hyperlinks.size() - 1);
+    }
+
+    AddHyperlinkToMap(uri, numericId);
+
+    if (!id.empty())
+    {
+        auto& key = _hyperlinks[numericId].customIdKey;
+        key.assign(customIdKey.data(), customIdKey.size());
+        _hyperlinkCustomIdMap.emplace(key, numericId);
+    }
+
+    return numericId;
+}
+
+// Method Description:
+// - Removes a hyperlink from the hyperlink map and the associated
+//   user defined id from the custom id map (if there is one)
+// Arguments:
+// - The ID of the hyperlink to be removed
+void TextBuffer::RemoveHyperlinkFromMap(uint16_t id)
+{
+    if (id == 0 || id >= _hyperlinks.size() || _hyperlinks[id].uri.empty())
+    {
+        return;
+    }
+
+    auto& entry = _hyperlinks[id];
+    if (!entry.customIdKey.empty())
+    {
+        _hyperlinkCustomIdMap.erase(entry.customIdKey);
+    }
+    entry = {};
+    --_hyperlinkCount;
+    _freeHyperlinkIds.emplace_back(id);
+}
+
+// Method Description:
+// - Obtains the custom ID, if there was one, associated with the
+//   uint16_t id of a hyperlink
+// Arguments:
+// - The uint16_t id of the hyperlink
+// Return Value:
+// - The custom ID if there was one, empty string otherwise
+std::wstring TextBuffer::GetCustomIdFromId(uint16_t id) const
+{
+    if (id < _hyperlinks.size())
+    {
+        return _hyperlinks[id].customIdKey;
+    }
+    return {};
+}
+
+// Method Description:
+// - Copies the hyperlink table of the old buffer into this one
+// Arguments:
+// - The other buffer
+void TextBuffer::CopyHyperlinkMaps(const TextBuffer& other)
+{
+    _hyperlinks = other._hyperlinks;
+    _freeHyperlinkIds = other._freeHyperlinkIds;
+    _hyperlinkCustomIdMap = other._hyperlinkCustomIdMap;
+    _hyperlinkCount = other._hyperlinkCount;
+    _hyperlinkPruneThreshold = other._hyperlinkPruneThreshold;
+}
+
+// Method Description:
+// - Prevents all hyperlinks that are currently in the table from being pruned, until UnpinHyperlinks() is called.
+//   This is needed while rows that were copied out of this buffer (or whose table this buffer got a copy of)
+//   may still be put back into it, like Terminal's resize history.
+void TextBuffer::PinHyperlinks()
+{
+    _pinnedHyperlinks.clear();
+    for (size_t id = 1; id < _hyperlinks.size(); ++id)
+    {
+        if (!_hyperlinks[id].uri.empty())
+        {
+            _pinnedHyperlinks.emplace_back(gsl::narrow_cast<uint16_t>(id));
+        }
+    }
+}
+
+void TextBuffer::UnpinHyperlinks() noexcept
+{
+    _pinnedHyperlinks.clear();
+}
+
+static ICU::unique_uregex createSearchRegex(const std::wstring_view& needle, SearchFlag flags, UErrorCode* status) noexcept
+{
+    uint32_t icuFlags{ 0 };
+    WI_SetFlagIf(icuFlags, UREGEX_CASE_INSENSITIVE, WI_IsFlagSet(flags, SearchFlag::CaseInsensitive));
+
+    if (WI_IsFlagSet(flags, SearchFlag::RegularExpression))
+    {
+        WI_SetFlag(icuFlags, UREGEX_MULTILINE);
+    }
+    else
+    {
+        WI_SetFlag(icuFlags, UREGEX_LITERAL);
+    }
+
+    return ICU::CreateRegex(needle, icuFlags, status);
+}
+
+// Returns true if the regular expression `needle` could possibly match (or look at) the line break
+// between two logical lines, or depends on the start/end of the entire text. Such patterns need to be
+// searched for in the entire buffer, while all others yield the same results when searching line by line.
+// This errs on the side of caution: For instance [^a] or \D can match a line break, even if they rarely do.
+static bool regexMayCrossLines(const std::wstring_view& needle) noexcept
+{
+    for (size_t i = 0; i < needle.size(); ++i)
+    {
+        const auto ch = needle[i];
+        const auto next = i + 1 < needle.size() ? needle[i + 1] : L'\0';
+
+        switch (ch)
+        {
+        case L'\r':
+        case L'\n':
+            return true;
+        case L'[':
+            // Negated sets and POSIX-style classes like [[:space:]].
+            if (next == L'^' || next == L':')
+            {
+                return true;
+            }
+            break;
+        case L'(':
+            // Inline flags like (?s) or (?x). Groups, lookarounds and comments are fine.
+            if (next == L'?' && i + 2 < needle.size() && !wcschr(L":=!<>#", needle[i + 2]))
+            {
+                return true;
+            }
+            break;
+        case L'\\':
+            // Escapes that match a line break or any character by its code (\x0a, \N{LINE FEED}, ...),
+            // that negate a set which excludes line breaks, or that anchor at the start/end of the text.
+            if (next != L'\0' && wcschr(L"nrsvRXWDHPpxuUNc0AZzG", next))
+            {
+                return true;
+            }
+            // Skip the escaped character, so that \\n is treated as a backslash followed by n.
+            ++i;
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
 }
 
-// Method Description:
-// - Retrieves the URI associated with a particular hyperlink ID
-// Arguments:
-// - The hyperlink ID
-// Return Value:
-// - The URI
-std::wstring TextBuffer::GetHyperlinkUriFromId(uint16_t id) const
+// Returns the offset of the first occurrence of `needle` in `haystack` at or after `offset`, or npos.
+// Instead of comparing the needle at every position, this compares the first and last character of the
+// needle against 8 positions at once and only verifies the positions where both of them are equal.
+// For typical text and needles this skips almost all of the haystack without looking at it twice.
+static size_t findLiteral(const std::wstring_view& haystack, const std::wstring_view& needle, size_t offset) noexcept
 {
-    return _hyperlinkMap.at(id);
-}
+    const auto len = needle.size();
+    if (len == 0 || len > haystack.size())
+    {
+        return std::wstring_view::npos;
+    }
 
-// Method description:
-// - Provides the hyperlink ID to be assigned as a text attribute, based on the optional custom id provided
-// Arguments:
-// - The user-defined id
-// Return value:
-// - The internal hyperlink ID
-uint16_t TextBuffer::GetHyperlinkId(std::wstring_view uri, std::wstring_view id)
-{
-    uint16_t numericId = 0;
-    if (id.empty())
+    // The past-the-end offset of the positions at which the needle could start.
+    const auto end = haystack.size() - len + 1;
+    const auto hay = haystack.data();
+    const auto first = needle.front();
+    const auto last = needle.back();
+    auto it = offset;
+
+#if defined(TIL_SSE_INTRINSICS)
+
+    const auto firstVec = _mm_set1_epi16(static_cast<short>(first));
+    const auto lastVec = _mm_set1_epi16(static_cast<short>(last));
+
+    for (; end - it >= 8 && it < end; it += 8)
     {
-        // no custom id specified, return our internal count
-        numericId = _currentHyperlinkId;
-        ++_currentHyperlinkId;
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + it));
+        const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + it + len - 1));
+        const auto eq = _mm_and_si128(_mm_cmpeq_epi16(a, firstVec), _mm_cmpeq_epi16(b, lastVec));
+        auto mask = gsl::narrow_cast<unsigned long>(_mm_movemask_epi8(eq));
+
+        while (mask)
+        {
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+            mask &= ~(3ul << bit);
+
+            const auto pos = it + bit / 2;
+            if (wmemcmp(hay + pos, needle.data(), len) == 0)
+            {
+                return pos;
+            }
+        }
     }
-    else
+
+#elif defined(TIL_ARM_NEON_INTRINSICS)
+
+    const auto firstVec = vdupq_n_u16(first);
+    const auto lastVec = vdupq_n_u16(last);
+
+    for (; end - it >= 8 && it < end; it += 8)
     {
-        // assign _currentHyperlinkId if the custom id does not already exist
-        std::wstring newId{ id };
-        // hash the URL and add it to the custom ID - GH#7698
-        newId += L"%" + std::to_wstring(til::hash(uri));
-        const auto result = _hyperlinkCustomIdMap.emplace(newId, _currentHyperlinkId);
-        if (result.second)
+        const auto a = vld1q_u16(reinterpret_cast<const uint16_t*>(hay + it));
+        const auto b = vld1q_u16(reinterpret_cast<const uint16_t*>(hay + it + len - 1));
+        const auto eq = vreinterpretq_u64_u16(vandq_u16(vceqq_u16(a, firstVec), vceqq_u16(b, lastVec)));
+
+        if (vgetq_lane_u64(eq, 0) | vgetq_lane_u64(eq, 1))
         {
-            // the custom id did not already exist
-            ++_currentHyperlinkId;
+            for (auto pos = it; pos < it + 8; ++pos)
+            {
+                if (wmemcmp(hay + pos, needle.data(), len) == 0)
+                {
+                    return pos;
+                }
+            }
         }
-        numericId = (*(result.first)).second;
     }
-    // _currentHyperlinkId could overflow, make sure its not 0
-    if (_currentHyperlinkId == 0)
+
+#endif
+
+#pragma loop(no_vector)
+    for (; it < end; ++it)
     {
-        ++_currentHyperlinkId;
+        if (hay[it] == first && hay[it + len - 1] == last && wmemcmp(hay + it, needle.data(), len) == 0)
+        {
+            return it;
+        }
     }
-    return numericId;
+
+    return std::wstring_view::npos;
 }
 
-// Method Description:
-// - Removes a hyperlink from the hyperlink map and the associated
-//   user defined id from the custom id map (if there is one)
-// Arguments:
-// - The ID of the hyperlink to be removed
-void TextBuffer::RemoveHyperlinkFromMap(uint16_t id) noexcept
+// Applies the simple (1:1) case folding to `str`, which is what the literal search uses for case-insensitive matching.
+// Code points whose folding differs in length in UTF-16 are left as is, so that the offsets into `str` don't change.
+static void foldCase(std::wstring& str) noexcept
 {
-    _hyperlinkMap.erase(id);
-    for (const auto& customIdPair : _hyperlinkCustomIdMap)
+    const auto beg = str.data();
+    const auto len = str.size();
+
+    for (size_t i = 0; i < len; ++i)
     {
-        if (customIdPair.second == id)
+        const auto ch = til::at(beg, i);
+
+        if (ch < 0x80)
         {
-            _hyperlinkCustomIdMap.erase(customIdPair.first);
-            break;
+            if (ch >= L'A' && ch <= L'Z')
+            {
+                til::at(beg, i) = gsl::narrow_cast<wchar_t>(ch | 0x20);
+            }
+        }
+        else if (til::is_leading_surrogate(ch) && i + 1 < len && til::is_trailing_surrogate(til::at(beg, i + 1)))
+        {
+            const auto folded = u_foldCase(gsl::narrow_cast<UChar32>(til::combine_surrogates(ch, til::at(beg, i + 1))), U_FOLD_CASE_DEFAULT);
+            if (folded > 0xffff)
+            {
+                til::at(beg, i) = gsl::narrow_cast<wchar_t>(0xd7c0 + (folded >> 10));
+                til::at(beg, i + 1) = gsl::narrow_cast<wchar_t>(0xdc00 | (folded & 0x3ff));
+            }
+            ++i;
+        }
+        else
+        {
+            const auto folded = u_foldCase(ch, U_FOLD_CASE_DEFAULT);
+            if (folded <= 0xffff)
+            {
+                til::at(beg, i) = gsl::narrow_cast<wchar_t>(folded);
+            }
         }
     }
 }
 
-// Method Description:
-// - Obtains the custom ID, if there was one, associated with the
-//   uint16_t id of a hyperlink
-// Arguments:
-// - The uint16_t id of the hyperlink
-// Return Value:
-// - The custom ID if there was one, empty string otherwise
-std::wstring TextBuffer::GetCustomIdFromId(uint16_t id) const
+// Searches for needles without any regex semantics (SearchFlag::RegularExpression unset).
+// Compiling a regex and going through the UText adapter is what dominates the cost of
+// searching for short needles via ICU, which is why this is implemented separately.
+class LiteralSearcher
 {
-    for (auto customIdPair : _hyperlinkCustomIdMap)
+public:
+    LiteralSearcher(const std::wstring_view& needle, const bool caseInsensitive) :
+        _needle{ needle },
+        _caseInsensitive{ caseInsensitive }
     {
-        if (customIdPair.second == id)
+        if (_caseInsensitive)
         {
-            return customIdPair.first;
+            foldCase(_needle);
         }
     }
-    return {};
-}
 
-// Method Description:
-// - Copies the hyperlink/customID maps of the old buffer into this one,
-//   also copies currentHyperlinkId
-// Arguments:
-// - The other buffer
-void TextBuffer::CopyHyperlinkMaps(const TextBuffer& other)
-{
-    _hyperlinkMap = other._hyperlinkMap;
-    _hyperlinkCustomIdMap = other._hyperlinkCustomIdMap;
-    _currentHyperlinkId = other._currentHyperlinkId;
-}
+    // Appends the matches within the rows [rowBeg,rowEnd) to `results`.
+    // The rows are joined into a single haystack, so the range should span a single logical line:
+    // Matches may then cross wrapped rows, but never an explicit line break.
+    void Search(const TextBuffer& textBuffer, const til::CoordType rowBeg, const til::CoordType rowEnd, std::vector<til::point_span>& results)
+    {
+        std::wstring_view haystack;
+
+        _rowOffsets.clear();
+
+        if (rowEnd - rowBeg == 1 && !_caseInsensitive)
+        {
+            _rowOffsets.emplace_back(0);
+            haystack = textBuffer.GetRowByOffset(rowBeg).GetText();
+        }
+        else
+        {
+            _haystack.clear();
+            for (auto y = rowBeg; y < rowEnd; ++y)
+            {
+                _rowOffsets.emplace_back(_haystack.size());
+                _haystack.append(textBuffer.GetRowByOffset(y).GetText());
+            }
+            if (_caseInsensitive)
+            {
+                foldCase(_haystack);
+            }
+            haystack = _haystack;
+        }
+
+        const auto len = _needle.size();
+        for (auto pos = findLiteral(haystack, _needle, 0); pos != std::wstring_view::npos; pos = findLiteral(haystack, _needle, pos + len))
+        {
+            results.emplace_back(til::point_span{ _pointAt(textBuffer, rowBeg, pos, false), _pointAt(textBuffer, rowBeg, pos + len - 1, true) });
+        }
+    }
+
+private:
+    // Turns an offset into the haystack into a buffer position. The end of a match is
+    // given as the offset of its last character and returned as the trailing column of its glyph.
+    til::point _pointAt(const TextBuffer& textBuffer, const til::CoordType rowBeg, const size_t offset, const bool trailing) const
+    {
+        // Find the last row that starts at or before `offset`.
+        const auto it = std::upper_bound(_rowOffsets.begin(), _rowOffsets.end(), offset) - 1;
+        const auto y = rowBeg + gsl::narrow_cast<til::CoordType>(it - _rowOffsets.begin());
+        const auto& row = textBuffer.GetRowByOffset(y);
+        const auto rowOffset = gsl::narrow_cast<ptrdiff_t>(offset - *it);
+        const auto x = trailing ? row.GetTrailingColumnAtCharOffset(rowOffset) : row.GetLeadingColumnAtCharOffset(rowOffset);
+        return { x, y };
+    }
+
+    std::wstring _needle;
+    std::wstring _haystack;
+    std::vector<size_t> _rowOffsets;
+    bool _caseInsensitive = false;
+};
 
 // Searches through the entire (committed) text buffer for `needle` and returns the coordinates in absolute coordinates.
 // The end coordinates of the returned ranges are considered inclusive.
@@ -3021,22 +3966,29 @@ std::optional<std::vector<til::point_span>> TextBuffer::SearchText(const std::ws
         return results;
     }
 
-    auto text = ICU::UTextFromTextBuffer(*this, rowBeg, rowEnd);
+    if (WI_IsFlagClear(flags, SearchFlag::RegularExpression))
+    {
+        LiteralSearcher searcher{ needle, WI_IsFlagSet(flags, SearchFlag::CaseInsensitive) };
 
-    uint32_t icuFlags{ 0 };
-    WI_SetFlagIf(icuFlags, UREGEX_CASE_INSENSITIVE, WI_IsFlagSet(flags, SearchFlag::CaseInsensitive));
+        for (auto y = rowBeg; y < rowEnd;)
+        {
+            auto end = y + 1;
+            while (end < rowEnd && GetRowByOffset(end - 1).WasWrapForced())
+            {
+                ++end;
+            }
 
-    if (WI_IsFlagSet(flags, SearchFlag::RegularExpression))
-    {
-        WI_SetFlag(icuFlags, UREGEX_MULTILINE);
-    }
-    else
-    {
-        WI_SetFlag(icuFlags, UREGEX_LITERAL);
+            searcher.Search(*this, y, end, results);
+            y = end;
+        }
+
+        return results;
     }
 
+    auto text = ICU::UTextFromTextBuffer(*this, rowBeg, rowEnd);
+
     UErrorCode status = U_ZERO_ERROR;
-    const auto re = ICU::CreateRegex(needle, icuFlags, &status);
+    const auto re = createSearchRegex(needle, flags, &status);
     if (status > U_ZERO_ERROR)
     {
         return std::nullopt;
@@ -3055,28 +4007,274 @@ std::optional<std::vector<til::point_span>> TextBuffer::SearchText(const std::ws
     return results;
 }
 
-// Collect up all the rows that were marked, and the data marked on that row.
-// This is what should be used for hot paths, like updating the scrollbar.
-std::vector<ScrollMark> TextBuffer::GetMarkRows() const
+// Same as SearchText() above, but it searches each logical line (rows joined by WasWrapForced()) on its own
+// and remembers the matches per line in `cache`. Subsequent calls with the same cache only search the lines
+// that were modified, resized or scrolled into the buffer since, because a line is identified by the
+// highest ROW::GetMutationId() of its rows, which are unique per TextBuffer and only ever increase.
+// This makes repeated searches while output is streaming in roughly proportional to the amount of new output.
+// Needles with line breaks, and regular expressions that may match across the explicit line breaks between
+// logical lines (see regexMayCrossLines()), would be missed by a per-line search. Those are always searched
+// for in the entire buffer, without the help of the cache.
+std::optional<std::vector<til::point_span>> TextBuffer::SearchText(const std::wstring_view& needle, SearchFlag flags, SearchCache& cache) const
 {
-    std::vector<ScrollMark> marks;
-    const auto bottom = _estimateOffsetOfLastCommittedRow();
-    for (auto y = 0; y <= bottom; y++)
+    const auto crossesLines = WI_IsFlagSet(flags, SearchFlag::RegularExpression) ? regexMayCrossLines(needle) : needle.find_first_of(L"\r\n") != std::wstring_view::npos;
+    if (crossesLines)
     {
-        const auto& row = GetRowByOffset(y);
-        const auto& data{ row.GetScrollbarData() };
-        if (data.has_value())
+        cache = {};
+        return SearchText(needle, flags);
+    }
+
+    std::vector<til::point_span> results;
+
+    // All whitespace strings would match the not-yet-written parts of the TextBuffer which would be weird.
+    if (allWhitespace(needle))
+    {
+        cache = {};
+        return results;
+    }
+
+    std::optional<LiteralSearcher> literalSearcher;
+    ICU::unique_uregex re;
+    UErrorCode status = U_ZERO_ERROR;
+
+    if (WI_IsFlagClear(flags, SearchFlag::RegularExpression))
+    {
+        literalSearcher.emplace(needle, WI_IsFlagSet(flags, SearchFlag::CaseInsensitive));
+    }
+    else
+    {
+        re = createSearchRegex(needle, flags, &status);
+        if (status > U_ZERO_ERROR)
+        {
+            cache = {};
+            return std::nullopt;
+        }
+    }
+
+    if (cache.needle != needle || cache.flags != flags || cache.width != _width || cache.lines.size() != _height)
+    {
+        cache.needle = needle;
+        cache.flags = flags;
+        cache.width = _width;
+        cache.lines.clear();
+        cache.lines.resize(_height);
+    }
+
+    // A line whose cached matches are out of date, spanning the rows [beg,end).
+    struct DirtyLine
+    {
+        SearchCache::Line* line;
+        til::CoordType beg;
+        til::CoordType end;
+    };
+
+    const auto rowEnd = _estimateOffsetOfLastCommittedRow() + 1;
+    std::vector<std::pair<til::CoordType, const SearchCache::Line*>> lines;
+    std::vector<DirtyLine> dirtyLines;
+    size_t dirtyRows = 0;
+
+    for (til::CoordType y = 0; y < rowEnd;)
+    {
+        uint64_t mutationId = 0;
+        auto end = y;
+
+        for (;;)
+        {
+            const auto& row = GetRowByOffset(end);
+            mutationId = std::max(mutationId, row.GetMutationId());
+            ++end;
+            if (!row.WasWrapForced() || end >= rowEnd)
+            {
+                break;
+            }
+        }
+
+        const auto height = end - y;
+        auto& line = til::at(cache.lines, gsl::narrow_cast<size_t>((_firstRow + y) % _height));
+
+        if (line.mutationId != mutationId || line.height != height)
+        {
+            line.mutationId = mutationId;
+            line.height = height;
+            line.matches.clear();
+            dirtyLines.emplace_back(DirtyLine{ &line, y, end });
+            dirtyRows += gsl::narrow_cast<size_t>(height);
+        }
+
+        lines.emplace_back(y, &line);
+        y = end;
+    }
+
+    // Neither a LiteralSearcher nor a URegularExpression may be used by multiple threads at once,
+    // which is why each call gets its own, unless it's the only one.
+    const auto searchLines = [this](const std::span<const DirtyLine> slice, LiteralSearcher* literalSearcher, URegularExpression* re) {
+        UErrorCode status = U_ZERO_ERROR;
+
+        for (const auto& dirty : slice)
+        {
+            auto& matches = dirty.line->matches;
+
+            if (literalSearcher)
+            {
+                literalSearcher->Search(*this, dirty.beg, dirty.end, matches);
+            }
+            else
+            {
+                auto text = ICU::UTextFromTextBuffer(*this, dirty.beg, dirty.end);
+                uregex_setUText(re, &text, &status);
+
+                if (uregex_find(re, -1, &status))
+                {
+                    do
+                    {
+                        matches.emplace_back(ICU::BufferRangeFromMatch(&text, re));
+                    } while (uregex_findNext(re, &status));
+                }
+            }
+
+            for (auto& match : matches)
+            {
+                match.start.y -= dirty.beg;
+                match.end.y -= dirty.beg;
+            }
+        }
+    };
+
+    // Searching a large number of rows (for instance the entire scrollback on the first search)
+    // is split up into one shard per CPU core. Since each shard consists of entire lines,
+    // no special care needs to be taken for lines that are wrapped across shards.
+    // The serial pass above has already accessed (and thus thawed, see FreezeColdRows()) all of these rows,
+    // which ensures that the shards don't modify the buffer concurrently.
+    static constexpr size_t minRowsPerShard = 1024;
+    const auto shardCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), dirtyRows / minRowsPerShard);
+
+    if (shardCount <= 1)
+    {
+        searchLines(dirtyLines, literalSearcher ? &*literalSearcher : nullptr, re.get());
+    }
+    else
+    {
+        std::vector<std::span<const DirtyLine>> shards;
+        shards.reserve(shardCount);
+
+        const auto rowsPerShard = (dirtyRows + shardCount - 1) / shardCount;
+        auto shardBeg = dirtyLines.begin();
+        size_t shardRows = 0;
+
+        for (auto it = dirtyLines.begin(); it != dirtyLines.end(); ++it)
+        {
+            shardRows += gsl::narrow_cast<size_t>(it->end - it->beg);
+            if (shardRows >= rowsPerShard)
+            {
+                shards.emplace_back(shardBeg, it + 1);
+                shardBeg = it + 1;
+                shardRows = 0;
+            }
+        }
+        if (shardBeg != dirtyLines.end())
+        {
+            shards.emplace_back(shardBeg, dirtyLines.end());
+        }
+
+        parallelFor(shards.size(), [&](const size_t i) {
+            if (literalSearcher)
+            {
+                auto searcher = *literalSearcher;
+                searchLines(til::at(shards, i), &searcher, nullptr);
+            }
+            else
+            {
+                UErrorCode status = U_ZERO_ERROR;
+                const ICU::unique_uregex clone{ uregex_clone(re.get(), &status) };
+                THROW_HR_IF(E_OUTOFMEMORY, !clone);
+                searchLines(til::at(shards, i), nullptr, clone.get());
+            }
+        });
+    }
+
+    for (const auto& [y, line] : lines)
+    {
+        for (auto match : line->matches)
+        {
+            match.start.y += y;
+            match.end.y += y;
+            results.emplace_back(match);
+        }
+    }
+
+    return results;
+}
+
+// Adds the row at `y` to the _markIndex. Must be called whenever a row gains ScrollbarData.
+void TextBuffer::_indexMark(const til::CoordType y)
+{
+    // Same as in _getRow().
+    auto row = (_firstRow + y) % _height;
+    if (row < 0)
+    {
+        row += _height;
+    }
+
+    const auto it = std::ranges::lower_bound(_markIndex, row, {}, &MarkIndexEntry::row);
+    if (it == _markIndex.end() || it->row != row)
+    {
+        _markIndex.insert(it, MarkIndexEntry{ .row = row });
+    }
+}
+
+// Returns all rows with ScrollbarData, sorted by their y coordinate, and prunes stale entries from the _markIndex.
+std::vector<ScrollMark> TextBuffer::_collectMarks() const
+{
+    std::vector<ScrollMark> marks;
+    marks.reserve(_markIndex.size());
+    auto stale = false;
+
+    const auto visit = [&](MarkIndexEntry& entry) {
+        auto y = entry.row - _firstRow;
+        if (y < 0)
+        {
+            y += _height;
+        }
+
+        // Frozen rows can't have changed since _freeze() refreshed their entry, so there's no need to thaw them.
+        if (!_isFrozen(gsl::narrow_cast<size_t>(entry.row) + 1))
         {
-            marks.emplace_back(y, *data);
+            const auto& data = GetRowByOffset(y).GetScrollbarData();
+            if (!data)
+            {
+                entry.row = -1;
+                stale = true;
+                return;
+            }
+            entry.data = *data;
         }
+
+        marks.emplace_back(y, entry.data);
+    };
+
+    // The physical rows [_firstRow, _height) come first in terms of y, followed by [0, _firstRow).
+    const auto pivot = std::ranges::lower_bound(_markIndex, _firstRow, {}, &MarkIndexEntry::row);
+    std::for_each(pivot, _markIndex.end(), visit);
+    std::for_each(_markIndex.begin(), pivot, visit);
+
+    if (stale)
+    {
+        std::erase_if(_markIndex, [](const auto& entry) { return entry.row < 0; });
     }
     return marks;
 }
 
+// Collect up all the rows that were marked, and the data marked on that row.
+// This is what should be used for hot paths, like updating the scrollbar.
+std::vector<ScrollMark> TextBuffer::GetMarkRows() const
+{
+    return _collectMarks();
+}
+
 // Get all the regions for all the shell integration marks in the buffer.
 // Marks will be returned in top-down order.
 //
-// This possibly iterates over every run in the buffer, so don't do this on a
+// This possibly iterates over every run of the returned marks, so don't do this on a
 // hot path. Just do this once per user input, if at all possible.
 //
 // Use `limit` to control how many you get, _starting from the bottom_. (e.g.
@@ -3089,17 +4287,11 @@ std::vector<MarkExtents> TextBuffer::GetMarkExtents(size_t limit) const
     }
 
     std::vector<MarkExtents> marks{};
-    const auto bottom = _estimateOffsetOfLastCommittedRow();
-    auto lastPromptY = bottom;
-    for (auto promptY = bottom; promptY >= 0; promptY--)
+    const auto rows = _collectMarks();
+    auto lastPromptY = _estimateOffsetOfLastCommittedRow();
+    for (auto it = rows.rbegin(); it != rows.rend(); ++it)
     {
-        const auto& currRow = GetRowByOffset(promptY);
-        auto& rowPromptData = currRow.GetScrollbarData();
-        if (!rowPromptData.has_value())
-        {
-            // This row didn't start a prompt, don't even look here.
-            continue;
-        }
+        const auto promptY = it->row;
 
         // Future thought! In #11000 & #14792, we considered the possibility of
         // scrolling to only an error mark, or something like that. Perhaps in
@@ -3109,7 +4301,7 @@ std::vector<MarkExtents> TextBuffer::GetMarkExtents(size_t limit) const
         // For now, skip any "Default" marks, since those came from the UI. We
         // just want the ones that correspond to shell integration.
 
-        if (rowPromptData->category == MarkCategory::Default)
+        if (it->data.category == MarkCategory::Default)
         {
             continue;
         }
@@ -3307,39 +4499,27 @@ std::wstring TextBuffer::_commandForRow(const til::CoordType rowOffset, const ti
 
 std::wstring TextBuffer::CurrentCommand() const
 {
-    auto promptY = GetCursor().GetPosition().y;
-    for (; promptY >= 0; promptY--)
+    // Find the last prompt at or above the cursor.
+    const auto marks = _collectMarks();
+    const auto it = std::ranges::upper_bound(marks, GetCursor().GetPosition().y, {}, &ScrollMark::row);
+    if (it == marks.begin())
     {
-        const auto& currRow = GetRowByOffset(promptY);
-        auto& rowPromptData = currRow.GetScrollbarData();
-        if (!rowPromptData.has_value())
-        {
-            // This row didn't start a prompt, don't even look here.
-            continue;
-        }
-
-        // This row did start a prompt! Find the prompt that starts here.
-        // Presumably, no rows below us will have prompts, so pass in the last
-        // row with text as the bottom
-        return _commandForRow(promptY, _estimateOffsetOfLastCommittedRow());
+        return L"";
     }
-    return L"";
+
+    // Presumably, no rows below us will have prompts, so pass in the last
+    // row with text as the bottom
+    return _commandForRow(std::prev(it)->row, _estimateOffsetOfLastCommittedRow());
 }
 
 std::vector<std::wstring> TextBuffer::Commands() const
 {
     std::vector<std::wstring> commands{};
-    const auto bottom = _estimateOffsetOfLastCommittedRow();
-    auto lastPromptY = bottom;
-    for (auto promptY = bottom; promptY >= 0; promptY--)
+    const auto marks = _collectMarks();
+    auto lastPromptY = _estimateOffsetOfLastCommittedRow();
+    for (auto it = marks.rbegin(); it != marks.rend(); ++it)
     {
-        const auto& currRow = GetRowByOffset(promptY);
-        auto& rowPromptData = currRow.GetScrollbarData();
-        if (!rowPromptData.has_value())
-        {
-            // This row didn't start a prompt, don't even look here.
-            continue;
-        }
+        const auto promptY = it->row;
 
         // This row did start a prompt! Find the prompt that starts here.
         // Presumably, no rows below us will have prompts, so pass in the last
@@ -3360,6 +4540,7 @@ void TextBuffer::StartPrompt()
     const auto currentRowOffset = GetCursor().GetPosition().y;
     auto& currentRow = GetMutableRowByOffset(currentRowOffset);
     currentRow.StartPrompt();
+    _indexMark(currentRowOffset);
 
     _currentAttributes.SetMarkAttributes(MarkKind::Prompt);
 }
@@ -3404,8 +4585,10 @@ bool TextBuffer::_createPromptMarkIfNeeded()
     //   --> add a new mark to this row, set all the attrs in this row
     //   to be Prompt, and set the current attrs to Output.
 
-    auto& row = GetMutableRowByOffset(GetCursor().GetPosition().y);
+    const auto y = GetCursor().GetPosition().y;
+    auto& row = GetMutableRowByOffset(y);
     row.StartPrompt();
+    _indexMark(y);
     return true;
 }
 
@@ -3428,15 +4611,11 @@ void TextBuffer::EndCurrentCommand(std::optional<unsigned int> error)
 {
     _currentAttributes.SetMarkAttributes(MarkKind::None);
 
-    for (auto y = GetCursor().GetPosition().y; y >= 0; y--)
+    const auto marks = _collectMarks();
+    const auto it = std::ranges::upper_bound(marks, GetCursor().GetPosition().y, {}, &ScrollMark::row);
+    if (it != marks.begin())
     {
-        auto& currRow = GetMutableRowByOffset(y);
-        auto& rowPromptData = currRow.GetScrollbarData();
-        if (rowPromptData.has_value())
-        {
-            currRow.EndOutput(error);
-            return;
-        }
+        GetMutableRowByOffset(std::prev(it)->row).EndOutput(error);
     }
 }
 
@@ -3444,6 +4623,7 @@ void TextBuffer::SetScrollbarData(ScrollbarData mark, til::CoordType y)
 {
     auto& row = GetMutableRowByOffset(y);
     row.SetScrollbarData(mark);
+    _indexMark(y);
 }
 void TextBuffer::ManuallyMarkRowAsPrompt(til::CoordType y)
 {
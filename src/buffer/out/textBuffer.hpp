@@ -156,6 +156,7 @@ public:
 
     void Reset() noexcept;
     void ClearScrollback(const til::CoordType start, const til::CoordType height);
+    void FreezeColdRows(til::CoordType hotRowCount);
 
     void ResizeTraditional(const til::size newSize);
 
@@ -187,9 +188,11 @@ public:
     void AddHyperlinkToMap(std::wstring_view uri, uint16_t id);
     std::wstring GetHyperlinkUriFromId(uint16_t id) const;
     uint16_t GetHyperlinkId(std::wstring_view uri, std::wstring_view id);
-    void RemoveHyperlinkFromMap(uint16_t id) noexcept;
+    void RemoveHyperlinkFromMap(uint16_t id);
     std::wstring GetCustomIdFromId(uint16_t id) const;
     void CopyHyperlinkMaps(const TextBuffer& OtherBuffer);
+    void PinHyperlinks();
+    void UnpinHyperlinks() noexcept;
 
     size_t SpanLength(const til::point coordStart, const til::point coordEnd) const;
 
@@ -266,21 +269,24 @@ public:
 
     std::wstring GetPlainText(const CopyRequest& req) const;
 
-    std::string GenHTML(const CopyRequest& req,
-                        const int fontHeightPoints,
-                        const std::wstring_view fontFaceName,
-                        const COLORREF backgroundColor,
-                        const bool isIntenseBold,
-                        std::function<std::tuple<COLORREF, COLORREF, COLORREF>(const TextAttribute&)> GetAttributeColors) const noexcept;
+    struct CopyFormats
+    {
+        std::wstring plainText;
+        std::string html;
+        std::string rtf;
+    };
 
-    std::string GenRTF(const CopyRequest& req,
-                       const int fontHeightPoints,
-                       const std::wstring_view fontFaceName,
-                       const COLORREF backgroundColor,
-                       const bool isIntenseBold,
-                       std::function<std::tuple<COLORREF, COLORREF, COLORREF>(const TextAttribute&)> GetAttributeColors) const noexcept;
+    CopyFormats GenCopyFormats(const CopyRequest& req,
+                               const bool html,
+                               const bool rtf,
+                               const int fontHeightPoints,
+                               const std::wstring_view fontFaceName,
+                               const COLORREF backgroundColor,
+                               const bool isIntenseBold,
+                               const std::function<std::tuple<COLORREF, COLORREF, COLORREF>(const TextAttribute&)>& GetAttributeColors) const;
 
-    void Serialize(const wchar_t* destination) const;
+    void SerializeSnapshot(const wchar_t* destination) const;
+    static std::unique_ptr<TextBuffer> DeserializeSnapshot(HANDLE file);
 
     struct PositionInformation
     {
@@ -289,10 +295,33 @@ public:
     };
 
     static void Reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const Microsoft::Console::Types::Viewport* lastCharacterViewport = nullptr, PositionInformation* positionInfo = nullptr);
+    static til::CoordType ReflowRows(TextBuffer& oldBuffer, TextBuffer& newBuffer, til::CoordType oldRowBegin, til::CoordType oldRowEnd, til::CoordType newRowBegin, const Microsoft::Console::Types::Viewport* lastCharacterViewport = nullptr, PositionInformation* positionInfo = nullptr);
 
     std::optional<std::vector<til::point_span>> SearchText(const std::wstring_view& needle, SearchFlag flags) const;
     std::optional<std::vector<til::point_span>> SearchText(const std::wstring_view& needle, SearchFlag flags, til::CoordType rowBeg, til::CoordType rowEnd) const;
 
+    // Holds the per-line results of previous SearchText() calls, so that repeated
+    // searches only need to look at the lines that changed in the meantime.
+    struct SearchCache
+    {
+        struct Line
+        {
+            // The highest ROW::GetMutationId() of all rows of the line at the time it was searched.
+            uint64_t mutationId = 0;
+            til::CoordType height = 0;
+            // The y coordinates are relative to the first row of the line.
+            std::vector<til::point_span> matches;
+        };
+
+        std::wstring needle;
+        SearchFlag flags{};
+        til::CoordType width = 0;
+        // Indexed by the position of each line's first row in the circular buffer.
+        std::vector<Line> lines;
+    };
+
+    std::optional<std::vector<til::point_span>> SearchText(const std::wstring_view& needle, SearchFlag flags, SearchCache& cache) const;
+
     // Mark handling
     std::vector<ScrollMark> GetMarkRows() const;
     std::vector<MarkExtents> GetMarkExtents(size_t limit = SIZE_T_MAX) const;
@@ -316,6 +345,14 @@ private:
     ROW& _getRowByOffsetDirect(size_t offset);
     ROW& _getRow(til::CoordType y) const;
     til::CoordType _estimateOffsetOfLastCommittedRow() const noexcept;
+    bool _isFrozen(size_t offset) const noexcept;
+    std::pair<std::byte*, std::byte*> _frozenBlockRange(size_t block) const noexcept;
+    void _thaw(size_t offset);
+    void _freeze(size_t block);
+    std::vector<ScrollMark> _collectMarks() const;
+    void _indexMark(til::CoordType y);
+    static til::CoordType _reflow(TextBuffer& oldBuffer, TextBuffer& newBuffer, const Microsoft::Console::Types::Viewport* lastCharacterViewport, PositionInformation* positionInfo, bool allowParallel, til::CoordType oldRowBegin = 0, til::CoordType oldRowEnd = til::CoordTypeMax, til::CoordType newRowBegin = 0);
+    static bool _reflowParallel(const TextBuffer& oldBuffer, TextBuffer& newBuffer, til::point oldCursorPos, til::CoordType oldHeight, PositionInformation* positionInfo, til::CoordType& newY, til::point& newCursorPos);
 
     void _SetFirstRowIndex(const til::CoordType FirstRowIndex) noexcept;
     void _ExpandTextRow(til::inclusive_rect& selectionRow) const;
@@ -336,9 +373,35 @@ private:
 
     Microsoft::Console::Render::Renderer* _renderer = nullptr;
 
-    std::unordered_map<uint16_t, std::wstring> _hyperlinkMap;
-    std::unordered_map<std::wstring, uint16_t> _hyperlinkCustomIdMap;
-    uint16_t _currentHyperlinkId = 1;
+    // The hyperlink table is indexed by the hyperlink ID stored in the TextAttributes. ID 0 means "no hyperlink"
+    // and so entry 0 is never used. Entries with an empty URI are unused and their IDs are in _freeHyperlinkIds.
+    // Hyperlinks aren't reference counted. Instead, once the table has grown past _hyperlinkPruneThreshold,
+    // GetHyperlinkId() calls _PruneHyperlinks() which frees all entries that aren't referenced anywhere anymore.
+    // The threshold is then set to twice the number of surviving entries, so that each sweep over the
+    // buffer is paid for by at least as many new hyperlinks and the cost per hyperlink is amortized O(1).
+    struct Hyperlink
+    {
+        std::wstring uri;
+        // The key of this hyperlink in _hyperlinkCustomIdMap, if it was given a custom ID.
+        std::wstring customIdKey;
+    };
+    struct HyperlinkKeyHasher
+    {
+        using is_transparent = void;
+
+        std::size_t operator()(const std::wstring_view& str) const noexcept
+        {
+            return til::hash(str);
+        }
+    };
+    static constexpr size_t _hyperlinkPruneMinimum = 256;
+    std::vector<Hyperlink> _hyperlinks;
+    std::vector<uint16_t> _freeHyperlinkIds;
+    std::unordered_map<std::wstring, uint16_t, HyperlinkKeyHasher, std::equal_to<>> _hyperlinkCustomIdMap;
+    size_t _hyperlinkCount = 0;
+    size_t _hyperlinkPruneThreshold = _hyperlinkPruneMinimum;
+    // IDs that _PruneHyperlinks() must not free, because rows outside of this buffer still refer to them.
+    std::vector<uint16_t> _pinnedHyperlinks;
 
     // This block describes the state of the underlying virtual memory buffer that holds all ROWs, text and attributes.
     // Initially memory is only allocated with MEM_RESERVE to reduce the private working set of conhost.
@@ -397,6 +460,40 @@ private:
     // The height of the buffer in rows, excluding the scratchpad row.
     uint16_t _height = 0;
 
+    // Rows far enough above the cursor are "cold" and FreezeColdRows() may freeze them in blocks of _frozenBlockRows:
+    // The rows get packed with ROW::Pack(), LZ4 compressed and destroyed, and their memory is decommitted.
+    // Accessing any row in a frozen block will thaw (restore) the entire block. Block i consists of the
+    // rows at the offsets [1 + i * _frozenBlockRows, 1 + (i + 1) * _frozenBlockRows) (offset 0 is the scratchpad).
+    struct FrozenBlock
+    {
+        std::vector<uint8_t> data;
+        // The hyperlink IDs used by the frozen rows, so that _PruneHyperlinks() doesn't need to thaw them.
+        std::vector<uint16_t> hyperlinks;
+        size_t size = 0;
+        bool frozen = false;
+    };
+    std::vector<FrozenBlock> _frozenBlocks;
+    // Allows _getRowByOffsetDirect() to skip the check for frozen blocks if there are none.
+    size_t _frozenBlockCount = 0;
+    size_t _frozenBlockRows = 0;
+    // The most recently thawed blocks, oldest first. They're exempt from being frozen again,
+    // so that scrolling through the history doesn't thaw and freeze the same blocks over and over.
+    std::vector<size_t> _thawedBlocks;
+    static constexpr size_t _thawedBlocksLimit = 8;
+    uint64_t _lastFreezeMutationId = 0;
+
+    // An index of all rows with ScrollbarData, so that mark queries don't need to look at every row.
+    // It's sorted by physical row ((_firstRow + y) % _height), which is unaffected by the circular buffer rotating.
+    // Entries are added whenever a row gains a mark, but are only removed lazily by _collectMarks() once
+    // their row has lost it (for instance, because it got Reset() or overwritten by ScrollRows()).
+    // `data` is a copy of the row's ScrollbarData, so that frozen rows don't need to be thawed to query it.
+    struct MarkIndexEntry
+    {
+        til::CoordType row = 0;
+        ScrollbarData data;
+    };
+    mutable std::vector<MarkIndexEntry> _markIndex;
+
     TextAttribute _currentAttributes;
     til::CoordType _firstRow = 0; // indexes top row (not necessarily 0)
     uint64_t _lastMutationId = 0;
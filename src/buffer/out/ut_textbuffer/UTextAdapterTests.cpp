@@ -61,4 +61,181 @@ class UTextAdapterTests
         actual = buffer.SearchText(L"ネコ", SearchFlag::None);
         VERIFY_ARE_EQUAL(expected, actual);
     }
+
+    TEST_METHOD(LiteralSearch)
+    {
+        DummyRenderer renderer;
+        TextBuffer buffer{ til::size{ 6, 2 }, TextAttribute{}, 0, false, &renderer };
+
+        RowWriteState state{
+            .text = L"xxxxAb",
+        };
+        buffer.Replace(0, TextAttribute{}, state);
+        buffer.GetMutableRowByOffset(0).SetWrapForced(true);
+        state = RowWriteState{
+            .text = L"C\x3a3bc",
+        };
+        buffer.Replace(1, TextAttribute{}, state);
+
+        static constexpr auto s = [](til::CoordType x1, til::CoordType y1, til::CoordType x2, til::CoordType y2) -> til::point_span {
+            return { { x1, y1 }, { x2, y2 } };
+        };
+
+        auto expected = std::vector{ s(4, 0, 0, 1) };
+        auto actual = buffer.SearchText(L"AbC", SearchFlag::None);
+        VERIFY_ARE_EQUAL(expected, actual);
+
+        actual = buffer.SearchText(L"abc", SearchFlag::None);
+        VERIFY_ARE_EQUAL(std::vector<til::point_span>{}, actual);
+
+        actual = buffer.SearchText(L"\x3c3", SearchFlag::CaseInsensitive);
+        VERIFY_ARE_EQUAL(std::vector{ s(1, 1, 1, 1) }, actual);
+        actual = buffer.SearchText(L"ABC", SearchFlag::CaseInsensitive);
+        VERIFY_ARE_EQUAL(std::vector{ s(4, 0, 0, 1) }, actual);
+    }
+
+    TEST_METHOD(CachedSearch)
+    {
+        DummyRenderer renderer;
+        TextBuffer buffer{ til::size{ 10, 4 }, TextAttribute{}, 0, false, &renderer };
+
+        const auto write = [&](til::CoordType y, const wchar_t* text) {
+            RowWriteState state{
+                .text = text,
+            };
+            buffer.Replace(y, TextAttribute{}, state);
+        };
+        static constexpr auto s = [](til::CoordType x1, til::CoordType y1, til::CoordType x2, til::CoordType y2) -> til::point_span {
+            return { { x1, y1 }, { x2, y2 } };
+        };
+
+        write(0, L"abc");
+        write(1, L"xxxxxxxxab");
+        buffer.GetMutableRowByOffset(1).SetWrapForced(true);
+        write(2, L"c");
+
+        TextBuffer::SearchCache cache;
+        auto expected = std::vector{ s(0, 0, 2, 0), s(8, 1, 0, 2) };
+        auto actual = buffer.SearchText(L"abc", SearchFlag::None, cache);
+        VERIFY_ARE_EQUAL(expected, actual);
+        VERIFY_ARE_EQUAL(expected, buffer.SearchText(L"abc", SearchFlag::None));
+
+        // Modifying a row must only invalidate the line it belongs to.
+        const auto firstLineMutationId = cache.lines.at(0).mutationId;
+        write(3, L"abc");
+        expected = std::vector{ s(0, 0, 2, 0), s(8, 1, 0, 2), s(0, 3, 2, 3) };
+        actual = buffer.SearchText(L"abc", SearchFlag::None, cache);
+        VERIFY_ARE_EQUAL(expected, actual);
+        VERIFY_ARE_EQUAL(firstLineMutationId, cache.lines.at(0).mutationId);
+
+        // Scrolling the buffer must shift the cached results.
+        buffer.IncrementCircularBuffer();
+        expected = std::vector{ s(8, 0, 0, 1), s(0, 2, 2, 2) };
+        actual = buffer.SearchText(L"abc", SearchFlag::None, cache);
+        VERIFY_ARE_EQUAL(expected, actual);
+        VERIFY_ARE_EQUAL(expected, buffer.SearchText(L"abc", SearchFlag::None));
+
+        // A different needle must not return stale results.
+        expected = std::vector{ s(0, 0, 8, 0) };
+        actual = buffer.SearchText(L"xxxxxxxxx", SearchFlag::None, cache);
+        VERIFY_ARE_EQUAL(expected, actual);
+    }
+
+    TEST_METHOD(CachedSearchAcrossLineBreaks)
+    {
+        DummyRenderer renderer;
+        TextBuffer buffer{ til::size{ 10, 4 }, TextAttribute{}, 0, false, &renderer };
+
+        const auto write = [&](til::CoordType y, const wchar_t* text) {
+            RowWriteState state{
+                .text = text,
+            };
+            buffer.Replace(y, TextAttribute{}, state);
+        };
+        static constexpr auto s = [](til::CoordType x1, til::CoordType y1, til::CoordType x2, til::CoordType y2) -> til::point_span {
+            return { { x1, y1 }, { x2, y2 } };
+        };
+
+        // Two lines separated by an explicit line break.
+        write(0, L"foo");
+        write(1, L"bar");
+
+        TextBuffer::SearchCache cache;
+        const auto expected = std::vector{ s(0, 0, 2, 1) };
+        for (const auto needle : { L"foo\\nbar", L"foo\\s+bar" })
+        {
+            const auto actual = buffer.SearchText(needle, SearchFlag::RegularExpression, cache);
+            VERIFY_ARE_EQUAL(expected, actual);
+            VERIFY_ARE_EQUAL(expected, buffer.SearchText(needle, SearchFlag::RegularExpression));
+            VERIFY_ARE_EQUAL(0u, cache.lines.size());
+        }
+
+        // A literal needle continues to use the cache.
+        auto actual = buffer.SearchText(L"bar", SearchFlag::None, cache);
+        VERIFY_ARE_EQUAL(std::vector{ s(0, 1, 2, 1) }, actual);
+        VERIFY_ARE_NOT_EQUAL(0u, cache.lines.size());
+
+        // So does a regular expression that can't match a line break.
+        actual = buffer.SearchText(L"b[a-z]r", SearchFlag::RegularExpression, cache);
+        VERIFY_ARE_EQUAL(std::vector{ s(0, 1, 2, 1) }, actual);
+        VERIFY_ARE_NOT_EQUAL(0u, cache.lines.size());
+
+        // ...and picks up modifications to the buffer.
+        write(0, L"baz");
+        actual = buffer.SearchText(L"b[a-z]r", SearchFlag::RegularExpression, cache);
+        VERIFY_ARE_EQUAL(std::vector{ s(0, 1, 2, 1) }, actual);
+        write(0, L"bor");
+        actual = buffer.SearchText(L"b[a-z]r", SearchFlag::RegularExpression, cache);
+        VERIFY_ARE_EQUAL((std::vector{ s(0, 0, 2, 0), s(0, 1, 2, 1) }), actual);
+        VERIFY_ARE_EQUAL(actual, buffer.SearchText(L"b[a-z]r", SearchFlag::RegularExpression));
+    }
+
+    TEST_METHOD(ParallelSearch)
+    {
+        // Large enough to be split up into multiple shards on any machine with more than 1 core.
+        static constexpr til::CoordType height = 8192;
+
+        DummyRenderer renderer;
+        TextBuffer buffer{ til::size{ 8, height }, TextAttribute{}, 0, false, &renderer };
+
+        for (til::CoordType y = 0; y < height; ++y)
+        {
+            const auto text = fmt::format(L"{:08}", y);
+            RowWriteState state{
+                .text = text,
+            };
+            buffer.Replace(y, TextAttribute{}, state);
+            // Marking every 4th row as wrapped results in a mix of lines spanning 1 and 2 rows.
+            buffer.GetMutableRowByOffset(y).SetWrapForced(y % 4 == 0);
+        }
+
+        // The first search with a cache searches all lines in parallel, each shard with its own
+        // copy of the LiteralSearcher or URegularExpression, while SearchText() without a cache is serial.
+        static constexpr std::pair<const wchar_t*, SearchFlag> needles[]{
+            { L"0077", SearchFlag::None },
+            { L"0077", SearchFlag::RegularExpression },
+            { L"00[78]7", SearchFlag::RegularExpression },
+        };
+        for (const auto& [needle, flags] : needles)
+        {
+            TextBuffer::SearchCache cache;
+            const auto expected = buffer.SearchText(needle, flags, 0, height);
+            const auto actual = buffer.SearchText(needle, flags, cache);
+            VERIFY_IS_TRUE(expected.has_value());
+            VERIFY_IS_FALSE(expected->empty());
+            VERIFY_ARE_EQUAL(expected, actual);
+            VERIFY_ARE_EQUAL(static_cast<size_t>(height), cache.lines.size());
+        }
+
+        // Regular expressions that may cross lines are still searched for in the entire buffer at once.
+        {
+            TextBuffer::SearchCache cache;
+            const auto expected = buffer.SearchText(L"0077\\n", SearchFlag::RegularExpression, 0, height);
+            const auto actual = buffer.SearchText(L"0077\\n", SearchFlag::RegularExpression, cache);
+            VERIFY_IS_TRUE(expected.has_value());
+            VERIFY_IS_FALSE(expected->empty());
+            VERIFY_ARE_EQUAL(expected, actual);
+            VERIFY_ARE_EQUAL(0u, cache.lines.size());
+        }
+    }
 };
@@ -658,7 +658,10 @@ namespace winrt::Microsoft::Terminal::TerminalConnection::implementation
         DWORD read = 0;
 
         til::u8state u8State;
-        std::wstring wstr;
+        // til::u8u16 needs room for 1 UTF-16 code unit per byte plus any partial code point carried over from the previous read.
+        // Allocating it once up front avoids resizing (and zero-filling) a std::wstring for every read.
+        std::wstring wbuffer(std::size(buffer) + std::size(u8State.partials), L'\0');
+        std::wstring_view wstr;
 
         // If we use overlapped IO We want to queue ReadFile() calls before processing the
         // string, because TerminalOutput.raise() may take a while (relatively speaking).
@@ -742,7 +745,7 @@ namespace winrt::Microsoft::Terminal::TerminalConnection::implementation
                 TraceLoggingKeyword(TIL_KEYWORD_TRACE));
 
             // If we hit a parsing error, eat it. It's bad utf-8, we can't do anything with it.
-            FAILED_LOG(til::u8u16({ &buffer[0], gsl::narrow_cast<size_t>(read) }, wstr, u8State));
+            FAILED_LOG(til::u8u16({ &buffer[0], gsl::narrow_cast<size_t>(read) }, wbuffer, wstr, u8State));
         }
 
         return 0;
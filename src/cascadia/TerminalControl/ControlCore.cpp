@@ -198,6 +198,31 @@ namespace winrt::Microsoft::Terminal::Control::implementation
                 }
             });
 
+        // Resizing only reflows the viewport and some scrollback above it (see _refreshSizeUnderLock).
+        // Once the size stopped changing, this reflows the rest of the history in the background.
+        shared->commitResize = std::make_unique<til::debounced_func_trailing<>>(
+            std::chrono::milliseconds{ 100 },
+            [weakTerminal = std::weak_ptr{ _terminal }, weakThis = get_weak(), dispatcher = _dispatcher]() {
+                const auto t = weakTerminal.lock();
+                if (!t || !t->CommitUserResize())
+                {
+                    return;
+                }
+
+                // The main buffer got longer and everything in it moved down.
+                dispatcher.TryEnqueue(DispatcherQueuePriority::Normal, [weakThis]() {
+                    if (const auto self = weakThis.get(); self && !self->_IsClosing())
+                    {
+                        self->ClearSearch();
+                        const auto shared = self->_shared.lock_shared();
+                        if (shared->outputIdle)
+                        {
+                            (*shared->outputIdle)();
+                        }
+                    }
+                });
+            });
+
         // Scrollbar updates are also expensive (XAML), so we'll throttle them as well.
         shared->updateScrollBar = std::make_shared<ThrottledFuncTrailing<Control::ScrollPositionChangedArgs>>(
             _dispatcher,
@@ -229,6 +254,7 @@ namespace winrt::Microsoft::Terminal::Control::implementation
         // we're re-attached to a new control (on a possibly new UI thread).
         const auto shared = _shared.lock();
         shared->outputIdle.reset();
+        shared->commitResize.reset();
         shared->updateScrollBar.reset();
     }
 
@@ -1106,7 +1132,10 @@ namespace winrt::Microsoft::Terminal::Control::implementation
 
         // If this function succeeds with S_FALSE, then the terminal didn't
         // actually change size. No need to notify the connection of this no-op.
-        const auto hr = _terminal->UserResize({ vp.Width(), vp.Height() });
+        // During a drag-resize we get called for every intermediate size. Reflowing the entire
+        // scrollback each time would be too slow, so we only reflow what's on (or near) the screen
+        // and let commitResize reflow the rest once the size stopped changing.
+        const auto hr = _terminal->UserResizePreview({ vp.Width(), vp.Height() });
         if (FAILED(hr) || hr == S_FALSE)
         {
             return;
@@ -1122,6 +1151,10 @@ namespace winrt::Microsoft::Terminal::Control::implementation
         {
             (*shared->outputIdle)();
         }
+        if (shared->commitResize)
+        {
+            (*shared->commitResize)();
+        }
     }
 
     void ControlCore::SizeChanged(const float width,
@@ -1790,7 +1823,8 @@ namespace winrt::Microsoft::Terminal::Control::implementation
 
     void ControlCore::PersistToPath(const wchar_t* path) const
     {
-        const auto lock = _terminal->LockForReading();
+        // SerializeMainBuffer() may need to finish a pending resize first.
+        const auto lock = _terminal->LockForWriting();
         _terminal->SerializeMainBuffer(path);
     }
 
@@ -1829,28 +1863,38 @@ namespace winrt::Microsoft::Terminal::Control::implementation
             message = fmt::format(FMT_COMPILE(L"\x1b[100;37m  [{} {} {}]\x1b[K\x1b[m\r\n"), msg, date, time);
         }
 
-        wchar_t buffer[32 * 1024];
-        DWORD read = 0;
-
-        // Ensure the text file starts with a UTF-16 BOM.
-        if (!ReadFile(file.get(), &buffer[0], 2, &read, nullptr) || read < 2 || buffer[0] != L'\uFEFF')
+        // PersistToPath() writes binary snapshots, which restore without going through the VT parser.
+        // Files from older versions contain VT sequences instead, and we still need to replay those.
+        if (const auto snapshot = TextBuffer::DeserializeSnapshot(file.get()))
         {
-            return;
+            const auto lock = _terminal->LockForWriting();
+            _terminal->RestoreMainBuffer(*snapshot);
         }
-
-        for (;;)
+        else
         {
-            if (!ReadFile(file.get(), &buffer[0], sizeof(buffer), &read, nullptr))
+            wchar_t buffer[32 * 1024];
+            DWORD read = 0;
+
+            // Ensure the text file starts with a UTF-16 BOM.
+            if (!ReadFile(file.get(), &buffer[0], 2, &read, nullptr) || read < 2 || buffer[0] != L'\uFEFF')
             {
-                break;
+                return;
             }
 
-            const auto lock = _terminal->LockForWriting();
-            _terminal->Write({ &buffer[0], read / 2 });
-
-            if (read < sizeof(buffer))
+            for (;;)
             {
-                break;
+                if (!ReadFile(file.get(), &buffer[0], sizeof(buffer), &read, nullptr))
+                {
+                    break;
+                }
+
+                const auto lock = _terminal->LockForWriting();
+                _terminal->Write({ &buffer[0], read / 2 });
+
+                if (read < sizeof(buffer))
+                {
+                    break;
+                }
             }
         }
 
@@ -209,6 +209,10 @@ void Terminal::SetCursorStyle(const DispatchTypes::CursorStyle cursorStyle)
 
 void Terminal::EraseScrollback()
 {
+    // The history that's still waiting to be reflowed is scrollback too.
+    _resizeHistory.reset();
+    _mainBuffer->UnpinHyperlinks();
+
     auto& engine = reinterpret_cast<OutputStateMachineEngine&>(_stateMachine->Engine());
     engine.Dispatch().EraseInDisplay(DispatchTypes::EraseType::Scrollback);
 }
@@ -232,6 +236,62 @@ std::wstring_view Terminal::GetWorkingDirectory() noexcept
 //      nothing to do (the viewportSize is the same as our current size), or an
 //      appropriate HRESULT for failing to resize.
 [[nodiscard]] HRESULT Terminal::UserResize(const til::size viewportSize) noexcept
+{
+    return _userResize(viewportSize, false);
+}
+
+// Method Description:
+// - Same as UserResize(), but meant for the intermediate sizes of an interactive resize.
+//   It only reflows the viewport and a margin of scrollback above it. The rest of the
+//   history is reflowed once by CommitUserResize(), after the size stopped changing.
+//   Until then, the scrollback appears to be cut off above that margin.
+// Arguments:
+// - viewportSize: the new size of the viewport, in chars
+// Return Value:
+// - See UserResize().
+[[nodiscard]] HRESULT Terminal::UserResizePreview(const til::size viewportSize) noexcept
+{
+    return _userResize(viewportSize, true);
+}
+
+// Method Description:
+// - Reflows the history that UserResizePreview() left out into a buffer of the
+//   current size, and prepends it to the main buffer.
+// - The reflow itself runs without holding the terminal lock, which is why the caller
+//   must not hold it either. The result is only swapped in if the main buffer didn't
+//   change size in the meantime. If it did, another call to this function will follow.
+// Return Value:
+// - true if the main buffer was replaced.
+bool Terminal::CommitUserResize()
+{
+    std::shared_ptr<ResizeHistory> history;
+    til::size bufferSize;
+    Renderer* renderer = nullptr;
+    {
+        const auto lock = LockForWriting();
+        if (!_resizeHistory)
+        {
+            return false;
+        }
+        history = _resizeHistory;
+        bufferSize = _mainBuffer->GetSize().Dimensions();
+        renderer = _mainBuffer->GetRenderer();
+    }
+
+    // The new buffer is inactive until it gets swapped in, so that it doesn't talk to the renderer.
+    auto newTextBuffer = std::make_unique<TextBuffer>(bufferSize, TextAttribute{}, 0, false, renderer);
+    const auto historyRows = _reflowResizeHistory(*history, *newTextBuffer);
+
+    const auto lock = LockForWriting();
+    if (_resizeHistory != history || _mainBuffer->GetSize().Dimensions() != bufferSize)
+    {
+        return false;
+    }
+    _finishResizeHistory(std::move(newTextBuffer), historyRows);
+    return true;
+}
+
+[[nodiscard]] HRESULT Terminal::_userResize(const til::size viewportSize, const bool preview) noexcept
 try
 {
     const auto oldDimensions = _GetMutableViewport().Dimensions();
@@ -257,6 +317,18 @@ try
         return S_OK;
     }
 
+    // A preview doesn't reflow the rows above oldRowBegin, and keeps them around in _resizeHistory instead.
+    // Once there's a _resizeHistory, the main buffer is small enough that it can be reflowed in its entirety.
+    til::CoordType oldRowBegin = 0;
+    if (!preview)
+    {
+        _commitResizeHistory();
+    }
+    else if (!_resizeHistory)
+    {
+        oldRowBegin = _resizePreviewBegin();
+    }
+
     const auto newBufferHeight = std::clamp(viewportSize.height + _scrollbackLines, 1, SHRT_MAX);
     const til::size bufferSize{ viewportSize.width, newBufferHeight };
 
@@ -289,7 +361,14 @@ try
         .visibleViewportTop = _VisibleStartIndex(),
     };
 
-    TextBuffer::Reflow(*_mainBuffer.get(), *newTextBuffer.get(), &_mutableViewport, &positionInfo);
+    if (oldRowBegin)
+    {
+        TextBuffer::ReflowRows(*_mainBuffer, *newTextBuffer, oldRowBegin, til::CoordTypeMax, 0, &_mutableViewport, &positionInfo);
+    }
+    else
+    {
+        TextBuffer::Reflow(*_mainBuffer.get(), *newTextBuffer.get(), &_mutableViewport, &positionInfo);
+    }
 
     // Restore the active text attributes
     newTextBuffer->SetCurrentAttributes(_mainBuffer->GetCurrentAttributes());
@@ -398,6 +477,23 @@ try
 
     _mainBuffer.swap(newTextBuffer);
 
+    if (oldRowBegin)
+    {
+        auto history = std::make_shared<ResizeHistory>();
+        history->buffer = std::move(newTextBuffer);
+        history->buffer->SetAsActiveBuffer(false);
+        history->end = oldRowBegin;
+        _resizeHistory = std::move(history);
+    }
+
+    // The history shares the hyperlink table that the main buffer got a copy of. The main buffer must not
+    // prune (and then reuse) the IDs that only the history refers to, because _finishResizeHistory()
+    // ends up with the main buffer's table. Each preview creates a new main buffer, so this is redone every time.
+    if (_resizeHistory)
+    {
+        _mainBuffer->PinHyperlinks();
+    }
+
     // GH#3494: Maintain scrollbar position during resize
     // Make sure that we don't scroll past the mutableViewport at the bottom of the buffer
     auto newVisibleTop = std::min(positionInfo.visibleViewportTop, _mutableViewport.Top());
@@ -414,9 +510,95 @@ try
 }
 CATCH_RETURN()
 
+// Returns the first row of the main buffer that UserResizePreview() reflows.
+til::CoordType Terminal::_resizePreviewBegin() const
+{
+    // Enough scrollback to look around during a resize, while still being quick to reflow.
+    static constexpr til::CoordType margin = 1000;
+
+    auto y = std::max(0, _VisibleStartIndex() - margin);
+    // The history and the rest of the buffer are reflowed separately,
+    // so the history must end with a complete line.
+    while (y > 0 && _mainBuffer->GetRowByOffset(y - 1).WasWrapForced())
+    {
+        --y;
+    }
+    return y;
+}
+
+// Reflows the history that UserResizePreview() left out into the given, empty buffer.
+// Returns the number of rows that were written, which may exceed the buffer's height.
+til::CoordType Terminal::_reflowResizeHistory(ResizeHistory& history, TextBuffer& newTextBuffer)
+{
+    const std::lock_guard guard{ history.mutex };
+    return TextBuffer::ReflowRows(*history.buffer, newTextBuffer, 0, history.end, 0);
+}
+
+// Same as CommitUserResize(), but synchronous and under the lock,
+// for when the entire main buffer is needed right away.
+void Terminal::_commitResizeHistory()
+{
+    if (!_resizeHistory)
+    {
+        return;
+    }
+
+    auto newTextBuffer = std::make_unique<TextBuffer>(_mainBuffer->GetSize().Dimensions(), TextAttribute{}, 0, false, _mainBuffer->GetRenderer());
+    const auto historyRows = _reflowResizeHistory(*_resizeHistory, *newTextBuffer);
+    _finishResizeHistory(std::move(newTextBuffer), historyRows);
+}
+
+// Appends the main buffer to the reflowed history in newTextBuffer and makes that the new main buffer.
+void Terminal::_finishResizeHistory(std::unique_ptr<TextBuffer> newTextBuffer, const til::CoordType historyRows)
+{
+    const auto height = newTextBuffer->GetSize().Height();
+    const auto viewportSize = _mutableViewport.Dimensions();
+    const auto originalOffsetWasZero = _scrollOffset == 0;
+
+    TextBuffer::PositionInformation positionInfo{
+        .mutableViewportTop = _mutableViewport.Top(),
+        .visibleViewportTop = _VisibleStartIndex(),
+    };
+
+    // Both buffers have the same width, so this copies the main buffer row by row.
+    // It also replaces the history's hyperlink table with the main buffer's, which has kept all of
+    // the history's hyperlinks around, because they were pinned in _userResize().
+    const auto end = TextBuffer::ReflowRows(*_mainBuffer, *newTextBuffer, 0, til::CoordTypeMax, std::min(historyRows, height), &_mutableViewport, &positionInfo);
+    // If the history and the main buffer didn't fit, the oldest rows were discarded,
+    // which positionInfo doesn't account for.
+    const auto discarded = std::max(0, end - height);
+
+    newTextBuffer->SetCurrentAttributes(_mainBuffer->GetCurrentAttributes());
+    newTextBuffer->SetAsActiveBuffer(_mainBuffer->IsActiveBuffer());
+
+    auto top = std::clamp(positionInfo.mutableViewportTop - discarded, 0, height - viewportSize.height);
+    top = std::min(top, newTextBuffer->GetCursor().GetPosition().y);
+    _mutableViewport = Viewport::FromDimensions({ 0, top }, viewportSize);
+
+    const auto visibleTop = std::clamp(positionInfo.visibleViewportTop - discarded, 0, top);
+    _scrollOffset = originalOffsetWasZero ? 0 : top - visibleTop;
+
+    _mainBuffer = std::move(newTextBuffer);
+    _resizeHistory.reset();
+
+    // Any selection would now be off by the length of the history.
+    if (!_inAltBuffer())
+    {
+        ClearSelection();
+    }
+
+    _mainBuffer->TriggerRedrawAll();
+    _NotifyScrollEvent();
+}
+
 void Terminal::Write(std::wstring_view stringView)
 {
     _stateMachine->ProcessString(stringView);
+
+    // Compress the scrollback that's far enough away from both the cursor and the scrolled-to viewport.
+    const auto cursorY = _mainBuffer->GetCursor().GetPosition().y;
+    const auto viewportHeight = _mutableViewport.Height();
+    _mainBuffer->FreezeColdRows(std::max(viewportHeight * 4, cursorY - _VisibleStartIndex() + viewportHeight));
 }
 
 // Method Description:
@@ -1545,9 +1727,42 @@ std::wstring Terminal::CurrentCommand() const
     return _activeBuffer().CurrentCommand();
 }
 
-void Terminal::SerializeMainBuffer(const wchar_t* destination) const
+void Terminal::SerializeMainBuffer(const wchar_t* destination)
 {
-    _mainBuffer->Serialize(destination);
+    _commitResizeHistory();
+    _mainBuffer->SerializeSnapshot(destination);
+}
+
+// Method Description:
+// - Replaces the contents of the main buffer with a buffer restored by TextBuffer::DeserializeSnapshot().
+//   The snapshot gets reflowed to our current size, the same way a resize would, and the viewport
+//   is placed so that the cursor is at its bottom.
+// Arguments:
+// - snapshot: the restored buffer. It's only read from, but reflowing requires a mutable one.
+void Terminal::RestoreMainBuffer(TextBuffer& snapshot)
+{
+    auto newTextBuffer = std::make_unique<TextBuffer>(_mainBuffer->GetSize().Dimensions(),
+                                                      TextAttribute{},
+                                                      0,
+                                                      _mainBuffer->IsActiveBuffer(),
+                                                      _mainBuffer->GetRenderer());
+    TextBuffer::Reflow(snapshot, *newTextBuffer);
+
+    // Reflow() copied the cursor properties of the snapshot, but the user's cursor style lives in ours.
+    newTextBuffer->CopyProperties(*_mainBuffer);
+    newTextBuffer->GetCursor().SetSize(_mainBuffer->GetCursor().GetSize());
+    newTextBuffer->SetCurrentAttributes(_mainBuffer->GetCurrentAttributes());
+
+    _resizeHistory.reset();
+    _mainBuffer.swap(newTextBuffer);
+
+    const auto viewportSize = _mutableViewport.Dimensions();
+    const auto cursorY = _mainBuffer->GetCursor().GetPosition().y;
+    _mutableViewport = Viewport::FromDimensions({ 0, std::max(0, cursorY - viewportSize.height + 1) }, viewportSize);
+    _scrollOffset = 0;
+
+    _mainBuffer->TriggerRedrawAll();
+    _NotifyScrollEvent();
 }
 
 void Terminal::ColorSelection(const TextAttribute& attr, winrt::Microsoft::Terminal::Core::MatchMode matchMode)
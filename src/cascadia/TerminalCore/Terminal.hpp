@@ -125,7 +125,8 @@ public:
 
     std::wstring CurrentCommand() const;
 
-    void SerializeMainBuffer(const wchar_t* destination) const;
+    void SerializeMainBuffer(const wchar_t* destination);
+    void RestoreMainBuffer(TextBuffer& snapshot);
 
 #pragma region ITerminalApi
     // These methods are defined in TerminalApi.cpp
@@ -172,6 +173,8 @@ public:
     [[nodiscard]] ::Microsoft::Console::VirtualTerminal::TerminalInput::OutputType FocusChanged(const bool focused) override;
 
     [[nodiscard]] HRESULT UserResize(const til::size viewportSize) noexcept override;
+    [[nodiscard]] HRESULT UserResizePreview(const til::size viewportSize) noexcept;
+    bool CommitUserResize();
     void UserScrollViewport(const int viewTop) override;
     int GetScrollOffset() noexcept override;
 
@@ -409,6 +412,18 @@ private:
     til::size _altBufferSize;
     std::optional<til::size> _deferredResize;
 
+    // UserResizePreview() only reflows the bottom of the main buffer. The rows above that remain
+    // in the old buffer at its old size until CommitUserResize() reflows them in the background.
+    // If the main buffer fills up and rotates before that, they're dropped (see NotifyBufferRotation()).
+    struct ResizeHistory
+    {
+        // Reading from a TextBuffer isn't thread-safe either, because it decompresses rows on demand.
+        std::mutex mutex;
+        std::unique_ptr<TextBuffer> buffer;
+        til::CoordType end = 0;
+    };
+    std::shared_ptr<ResizeHistory> _resizeHistory;
+
     // _scrollOffset is the number of lines above the viewport that are currently visible
     // If _scrollOffset is 0, then the visible region of the buffer is the viewport.
     til::CoordType _scrollOffset = 0;
@@ -459,6 +474,11 @@ private:
     til::CoordType _ScrollToPoints(const til::point coordStart, const til::point coordEnd);
 
     void _NotifyScrollEvent();
+    [[nodiscard]] HRESULT _userResize(const til::size viewportSize, const bool preview) noexcept;
+    til::CoordType _resizePreviewBegin() const;
+    static til::CoordType _reflowResizeHistory(ResizeHistory& history, TextBuffer& newTextBuffer);
+    void _commitResizeHistory();
+    void _finishResizeHistory(std::unique_ptr<TextBuffer> newTextBuffer, til::CoordType historyRows);
     bool _inAltBuffer() const noexcept;
     TextBuffer& _activeBuffer() const noexcept;
     void _updateUrlDetection();
@@ -338,6 +338,15 @@ void Terminal::SearchMissingCommand(const std::wstring_view command)
 
 void Terminal::NotifyBufferRotation(const int delta)
 {
+    // The main buffer only rotates once it's full, at which point any history that's still waiting to be
+    // reflowed (along with the rows that were just rotated out) has scrolled out of the scrollback entirely.
+    // Committing it now would only push it right back out again, so it's dropped instead.
+    if (_resizeHistory && !_inAltBuffer())
+    {
+        _resizeHistory.reset();
+        _mainBuffer->UnpinHyperlinks();
+    }
+
     // Update our selection, so it doesn't move as the buffer is cycled
     if (_selection->active)
     {
@@ -888,25 +888,22 @@ Terminal::TextCopyData Terminal::RetrieveSelectedTextFromBuffer(const bool singl
     const auto& textBuffer = _activeBuffer();
 
     const auto req = TextBuffer::CopyRequest::FromConfig(textBuffer, _selection->start, _selection->end, singleLine, _selection->blockSelection, _trimBlockSelection);
-    data.plainText = textBuffer.GetPlainText(req);
 
-    if (html || rtf)
+    if (!html && !rtf)
     {
-        const auto bgColor = _renderSettings.GetAttributeColors({}).second;
-        const auto isIntenseBold = _renderSettings.GetRenderMode(::Microsoft::Console::Render::RenderSettings::Mode::IntenseIsBold);
-        const auto fontSizePt = _fontInfo.GetUnscaledSize().height; // already in points
-        const auto& fontName = _fontInfo.GetFaceName();
-
-        if (html)
-        {
-            data.html = textBuffer.GenHTML(req, fontSizePt, fontName, bgColor, isIntenseBold, GetAttributeColors);
-        }
-        if (rtf)
-        {
-            data.rtf = textBuffer.GenRTF(req, fontSizePt, fontName, bgColor, isIntenseBold, GetAttributeColors);
-        }
+        data.plainText = textBuffer.GetPlainText(req);
+        return data;
     }
 
+    const auto bgColor = _renderSettings.GetAttributeColors({}).second;
+    const auto isIntenseBold = _renderSettings.GetRenderMode(::Microsoft::Console::Render::RenderSettings::Mode::IntenseIsBold);
+    const auto fontSizePt = _fontInfo.GetUnscaledSize().height; // already in points
+    const auto& fontName = _fontInfo.GetFaceName();
+
+    auto formats = textBuffer.GenCopyFormats(req, html, rtf, fontSizePt, fontName, bgColor, isIntenseBold, GetAttributeColors);
+    data.plainText = std::move(formats.plainText);
+    data.html = std::move(formats.html);
+    data.rtf = std::move(formats.rtf);
     return data;
 }
 
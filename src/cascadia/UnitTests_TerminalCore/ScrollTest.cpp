@@ -3,6 +3,8 @@
 
 #include "pch.h"
 
+#include <future>
+
 #include "../cascadia/TerminalCore/Terminal.hpp"
 #include "../renderer/inc/DummyRenderer.hpp"
 #include "../renderer/inc/RenderEngineBase.hpp"
@@ -26,28 +28,82 @@ namespace
             return _triggerScrollDelta;
         }
 
+        size_t TriggerScrollCount() const noexcept
+        {
+            return _triggerScrollCount;
+        }
+
         void Reset()
         {
             _triggerScrollDelta.reset();
+            _triggerScrollCount = 0;
+            _invalidatedWhilePainting = false;
+            _invalidatedRegions.clear();
         }
 
-        HRESULT StartPaint() noexcept { return S_OK; }
-        HRESULT EndPaint() noexcept { return S_OK; }
+        // The callback is invoked from the first PaintBufferLine() call of the next frame.
+        void OnPaintBufferLine(std::function<void()> callback)
+        {
+            _paintBufferLineCallback = std::move(callback);
+        }
+
+        bool InvalidatedWhilePainting() const noexcept
+        {
+            return _invalidatedWhilePainting;
+        }
+
+        // The regions that were invalidated outside of StartPaint() and EndPaint().
+        const std::vector<til::rect>& InvalidatedRegions() const noexcept
+        {
+            return _invalidatedRegions;
+        }
+
+        HRESULT StartPaint() noexcept
+        {
+            _painting = true;
+            return S_OK;
+        }
+        HRESULT EndPaint() noexcept
+        {
+            _painting = false;
+            return S_OK;
+        }
         HRESULT Present() noexcept { return S_OK; }
         HRESULT ScrollFrame() noexcept { return S_OK; }
-        HRESULT Invalidate(const til::rect* /*psrRegion*/) noexcept { return S_OK; }
+        HRESULT Invalidate(const til::rect* psrRegion) noexcept
+        try
+        {
+            if (_painting)
+            {
+                _invalidatedWhilePainting = true;
+            }
+            else
+            {
+                _invalidatedRegions.emplace_back(*psrRegion);
+            }
+            return S_OK;
+        }
+        CATCH_RETURN()
         HRESULT InvalidateCursor(const til::rect* /*psrRegion*/) noexcept { return S_OK; }
         HRESULT InvalidateSystem(const til::rect* /*prcDirtyClient*/) noexcept { return S_OK; }
         HRESULT InvalidateSelection(const std::vector<til::rect>& /*rectangles*/) noexcept { return S_OK; }
         HRESULT InvalidateScroll(const til::point* pcoordDelta) noexcept
         {
             _triggerScrollDelta = *pcoordDelta;
+            _triggerScrollCount++;
             return S_OK;
         }
         HRESULT InvalidateAll() noexcept { return S_OK; }
         HRESULT InvalidateCircling(_Out_ bool* /*pForcePaint*/) noexcept { return S_OK; }
         HRESULT PaintBackground() noexcept { return S_OK; }
-        HRESULT PaintBufferLine(std::span<const Cluster> /*clusters*/, til::point /*coord*/, bool /*fTrimLeft*/, bool /*lineWrapped*/) noexcept { return S_OK; }
+        HRESULT PaintBufferLine(std::span<const Cluster> /*clusters*/, til::point /*coord*/, bool /*fTrimLeft*/, bool /*lineWrapped*/) noexcept
+        {
+            if (const auto callback = std::exchange(_paintBufferLineCallback, nullptr))
+            {
+                callback();
+            }
+            return S_OK;
+        }
         HRESULT PaintBufferGridLines(GridLineSet /*lines*/, COLORREF /*gridlineColor*/, COLORREF /*underlineColor*/, size_t /*cchLine*/, til::point /*coordTarget*/) noexcept { return S_OK; }
         HRESULT PaintSelection(const til::rect& /*rect*/) noexcept { return S_OK; }
         HRESULT PaintCursor(const CursorOptions& /*options*/) noexcept { return S_OK; }
@@ -56,7 +112,11 @@ namespace
         HRESULT UpdateDpi(int /*iDpi*/) noexcept { return S_OK; }
         HRESULT UpdateViewport(const til::inclusive_rect& /*srNewViewport*/) noexcept { return S_OK; }
         HRESULT GetProposedFont(const FontInfoDesired& /*FontInfoDesired*/, _Out_ FontInfo& /*FontInfo*/, int /*iDpi*/) noexcept { return S_OK; }
-        HRESULT GetDirtyArea(std::span<const til::rect>& /*area*/) noexcept { return S_OK; }
+        HRESULT GetDirtyArea(std::span<const til::rect>& area) noexcept
+        {
+            area = { &_dirtyArea, 1 };
+            return S_OK;
+        }
         HRESULT GetFontSize(_Out_ til::size* /*pFontSize*/) noexcept { return S_OK; }
         HRESULT IsGlyphWideByFont(std::wstring_view /*glyph*/, _Out_ bool* /*pResult*/) noexcept { return S_OK; }
 
@@ -65,6 +125,12 @@ namespace
 
     private:
         std::optional<til::point> _triggerScrollDelta;
+        size_t _triggerScrollCount = 0;
+        std::function<void()> _paintBufferLineCallback;
+        til::rect _dirtyArea{ 0, 0, 80, 32 };
+        bool _painting = false;
+        std::vector<til::rect> _invalidatedRegions;
+        bool _invalidatedWhilePainting = false;
     };
 
     struct ScrollBarNotification
@@ -95,6 +161,9 @@ class TerminalCoreUnitTests::ScrollTest final
     TEST_CLASS(ScrollTest);
 
     TEST_METHOD(TestNotifyScrolling);
+    TEST_METHOD(TestPaintWithoutConsoleLock);
+    TEST_METHOD(TestInvalidateMutatedRows);
+    TEST_METHOD(TestBatchedBufferRotation);
 
     TEST_METHOD_SETUP(MethodSetup)
     {
@@ -166,6 +235,10 @@ void ScrollTest::TestNotifyScrolling()
     // of output to the console is actually quite unnecessary
     WEX::TestExecution::SetVerifyOutput settings(WEX::TestExecution::VerifyOutputSettings::LogOnlyFailures);
 
+    // The renderer forwards scrolls to the engine when it paints a frame.
+    // Paint one now, so that the initial viewport isn't mistaken for a scroll.
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+
     // Emit a bunch of newlines to test scrolling.
     for (; currentRow < totalBufferSize * 2; currentRow++)
     {
@@ -173,6 +246,7 @@ void ScrollTest::TestNotifyScrolling()
         _renderEngine->Reset();
 
         termSm.ProcessString(L"X\r\n");
+        VERIFY_SUCCEEDED(_renderer->PaintFrame());
 
         // When we're on TerminalViewHeight-1, we'll emit the newline that
         // causes the first scroll event
@@ -196,9 +270,10 @@ void ScrollTest::TestNotifyScrolling()
                             fmt::format(L"Expected to not see a 'scroll bar position changed' notification for row {}", currentRow).c_str());
         }
 
-        // If we scrolled but it circled the buffer, then the terminal will
-        // call `TriggerScroll` with a delta to tell the renderer about it.
-        if (scrolled && circledBuffer)
+        // If we scrolled, the renderer tells the engine about it. Either because the
+        // viewport moved down, or because the buffer circled, in which case the
+        // terminal calls `TriggerScroll` with a delta to tell the renderer about it.
+        if (scrolled)
         {
             VERIFY_IS_TRUE(_renderEngine->TriggerScrollDelta().has_value(),
                            fmt::format(L"Expected a 'trigger scroll' notification in Render Engine for row {}", currentRow).c_str());
@@ -235,3 +310,101 @@ void ScrollTest::TestNotifyScrolling()
         }
     }
 }
+
+void ScrollTest::TestPaintWithoutConsoleLock()
+{
+    // The renderer paints the text without holding the console lock.
+    // Output that arrives in the meantime must not block on the renderer
+    // and must be invalidated at the start of the next frame.
+    _term->Write(L"hello");
+    _renderEngine->Reset();
+
+    auto writerFinished = false;
+    _renderEngine->OnPaintBufferLine([&]() {
+        auto writer = std::async(std::launch::async, [&]() {
+            const auto lock = _term->LockForWriting();
+            _term->Write(L" world");
+        });
+        writerFinished = writer.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    });
+
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+
+    VERIFY_IS_TRUE(writerFinished);
+    VERIFY_IS_FALSE(_renderEngine->InvalidatedWhilePainting());
+
+    _renderEngine->Reset();
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+
+    const std::vector<til::rect> expected{ { 0, 0, TerminalViewWidth, 1 } };
+    VERIFY_IS_TRUE(expected == _renderEngine->InvalidatedRegions());
+}
+
+void ScrollTest::TestInvalidateMutatedRows()
+{
+    // The text buffer doesn't invalidate the regions it modifies. Instead, the
+    // renderer invalidates the rows that were modified since the last frame.
+    _term->Write(L"hello");
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+
+    Log::Comment(L"Nothing changed, so nothing should be invalidated.");
+    _renderEngine->Reset();
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+    VERIFY_IS_TRUE(_renderEngine->InvalidatedRegions().empty());
+
+    Log::Comment(L"Many writes to the same rows result in a single invalidation.");
+    _renderEngine->Reset();
+    for (auto i = 0; i < 100; ++i)
+    {
+        _term->Write(L"\x1b[5;1Hworld\x1b[6;1Hworld");
+    }
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+    {
+        const std::vector<til::rect> expected{ { 0, 4, TerminalViewWidth, 6 } };
+        VERIFY_IS_TRUE(expected == _renderEngine->InvalidatedRegions());
+    }
+
+    Log::Comment(L"Rows that merely scrolled aren't invalidated.");
+    _term->Write(fmt::format(L"\x1b[{};1H", TerminalViewHeight));
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+    _renderEngine->Reset();
+    _term->Write(L"\r\nfoo");
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+    VERIFY_IS_TRUE(_renderEngine->TriggerScrollDelta().has_value());
+    for (const auto& region : _renderEngine->InvalidatedRegions())
+    {
+        VERIFY_IS_GREATER_THAN_OR_EQUAL(region.top, TerminalViewHeight - 2);
+    }
+}
+
+void ScrollTest::TestBatchedBufferRotation()
+{
+    // A burst of line feeds at the bottom of a full buffer rotates it once per line,
+    // but the engine should only be told about the sum of those scrolls, once per frame.
+    auto& termTb = *_term->_mainBuffer;
+    const auto totalBufferSize = termTb.GetSize().Height();
+
+    std::wstring lines;
+    for (auto i = 0; i < totalBufferSize; ++i)
+    {
+        lines.append(L"X\r\n");
+    }
+    _term->Write(lines);
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+
+    _renderEngine->Reset();
+    _term->Write(L"1\r\n2\r\n3\r\n4\r\n5\r\n");
+
+    Log::Comment(L"Nothing reaches the engine before the next frame.");
+    VERIFY_ARE_EQUAL(0u, _renderEngine->TriggerScrollCount());
+
+    VERIFY_SUCCEEDED(_renderer->PaintFrame());
+    VERIFY_ARE_EQUAL(1u, _renderEngine->TriggerScrollCount());
+    VERIFY_ARE_EQUAL((til::point{ 0, -5 }), _renderEngine->TriggerScrollDelta().value());
+
+    Log::Comment(L"Only the rows that scrolled into view are invalidated.");
+    for (const auto& region : _renderEngine->InvalidatedRegions())
+    {
+        VERIFY_IS_GREATER_THAN_OR_EQUAL(region.top, TerminalViewHeight - 6);
+    }
+}
@@ -53,6 +53,12 @@ class TerminalCoreUnitTests::TerminalBufferTests final
 
     TEST_METHOD(TestURLPatternDetection);
 
+    TEST_METHOD(TestResizePreview);
+
+    TEST_METHOD(TestResizePreviewWithRotation);
+
+    TEST_METHOD(TestResizePreviewHyperlinks);
+
     TEST_METHOD_SETUP(MethodSetup)
     {
         // STEP 1: Set up the Terminal
@@ -627,3 +633,153 @@ void TerminalBufferTests::TestURLPatternDetection()
     result = term->GetHyperlinkAtBufferPosition(til::point{ urlEndX + 1, 0 });
     VERIFY_IS_TRUE(result.empty(), L"URL is not detected after the actual URL.");
 }
+
+void TerminalBufferTests::TestResizePreview()
+{
+    // UserResizePreview() leaves out everything more than 1000 rows above the viewport.
+    // This needs a lot more history than the other tests to have anything to leave out.
+    static constexpr til::CoordType historyLength = 3000;
+
+    Terminal expected{ Terminal::TestDummyMarker{} };
+    DummyRenderer expectedRenderer{ &expected };
+    expected.Create({ TerminalViewWidth, TerminalViewHeight }, historyLength, expectedRenderer);
+
+    Terminal actual{ Terminal::TestDummyMarker{} };
+    DummyRenderer actualRenderer{ &actual };
+    actual.Create({ TerminalViewWidth, TerminalViewHeight }, historyLength, actualRenderer);
+
+    // Lines of varying length, so that some of them wrap differently at each width.
+    // At 50 columns, they don't fit into the buffer anymore, which tests that the
+    // oldest rows of the history get discarded when the main buffer is appended to it.
+    std::wstring text;
+    for (auto i = 0; i < 2400; ++i)
+    {
+        text.append(fmt::format(FMT_COMPILE(L"{}:{}\r\n"), i, std::wstring(i % 97, L'x')));
+    }
+    expected._stateMachine->ProcessString(text);
+    actual._stateMachine->ProcessString(text);
+
+    VERIFY_SUCCEEDED(expected.UserResize({ 50, TerminalViewHeight }));
+
+    VERIFY_SUCCEEDED(actual.UserResizePreview({ 60, TerminalViewHeight }));
+    VERIFY_IS_TRUE(actual._resizeHistory != nullptr);
+    VERIFY_SUCCEEDED(actual.UserResizePreview({ 50, TerminalViewHeight }));
+
+    // Output that arrives while the history is pending must not get lost.
+    expected._stateMachine->ProcessString(L"after resize\r\n");
+    actual._stateMachine->ProcessString(L"after resize\r\n");
+
+    VERIFY_IS_TRUE(actual.CommitUserResize());
+    VERIFY_IS_TRUE(actual._resizeHistory == nullptr);
+    VERIFY_IS_FALSE(actual.CommitUserResize());
+
+    VERIFY_ARE_EQUAL(expected.GetViewport().Top(), actual.GetViewport().Top());
+    VERIFY_ARE_EQUAL(expected.GetViewport().Width(), actual.GetViewport().Width());
+    VERIFY_ARE_EQUAL(expected.GetScrollOffset(), actual.GetScrollOffset());
+
+    const auto& expectedBuffer = *expected._mainBuffer;
+    const auto& actualBuffer = *actual._mainBuffer;
+    VERIFY_ARE_EQUAL(expectedBuffer.GetCursor().GetPosition(), actualBuffer.GetCursor().GetPosition());
+
+    const auto height = expectedBuffer.GetSize().Height();
+    VERIFY_ARE_EQUAL(height, actualBuffer.GetSize().Height());
+    for (til::CoordType y = 0; y < height; ++y)
+    {
+        const auto& expectedRow = expectedBuffer.GetRowByOffset(y);
+        const auto& actualRow = actualBuffer.GetRowByOffset(y);
+        VERIFY_ARE_EQUAL(expectedRow.GetText(), actualRow.GetText());
+        VERIFY_ARE_EQUAL(expectedRow.WasWrapForced(), actualRow.WasWrapForced());
+    }
+}
+
+void TerminalBufferTests::TestResizePreviewWithRotation()
+{
+    static constexpr til::CoordType historyLength = 3000;
+
+    Terminal expected{ Terminal::TestDummyMarker{} };
+    DummyRenderer expectedRenderer{ &expected };
+    expected.Create({ TerminalViewWidth, TerminalViewHeight }, historyLength, expectedRenderer);
+
+    Terminal actual{ Terminal::TestDummyMarker{} };
+    DummyRenderer actualRenderer{ &actual };
+    actual.Create({ TerminalViewWidth, TerminalViewHeight }, historyLength, actualRenderer);
+
+    const auto write = [&](const int beg, const int end) {
+        std::wstring text;
+        for (auto i = beg; i < end; ++i)
+        {
+            text.append(fmt::format(FMT_COMPILE(L"{}:{}\r\n"), i, std::wstring(i % 97, L'x')));
+        }
+        expected._stateMachine->ProcessString(text);
+        actual._stateMachine->ProcessString(text);
+    };
+
+    write(0, 2400);
+
+    VERIFY_SUCCEEDED(expected.UserResize({ 50, TerminalViewHeight }));
+    VERIFY_SUCCEEDED(actual.UserResizePreview({ 50, TerminalViewHeight }));
+    VERIFY_IS_TRUE(actual._resizeHistory != nullptr);
+
+    // The preview's main buffer only holds the viewport and 1000 rows of scrollback.
+    // Writing more lines than fit into the rest of it rotates the buffer, which
+    // pushes both the oldest rows of the main buffer and the entire history out.
+    write(2400, 2400 + historyLength);
+    VERIFY_IS_TRUE(actual._resizeHistory == nullptr);
+    VERIFY_IS_FALSE(actual.CommitUserResize());
+
+    VERIFY_ARE_EQUAL(expected.GetViewport().Top(), actual.GetViewport().Top());
+    VERIFY_ARE_EQUAL(expected.GetScrollOffset(), actual.GetScrollOffset());
+
+    const auto& expectedBuffer = *expected._mainBuffer;
+    const auto& actualBuffer = *actual._mainBuffer;
+    VERIFY_ARE_EQUAL(expectedBuffer.GetCursor().GetPosition(), actualBuffer.GetCursor().GetPosition());
+
+    const auto height = expectedBuffer.GetSize().Height();
+    VERIFY_ARE_EQUAL(height, actualBuffer.GetSize().Height());
+    for (til::CoordType y = 0; y < height; ++y)
+    {
+        const auto& expectedRow = expectedBuffer.GetRowByOffset(y);
+        const auto& actualRow = actualBuffer.GetRowByOffset(y);
+        VERIFY_ARE_EQUAL(expectedRow.GetText(), actualRow.GetText());
+        VERIFY_ARE_EQUAL(expectedRow.WasWrapForced(), actualRow.WasWrapForced());
+    }
+}
+
+void TerminalBufferTests::TestResizePreviewHyperlinks()
+{
+    Terminal term{ Terminal::TestDummyMarker{} };
+    DummyRenderer renderer{ &term };
+    term.Create({ TerminalViewWidth, TerminalViewHeight }, 3000, renderer);
+    auto& stateMachine = *term._stateMachine;
+
+    // A hyperlink that ends up in the history, followed by enough lines that the preview leaves it out.
+    stateMachine.ProcessString(L"\x1b]8;;https://example.com/history\x1b\\history\x1b]8;;\x1b\\\r\n");
+    std::wstring text;
+    for (auto i = 0; i < 1500; ++i)
+    {
+        text.append(fmt::format(FMT_COMPILE(L"{}\r\n"), i));
+    }
+    stateMachine.ProcessString(text);
+
+    VERIFY_SUCCEEDED(term.UserResizePreview({ 60, TerminalViewHeight }));
+    VERIFY_IS_TRUE(term._resizeHistory != nullptr);
+
+    // Enough new hyperlinks to make the main buffer prune its table. None of its rows
+    // refer to the history's hyperlink, but its ID must not be reused regardless.
+    text.clear();
+    for (auto i = 0; i < 300; ++i)
+    {
+        text.append(fmt::format(FMT_COMPILE(L"\x1b]8;;https://example.com/{}\x1b\\{}\x1b]8;;\x1b\\\r\n"), i, i));
+    }
+    stateMachine.ProcessString(text);
+
+    VERIFY_IS_TRUE(term.CommitUserResize());
+
+    const auto& buffer = *term._mainBuffer;
+    const auto& firstRow = buffer.GetRowByOffset(0);
+    VERIFY_IS_TRUE(firstRow.GetText().starts_with(L"history"));
+    VERIFY_ARE_EQUAL(L"https://example.com/history", buffer.GetHyperlinkUriFromId(firstRow.GetAttrByColumn(0).GetHyperlinkId()));
+
+    const auto& lastRow = buffer.GetRowByOffset(buffer.GetCursor().GetPosition().y - 1);
+    VERIFY_ARE_EQUAL(L"https://example.com/299", buffer.GetHyperlinkUriFromId(lastRow.GetAttrByColumn(0).GetHyperlinkId()));
+}
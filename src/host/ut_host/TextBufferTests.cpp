@@ -110,6 +110,7 @@ class TextBufferTests
     TEST_METHOD(TestComplexUnintense);
 
     TEST_METHOD(CopyAttrs);
+    TEST_METHOD(ReplaceAttributesOnUniformRow);
 
     TEST_METHOD(EmptySgrTest);
 
@@ -137,6 +138,7 @@ class TextBufferTests
 
     TEST_METHOD(TestOverwriteChars);
     TEST_METHOD(TestReplace);
+    TEST_METHOD(TestReplaceAsciiPrefix);
     TEST_METHOD(TestInsert);
 
     TEST_METHOD(TestAppendRTFText);
@@ -148,11 +150,20 @@ class TextBufferTests
 
     TEST_METHOD(GetTextRects);
     TEST_METHOD(GetPlainText);
+    TEST_METHOD(GenCopyFormats);
 
     TEST_METHOD(HyperlinkTrim);
     TEST_METHOD(NoHyperlinkTrim);
+    TEST_METHOD(HyperlinkIdReuse);
 
     TEST_METHOD(ReflowPromptRegions);
+
+    TEST_METHOD(FreezeColdRows);
+    TEST_METHOD(MarkIndex);
+
+    TEST_METHOD(ReflowParallel);
+
+    TEST_METHOD(SerializeSnapshot);
 };
 
 void TextBufferTests::TestBufferCreate()
@@ -1900,6 +1911,41 @@ void TextBufferTests::TestReplace()
 #undef complex
 }
 
+void TextBufferTests::TestReplaceAsciiPrefix()
+{
+    static constexpr til::size bufferSize{ 40, 1 };
+    static constexpr UINT cursorSize = 12;
+    const TextAttribute attr{ 0x7f };
+    TextBuffer buffer{ bufferSize, attr, cursorSize, false, &_renderer };
+
+    // ROW::ReplaceText() processes ASCII 8 characters at a time before falling back to grapheme segmentation.
+    // A combining mark at every possible offset (relative to those chunks) must still join with the preceding
+    // ASCII character and a wide glyph must still occupy 2 columns.
+    for (size_t pos = 1; pos < 24; ++pos)
+    {
+        for (const auto insert : { std::wstring_view{ L"\u0301" }, std::wstring_view{ L"\U0001F41B" } })
+        {
+            std::wstring text(24, L'a');
+            text.insert(pos, insert);
+
+            const auto columns = insert.size() == 1 ? 24 : 26;
+            auto expectedRow = text;
+            expectedRow.append(bufferSize.width - columns, L' ');
+
+            buffer.GetMutableRowByOffset(0).Reset(attr);
+            RowWriteState state{
+                .text = text,
+                .columnLimit = bufferSize.width,
+            };
+            buffer.Replace(0, attr, state);
+
+            VERIFY_IS_TRUE(state.text.empty());
+            VERIFY_ARE_EQUAL(columns, state.columnEnd);
+            VERIFY_ARE_EQUAL(std::wstring_view{ expectedRow }, buffer.GetRowByOffset(0).GetText());
+        }
+    }
+}
+
 void TextBufferTests::TestInsert()
 {
     static constexpr til::size bufferSize{ 10, 3 };
@@ -1981,6 +2027,46 @@ void TextBufferTests::TestInsert()
     VERIFY_ARE_EQUAL(expectedAttr, actualAttr);
 }
 
+void TextBufferTests::ReplaceAttributesOnUniformRow()
+{
+    const til::size bufferSize{ 10, 4 };
+    const UINT cursorSize = 12;
+    const TextAttribute attr1{ 0x7f };
+    const TextAttribute attr2{ 0x1e };
+    auto _buffer = std::make_unique<TextBuffer>(bufferSize, attr1, cursorSize, false, &_renderer);
+
+    const auto verifyRuns = [&](const ROW& row, const std::vector<std::pair<TextAttribute, til::CoordType>>& expected) {
+        const auto& runs = row.Attributes().runs();
+        VERIFY_ARE_EQUAL(expected.size(), runs.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            VERIFY_ARE_EQUAL(expected[i].first, runs[i].value);
+            VERIFY_ARE_EQUAL(expected[i].second, gsl::narrow_cast<til::CoordType>(runs[i].length));
+        }
+    };
+
+    Log::Comment(L"Writing the same attributes into a uniformly attributed row leaves it unchanged.");
+    auto& row0 = _buffer->GetMutableRowByOffset(0);
+    row0.ReplaceAttributes(2, 5, attr1);
+    verifyRuns(row0, { { attr1, 10 } });
+    row0.SetAttrToEnd(3, attr1);
+    verifyRuns(row0, { { attr1, 10 } });
+
+    Log::Comment(L"Writing different attributes splits the run.");
+    row0.ReplaceAttributes(2, 5, attr2);
+    verifyRuns(row0, { { attr1, 2 }, { attr2, 3 }, { attr1, 5 } });
+
+    auto& row1 = _buffer->GetMutableRowByOffset(1);
+    row1.SetAttrToEnd(6, attr2);
+    verifyRuns(row1, { { attr1, 6 }, { attr2, 4 } });
+
+    Log::Comment(L"Writing the same attributes into a row with several runs still replaces them.");
+    row1.ReplaceAttributes(0, 8, attr1);
+    verifyRuns(row1, { { attr1, 8 }, { attr2, 2 } });
+    row1.SetAttrToEnd(0, attr2);
+    verifyRuns(row1, { { attr2, 10 } });
+}
+
 void TextBufferTests::TestAppendRTFText()
 {
     {
@@ -2694,8 +2780,8 @@ void TextBufferTests::GetPlainText()
     }
 }
 
-// This tests that when we increment the circular buffer, obsolete hyperlink references
-// are removed from the hyperlink map
+// This tests that once hyperlinks have scrolled out of the buffer,
+// pruning removes them from the hyperlink table and frees their IDs
 void TextBufferTests::HyperlinkTrim()
 {
     // Set up a text buffer for us
@@ -2724,24 +2810,28 @@ void TextBufferTests::HyperlinkTrim()
     _buffer->GetMutableRowByOffset(otherPos.y).SetAttrToEnd(otherPos.x, newAttr);
     _buffer->AddHyperlinkToMap(otherUrl, otherId);
 
-    // Increment the circular buffer
+    // Increment the circular buffer and prune the hyperlink table
     _buffer->IncrementCircularBuffer();
+    _buffer->_PruneHyperlinks();
 
     const auto finalCustomId = fmt::format(L"{}%{}", customId, til::hash(url));
     const auto finalOtherCustomId = fmt::format(L"{}%{}", otherCustomId, til::hash(otherUrl));
 
     // The hyperlink reference that was only in the first row should be deleted from the map
-    VERIFY_ARE_EQUAL(_buffer->_hyperlinkMap.find(id), _buffer->_hyperlinkMap.end());
+    VERIFY_ARE_EQUAL(L"", _buffer->GetHyperlinkUriFromId(id));
     // Since there was a custom id, that should be deleted as well
-    VERIFY_ARE_EQUAL(_buffer->_hyperlinkCustomIdMap.find(finalCustomId), _buffer->_hyperlinkCustomIdMap.end());
+    VERIFY_IS_TRUE(_buffer->_hyperlinkCustomIdMap.find(finalCustomId) == _buffer->_hyperlinkCustomIdMap.end());
 
     // The other hyperlink reference should not be deleted
-    VERIFY_ARE_EQUAL(_buffer->_hyperlinkMap[otherId], otherUrl);
+    VERIFY_ARE_EQUAL(otherUrl, _buffer->GetHyperlinkUriFromId(otherId));
     VERIFY_ARE_EQUAL(_buffer->_hyperlinkCustomIdMap[finalOtherCustomId], otherId);
+
+    // The freed ID gets reused by the next hyperlink
+    VERIFY_ARE_EQUAL(id, _buffer->GetHyperlinkId(L"new.url", L""));
 }
 
-// This tests that when we increment the circular buffer, non-obsolete hyperlink references
-// do not get removed from the hyperlink map
+// This tests that hyperlinks which are still present in the buffer
+// do not get removed from the hyperlink table by pruning
 void TextBufferTests::NoHyperlinkTrim()
 {
     // Set up a text buffer for us
@@ -2765,8 +2855,9 @@ void TextBufferTests::NoHyperlinkTrim()
     const til::point otherPos{ 70, 5 };
     _buffer->GetMutableRowByOffset(otherPos.y).SetAttrToEnd(otherPos.x, newAttr);
 
-    // Increment the circular buffer
+    // Increment the circular buffer and prune the hyperlink table
     _buffer->IncrementCircularBuffer();
+    _buffer->_PruneHyperlinks();
 
     const auto finalCustomId = fmt::format(L"{}%{}", customId, til::hash(url));
 
@@ -2775,6 +2866,36 @@ void TextBufferTests::NoHyperlinkTrim()
     VERIFY_ARE_EQUAL(_buffer->_hyperlinkCustomIdMap[finalCustomId], id);
 }
 
+// This tests that a steady stream of hyperlinks neither exhausts
+// the 16-bit ID space nor grows the hyperlink table without bounds
+void TextBufferTests::HyperlinkIdReuse()
+{
+    const til::size bufferSize{ 80, 10 };
+    const UINT cursorSize = 12;
+    auto _buffer = std::make_unique<TextBuffer>(bufferSize, TextAttribute{ 0x7f }, cursorSize, false, &_renderer);
+
+    // More hyperlinks than there are IDs, each of which overwrites the one printed a screen ago.
+    for (auto i = 0; i < 70000; ++i)
+    {
+        const auto url = fmt::format(L"file://host/{}", i);
+        const auto id = _buffer->GetHyperlinkId(url, L"");
+        VERIFY_ARE_NOT_EQUAL(uint16_t{ 0 }, id);
+
+        TextAttribute newAttr{ 0x7f };
+        newAttr.SetHyperlinkId(id);
+        _buffer->GetMutableRowByOffset(i % bufferSize.height).SetAttrToEnd(0, newAttr);
+    }
+
+    VERIFY_IS_LESS_THAN_OR_EQUAL(_buffer->_hyperlinks.size(), TextBuffer::_hyperlinkPruneMinimum + 1);
+
+    // The hyperlinks that are still in the buffer must have survived.
+    for (auto i = 70000 - bufferSize.height; i < 70000; ++i)
+    {
+        const auto id = _buffer->GetRowByOffset(i % bufferSize.height).GetAttrByColumn(0).GetHyperlinkId();
+        VERIFY_ARE_EQUAL(fmt::format(L"file://host/{}", i), _buffer->GetHyperlinkUriFromId(id));
+    }
+}
+
 #define FTCS_A L"\x1b]133;A\x1b\\"
 #define FTCS_B L"\x1b]133;B\x1b\\"
 #define FTCS_C L"\x1b]133;C\x1b\\"
@@ -2900,3 +3021,317 @@ void TextBufferTests::ReflowPromptRegions()
     Log::Comment(L"========== Checking the host buffer state (after) ==========");
     verifyBuffer(*newBuffer, si.GetViewport().ToExclusive(), false, true);
 }
+
+void TextBufferTests::FreezeColdRows()
+{
+    static constexpr til::size bufferSize{ 20, 2000 };
+    static constexpr UINT cursorSize = 12;
+    const TextAttribute attr{ 0x7 };
+    TextBuffer buffer{ bufferSize, attr, cursorSize, false, &_renderer };
+
+    struct Expected
+    {
+        std::wstring text;
+        bool wrap;
+        std::vector<TextAttribute> attrs;
+        uint64_t mutationId;
+    };
+    std::vector<Expected> expected;
+
+    // Some text with wide glyphs, surrogate pairs and colors, as well as some wrapped rows.
+    for (til::CoordType y = 0; y < bufferSize.height; ++y)
+    {
+        auto text = fmt::format(L"{}\u304B\U0001F41B", y);
+        RowWriteState state{
+            .text = text,
+            .columnLimit = bufferSize.width,
+        };
+        buffer.Replace(y, TextAttribute{ gsl::narrow_cast<WORD>(y & 0xff) }, state);
+
+        auto& row = buffer.GetMutableRowByOffset(y);
+        row.SetWrapForced(y % 3 == 0);
+
+        std::vector<TextAttribute> attrs;
+        for (til::CoordType x = 0; x < bufferSize.width; ++x)
+        {
+            attrs.emplace_back(row.GetAttrByColumn(x));
+        }
+        expected.emplace_back(std::wstring{ row.GetText() }, row.WasWrapForced(), std::move(attrs), row.GetMutationId());
+    }
+
+    buffer.GetCursor().SetPosition({ 0, bufferSize.height - 1 });
+    buffer.FreezeColdRows(10);
+    VERIFY_IS_GREATER_THAN(buffer._frozenBlockCount, size_t{ 0 });
+
+    // Accessing the rows must transparently thaw them.
+    for (til::CoordType y = 0; y < bufferSize.height; ++y)
+    {
+        const auto& row = buffer.GetRowByOffset(y);
+        const auto& exp = expected[y];
+        VERIFY_ARE_EQUAL(std::wstring_view{ exp.text }, row.GetText());
+        VERIFY_ARE_EQUAL(exp.wrap, row.WasWrapForced());
+        VERIFY_ARE_EQUAL(exp.mutationId, row.GetMutationId());
+        for (til::CoordType x = 0; x < bufferSize.width; ++x)
+        {
+            VERIFY_ARE_EQUAL(exp.attrs[x], row.GetAttrByColumn(x));
+        }
+    }
+    VERIFY_ARE_EQUAL(size_t{ 0 }, buffer._frozenBlockCount);
+}
+
+void TextBufferTests::MarkIndex()
+{
+    static constexpr til::size bufferSize{ 10, 10 };
+    static constexpr UINT cursorSize = 12;
+    TextBuffer buffer{ bufferSize, TextAttribute{ 0x7 }, cursorSize, false, &_renderer };
+
+    const auto markRows = [&]() {
+        std::vector<til::CoordType> rows;
+        for (const auto& mark : buffer.GetMarkRows())
+        {
+            rows.emplace_back(mark.row);
+        }
+        return rows;
+    };
+
+    buffer.SetScrollbarData(ScrollbarData{ .category = MarkCategory::Prompt }, 7);
+    buffer.SetScrollbarData(ScrollbarData{ .category = MarkCategory::Error }, 2);
+    buffer.SetScrollbarData(ScrollbarData{ .category = MarkCategory::Prompt }, 5);
+    VERIFY_IS_TRUE(std::vector<til::CoordType>{ 2, 5, 7 } == markRows());
+    VERIFY_IS_TRUE(buffer.GetMarkRows()[0].data.category == MarkCategory::Error);
+
+    Log::Comment(L"Rotating the circular buffer moves the marks up and drops the ones that scroll out.");
+    for (auto i = 0; i < 4; ++i)
+    {
+        buffer.IncrementCircularBuffer();
+    }
+    VERIFY_IS_TRUE(std::vector<til::CoordType>{ 1, 3 } == markRows());
+
+    Log::Comment(L"Marks wrapping around the end of the circular buffer are still sorted by y.");
+    buffer.SetScrollbarData(ScrollbarData{ .category = MarkCategory::Prompt }, 9);
+    buffer.SetScrollbarData(ScrollbarData{ .category = MarkCategory::Prompt }, 0);
+    VERIFY_IS_TRUE(std::vector<til::CoordType>{ 0, 1, 3, 9 } == markRows());
+
+    Log::Comment(L"ScrollRows() moves marks along with their rows.");
+    buffer.ScrollRows(3, 2, 3);
+    VERIFY_IS_TRUE(std::vector<til::CoordType>{ 0, 1, 3, 6, 9 } == markRows());
+
+    buffer.ClearMarksInRange({ 0, 2 }, { 0, 6 });
+    VERIFY_IS_TRUE(std::vector<til::CoordType>{ 0, 1, 9 } == markRows());
+
+    Log::Comment(L"The most recent prompt at or above the cursor gets the exit code.");
+    buffer.GetCursor().SetPosition({ 0, 5 });
+    buffer.EndCurrentCommand(1);
+    const auto marks = buffer.GetMarkRows();
+    VERIFY_IS_FALSE(marks[0].data.exitCode.has_value());
+    VERIFY_ARE_EQUAL(1u, marks[1].data.exitCode.value_or(0));
+    VERIFY_IS_FALSE(marks[2].data.exitCode.has_value());
+
+    buffer.ClearAllMarks();
+    VERIFY_IS_TRUE(buffer.GetMarkRows().empty());
+    VERIFY_IS_TRUE(buffer._markIndex.empty());
+}
+
+void TextBufferTests::ReflowParallel()
+{
+    BEGIN_TEST_METHOD_PROPERTIES()
+        TEST_METHOD_PROPERTY(L"Data:newWidth", L"{7, 20, 33}")
+        TEST_METHOD_PROPERTY(L"Data:newHeight", L"{1000, 8192, 9000}")
+    END_TEST_METHOD_PROPERTIES()
+
+    int newWidth;
+    int newHeight;
+    VERIFY_SUCCEEDED(TestData::TryGetValue(L"newWidth", newWidth), L"Get newWidth");
+    VERIFY_SUCCEEDED(TestData::TryGetValue(L"newHeight", newHeight), L"Get newHeight");
+
+    static constexpr til::size bufferSize{ 20, 8192 };
+    static constexpr UINT cursorSize = 12;
+    const TextAttribute attr{ 0x7 };
+    TextBuffer buffer{ bufferSize, attr, cursorSize, false, &_renderer };
+
+    // Lines of varying lengths with wide glyphs, colors, marks and double-width rows.
+    for (til::CoordType y = 0; y < bufferSize.height; ++y)
+    {
+        auto text = fmt::format(L"{}\u304B{}", y, std::wstring(y % 17, L'x'));
+        RowWriteState state{
+            .text = text,
+            .columnLimit = bufferSize.width,
+        };
+        buffer.Replace(y, TextAttribute{ gsl::narrow_cast<WORD>(y & 0xff) }, state);
+
+        auto& row = buffer.GetMutableRowByOffset(y);
+        row.SetWrapForced(y % 3 != 0);
+        if (y % 101 == 0)
+        {
+            row.SetLineRendition(LineRendition::DoubleWidth);
+        }
+        if (y % 7 == 0)
+        {
+            buffer.SetScrollbarData(ScrollbarData{ .category = MarkCategory::Prompt }, y);
+        }
+    }
+    buffer.GetCursor().SetPosition({ 5, bufferSize.height - 2 });
+
+    const til::size newSize{ newWidth, newHeight };
+    TextBuffer serial{ newSize, attr, cursorSize, false, &_renderer };
+    TextBuffer parallel{ newSize, attr, cursorSize, false, &_renderer };
+    TextBuffer::PositionInformation serialPositions{ 1000, 5000 };
+    TextBuffer::PositionInformation parallelPositions{ 1000, 5000 };
+    TextBuffer::_reflow(buffer, serial, nullptr, &serialPositions, false);
+    TextBuffer::_reflow(buffer, parallel, nullptr, &parallelPositions, true);
+
+    VERIFY_ARE_EQUAL(serial.GetCursor().GetPosition(), parallel.GetCursor().GetPosition());
+    VERIFY_ARE_EQUAL(serialPositions.mutableViewportTop, parallelPositions.mutableViewportTop);
+    VERIFY_ARE_EQUAL(serialPositions.visibleViewportTop, parallelPositions.visibleViewportTop);
+
+    for (til::CoordType y = 0; y < newHeight; ++y)
+    {
+        const auto& expected = serial.GetRowByOffset(y);
+        const auto& actual = parallel.GetRowByOffset(y);
+        VERIFY_ARE_EQUAL(expected.GetText(), actual.GetText());
+        VERIFY_ARE_EQUAL(expected.WasWrapForced(), actual.WasWrapForced());
+        VERIFY_IS_TRUE(expected.GetLineRendition() == actual.GetLineRendition());
+        VERIFY_IS_TRUE(expected.Attributes() == actual.Attributes());
+        VERIFY_ARE_EQUAL(expected.GetScrollbarData().has_value(), actual.GetScrollbarData().has_value());
+    }
+}
+
+void TextBufferTests::SerializeSnapshot()
+{
+    static constexpr til::size bufferSize{ 20, 2000 };
+    static constexpr UINT cursorSize = 12;
+    TextBuffer buffer{ bufferSize, TextAttribute{ 0x7 }, cursorSize, false, &_renderer };
+
+    static constexpr std::wstring_view uri{ L"https://example.com" };
+    buffer.AddHyperlinkToMap(uri, 5);
+
+    // Enough rows with text, colors and wide glyphs to span multiple chunks.
+    for (til::CoordType y = 0; y < bufferSize.height - 100; ++y)
+    {
+        auto text = fmt::format(L"{}\u304B\U0001F41B", y);
+        RowWriteState state{
+            .text = text,
+            .columnLimit = bufferSize.width,
+        };
+        TextAttribute attr{ gsl::narrow_cast<WORD>(y & 0xff) };
+        if (y % 7 == 0)
+        {
+            attr.SetHyperlinkId(5);
+        }
+        buffer.Replace(y, attr, state);
+
+        auto& row = buffer.GetMutableRowByOffset(y);
+        row.SetWrapForced(y % 3 == 0);
+        if (y % 11 == 0)
+        {
+            row.SetLineRendition(LineRendition::DoubleWidth);
+        }
+        if (y % 13 == 0)
+        {
+            buffer.SetScrollbarData(ScrollbarData{ .category = MarkCategory::Prompt, .exitCode = 1 }, y);
+        }
+    }
+
+    const auto path = std::filesystem::temp_directory_path() / L"TextBufferTests_SerializeSnapshot.bin";
+    const auto cleanup = wil::scope_exit([&]() {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    });
+
+    buffer.SerializeSnapshot(path.c_str());
+
+    const wil::unique_handle file{ CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+    VERIFY_IS_TRUE(static_cast<bool>(file));
+    const auto restored = TextBuffer::DeserializeSnapshot(file.get());
+    VERIFY_IS_NOT_NULL(restored.get());
+
+    // The snapshot ends at the last row with text and the cursor is placed on the row after that.
+    const auto rows = bufferSize.height - 100;
+    VERIFY_ARE_EQUAL(bufferSize.width, restored->GetSize().Width());
+    VERIFY_ARE_EQUAL(rows + 1, restored->GetSize().Height());
+    VERIFY_ARE_EQUAL(til::point(0, rows), restored->GetCursor().GetPosition());
+    VERIFY_ARE_EQUAL(std::wstring{ uri }, restored->GetHyperlinkUriFromId(5));
+
+    for (til::CoordType y = 0; y < rows; ++y)
+    {
+        const auto& expected = buffer.GetRowByOffset(y);
+        const auto& actual = restored->GetRowByOffset(y);
+        VERIFY_ARE_EQUAL(expected.GetText(), actual.GetText());
+        VERIFY_ARE_EQUAL(expected.WasWrapForced(), actual.WasWrapForced());
+        VERIFY_IS_TRUE(expected.GetLineRendition() == actual.GetLineRendition());
+        VERIFY_ARE_EQUAL(expected.GetScrollbarData().has_value(), actual.GetScrollbarData().has_value());
+        for (til::CoordType x = 0; x < bufferSize.width; ++x)
+        {
+            VERIFY_ARE_EQUAL(expected.GetAttrByColumn(x), actual.GetAttrByColumn(x));
+        }
+    }
+    VERIFY_ARE_EQUAL(buffer.GetMarkRows().size(), restored->GetMarkRows().size());
+
+    Log::Comment(L"Files persisted as VT text by older versions aren't snapshots.");
+    {
+        const wil::unique_handle textFile{ CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+        VERIFY_IS_TRUE(static_cast<bool>(textFile));
+        static constexpr std::wstring_view text{ L"\uFEFF\x1b[0mtext\r\n" };
+        DWORD written = 0;
+        VERIFY_WIN32_BOOL_SUCCEEDED(WriteFile(textFile.get(), text.data(), gsl::narrow_cast<DWORD>(text.size() * sizeof(wchar_t)), &written, nullptr));
+    }
+    const wil::unique_handle textFile{ CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+    VERIFY_IS_TRUE(static_cast<bool>(textFile));
+    VERIFY_IS_NULL(TextBuffer::DeserializeSnapshot(textFile.get()).get());
+}
+
+void TextBufferTests::GenCopyFormats()
+{
+    til::size bufferSize{ 10, 20 };
+    UINT cursorSize = 12;
+    TextAttribute attr{ 0x7f };
+    auto _buffer = std::make_unique<TextBuffer>(bufferSize, attr, cursorSize, false, &_renderer);
+
+    const std::vector<std::wstring> bufferText = { L"12345",
+                                                   L"<a&b>",
+                                                   L"123  " };
+    WriteLinesToBuffer(bufferText, *_buffer);
+    _buffer->GetMutableRowByOffset(1).ReplaceAttributes(0, 3, TextAttribute{ 0x1e });
+
+    size_t colorCalls = 0;
+    const auto getAttributeColors = [&](const TextAttribute& attr) {
+        ++colorCalls;
+        return std::tuple{ attr.GetForeground().GetRGB(), attr.GetBackground().GetRGB(), attr.GetForeground().GetRGB() };
+    };
+
+    const auto req = TextBuffer::CopyRequest{ *_buffer, { 0, 0 }, { 4, 2 }, false, true, true, false };
+    const auto formats = _buffer->GenCopyFormats(req, true, true, 12, L"Consolas", RGB(0, 0, 0), false, getAttributeColors);
+
+    Log::Comment(L"The plain text is identical to the one from GetPlainText().");
+    VERIFY_ARE_EQUAL(_buffer->GetPlainText(req), formats.plainText);
+
+    Log::Comment(L"The colors of each distinct attribute are only retrieved once.");
+    VERIFY_ARE_EQUAL(2u, colorCalls);
+
+    Log::Comment(L"The CF_HTML header points at the fragment.");
+    const auto& html = formats.html;
+    VERIFY_IS_TRUE(html.starts_with("Version:0.9\r\nStartHTML:0000000157\r\n"));
+    const auto fragStart = std::stoul(html.substr(html.find("StartFragment:") + 14, 10));
+    const auto fragEnd = std::stoul(html.substr(html.find("EndFragment:") + 12, 10));
+    const auto htmlEnd = std::stoul(html.substr(html.find("EndHTML:") + 8, 10));
+    VERIFY_ARE_EQUAL(html.size(), htmlEnd);
+    VERIFY_IS_TRUE(html.compare(fragStart, 21, "<!--StartFragment -->") == 0);
+    VERIFY_IS_TRUE(html.compare(fragEnd, 14, "</BODY></HTML>") == 0);
+    VERIFY_ARE_NOT_EQUAL(std::string::npos, html.find("&lt;a&amp;</SPAN>"));
+
+    Log::Comment(L"The RTF color table precedes the content and the document is closed.");
+    const auto& rtf = formats.rtf;
+    const auto colorTable = rtf.find("{\\colortbl ;");
+    VERIFY_ARE_NOT_EQUAL(std::string::npos, colorTable);
+    VERIFY_IS_LESS_THAN(colorTable, rtf.find("\\viewkind4"));
+    VERIFY_IS_TRUE(rtf.ends_with("}"));
+
+    Log::Comment(L"If formatting fails, the plain text is still generated.");
+    const auto failingAttributeColors = [](const TextAttribute&) -> std::tuple<COLORREF, COLORREF, COLORREF> {
+        THROW_HR(E_FAIL);
+    };
+    const auto plainOnly = _buffer->GenCopyFormats(req, true, true, 12, L"Consolas", RGB(0, 0, 0), false, failingAttributeColors);
+    VERIFY_ARE_EQUAL(_buffer->GetPlainText(req), plainOnly.plainText);
+    VERIFY_IS_TRUE(plainOnly.html.empty());
+    VERIFY_IS_TRUE(plainOnly.rtf.empty());
+}
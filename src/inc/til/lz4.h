@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#pragma warning(push)
+// This is a byte oriented codec. Pointer arithmetic is all it does.
+#pragma warning(disable : 26481) // Don't use pointer arithmetic. Use span instead (bounds.1).
+#pragma warning(disable : 26446) // Prefer to use gsl::at() instead of unchecked subscript operator (bounds.4).
+
+// An implementation of the LZ4 block format: https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+// It favors simplicity over the last bit of speed and compression ratio, but the output is compatible with
+// the reference implementation. The block format doesn't store the uncompressed size, so callers need to.
+namespace til::lz4
+{
+    namespace details
+    {
+        inline constexpr size_t minMatch = 4;
+        // The last match must start at least 12 bytes before the end of the block...
+        inline constexpr size_t matchStartLimit = 12;
+        // ...and the last 5 bytes are always literals.
+        inline constexpr size_t lastLiterals = 5;
+        inline constexpr size_t maxOffset = 65535;
+        inline constexpr size_t hashLog = 12;
+
+        inline uint32_t read32(const uint8_t* p) noexcept
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline size_t hash(const uint32_t v) noexcept
+        {
+            return (v * 2654435761u) >> (32 - hashLog);
+        }
+
+        inline void putLength(std::vector<uint8_t>& output, size_t length)
+        {
+            for (; length >= 255; length -= 255)
+            {
+                output.push_back(255);
+            }
+            output.push_back(static_cast<uint8_t>(length));
+        }
+
+        // Reads the continuation bytes of a literal or match length. Returns false if the input ended prematurely.
+        inline bool getLength(const uint8_t*& it, const uint8_t* end, size_t& length) noexcept
+        {
+            for (;;)
+            {
+                if (it == end)
+                {
+                    return false;
+                }
+                const auto b = *it++;
+                length += b;
+                if (b != 255)
+                {
+                    return true;
+                }
+            }
+        }
+
+        inline void putSequence(std::vector<uint8_t>& output, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength)
+        {
+            const auto ml = matchLength - minMatch;
+            const auto token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(ml, 15));
+
+            output.push_back(token);
+            if (literalLength >= 15)
+            {
+                putLength(output, literalLength - 15);
+            }
+            output.insert(output.end(), literals, literals + literalLength);
+
+            if (matchLength)
+            {
+                output.push_back(static_cast<uint8_t>(offset));
+                output.push_back(static_cast<uint8_t>(offset >> 8));
+                if (ml >= 15)
+                {
+                    putLength(output, ml - 15);
+                }
+            }
+        }
+    }
+
+    // Appends the compressed `input` to `output`.
+    inline void compress(const std::span<const uint8_t> input, std::vector<uint8_t>& output)
+    {
+        using namespace details;
+
+        const auto beg = input.data();
+        const auto size = input.size();
+        auto anchor = beg;
+
+        if (size > matchStartLimit)
+        {
+            // Stores 1 + the offset of the last occurrence of a hash, so that 0 means "none".
+            std::array<uint32_t, size_t{ 1 } << hashLog> table{};
+            const auto matchStartEnd = beg + size - matchStartLimit;
+            const auto matchEnd = beg + size - lastLiterals;
+            auto it = beg;
+            // Incompressible data is skipped over in increasingly large steps, just like the reference implementation does.
+            size_t misses = 0;
+
+            while (it < matchStartEnd)
+            {
+                const auto seq = read32(it);
+                auto& slot = table[hash(seq)];
+                const auto candidate = slot;
+                slot = static_cast<uint32_t>(it - beg + 1);
+
+                const auto ref = beg + (candidate ? candidate - 1 : 0);
+                if (!candidate || static_cast<size_t>(it - ref) > maxOffset || read32(ref) != seq)
+                {
+                    it += 1 + (misses++ >> 6);
+                    continue;
+                }
+
+                auto length = minMatch;
+                while (it + length < matchEnd && ref[length] == it[length])
+                {
+                    ++length;
+                }
+
+                putSequence(output, anchor, it - anchor, it - ref, length);
+                it += length;
+                anchor = it;
+                misses = 0;
+            }
+        }
+
+        putSequence(output, anchor, beg + size - anchor, 0, 0);
+    }
+
+    // Decompresses `input` into `output`, which must be exactly as large as the uncompressed data.
+    // Returns false if the input is malformed or doesn't decompress to exactly output.size() bytes.
+    [[nodiscard]] inline bool decompress(const std::span<const uint8_t> input, const std::span<uint8_t> output) noexcept
+    {
+        using namespace details;
+
+        auto in = input.data();
+        const auto inEnd = in + input.size();
+        const auto outBeg = output.data();
+        const auto outEnd = outBeg + output.size();
+        auto out = outBeg;
+
+        for (;;)
+        {
+            if (in == inEnd)
+            {
+                return false;
+            }
+
+            const auto token = *in++;
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !getLength(in, inEnd, literalLength))
+            {
+                return false;
+            }
+            if (literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out))
+            {
+                return false;
+            }
+            if (literalLength)
+            {
+                memcpy(out, in, literalLength);
+            }
+            in += literalLength;
+            out += literalLength;
+
+            // The last sequence consists of literals only.
+            if (in == inEnd)
+            {
+                return out == outEnd;
+            }
+
+            if (inEnd - in < 2)
+            {
+                return false;
+            }
+            const size_t offset = in[0] | (in[1] << 8);
+            in += 2;
+            if (offset == 0 || offset > static_cast<size_t>(out - outBeg))
+            {
+                return false;
+            }
+
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !getLength(in, inEnd, matchLength))
+            {
+                return false;
+            }
+            matchLength += minMatch;
+            if (matchLength > static_cast<size_t>(outEnd - out))
+            {
+                return false;
+            }
+
+            // The match may overlap with the bytes it produces (offset < matchLength),
+            // which is how LZ4 encodes runs of repeating patterns. memcpy can't do that.
+            const auto ref = out - offset;
+            if (offset >= matchLength)
+            {
+                memcpy(out, ref, matchLength);
+            }
+            else
+            {
+                for (size_t i = 0; i < matchLength; ++i)
+                {
+                    out[i] = ref[i];
+                }
+            }
+            out += matchLength;
+        }
+    }
+}
+
+#pragma warning(pop)
@@ -14,6 +14,10 @@ could overcome disadvantages of syscalls. Test results can be read up
 in PR #4093 and the test algorithms are available in src\tools\U8U16Test.
 Based on the results the decision was made to keep using the platform
 functions MultiByteToWideChar and WideCharToMultiByte.
+The exception is the UTF-8 to UTF-16 direction, which is on the hot path of
+every ConPTY read: Well-formed input is decoded by details::u8u16_decode,
+which widens ASCII runs with SIMD instructions. Ill-formed input is still
+passed to MultiByteToWideChar. Run U8U16Test to compare the two.
 
 Author(s):
 - Steffen Illhardt (german-one), Leonard Hecker (lhecker) 2020-2021
@@ -47,6 +51,141 @@ namespace til // Terminal Implementation Library. Also: "Today I Learned"
         }
     };
 
+    namespace details
+    {
+#pragma warning(push)
+#pragma warning(disable : 26429 26481 26490) // use not_null, pointer arithmetic, reinterpret_cast
+        // Converts the UTF-8 string [beg, end) to UTF-16 and writes it to dst, which must have room for at least end - beg code units.
+        // The input is assumed to consist of complete code points (incomplete trailing ones are treated as invalid).
+        // Returns the end of the written output or nullptr if the conversion failed.
+        //
+        // Well-formed input is decoded inline: ASCII runs are widened 16 bytes at a time and multi-byte sequences
+        // are validated and decoded one by one. Ill-formed sequences are handed to MultiByteToWideChar, so that
+        // the number and placement of U+FFFD replacement characters is identical to what the platform produces.
+        // Since ASCII bytes can never be part of a UTF-8 sequence, such a span ends at the next ASCII byte at the latest.
+        inline wchar_t* u8u16_decode(const char* const beg, const char* const end, wchar_t* dst) noexcept
+        {
+            auto it = reinterpret_cast<const uint8_t*>(beg);
+            const auto last = reinterpret_cast<const uint8_t*>(end);
+
+            while (it != last)
+            {
+#if defined(TIL_SSE_INTRINSICS)
+                // Every input byte produces at most 1 output code unit, which means that
+                // dst has room for at least 16 code units whenever 16 input bytes remain.
+                // We can thus unconditionally store all 16 widened bytes and only advance by the ASCII prefix.
+                while (last - it >= 16)
+                {
+                    const auto vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(vec, _mm_setzero_si128()));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), _mm_unpackhi_epi8(vec, _mm_setzero_si128()));
+
+                    const auto mask = static_cast<unsigned long>(_mm_movemask_epi8(vec));
+                    if (mask)
+                    {
+                        unsigned long offset;
+                        _BitScanForward(&offset, mask);
+                        it += offset;
+                        dst += offset;
+                        break;
+                    }
+
+                    it += 16;
+                    dst += 16;
+                }
+#elif defined(TIL_ARM_NEON_INTRINSICS)
+                while (last - it >= 16)
+                {
+                    const auto vec = vld1q_u8(it);
+                    const auto high = vreinterpretq_u64_u8(vandq_u8(vec, vdupq_n_u8(0x80)));
+                    if (vgetq_lane_u64(high, 0) | vgetq_lane_u64(high, 1))
+                    {
+                        break;
+                    }
+
+                    vst1q_u16(reinterpret_cast<uint16_t*>(dst), vmovl_u8(vget_low_u8(vec)));
+                    vst1q_u16(reinterpret_cast<uint16_t*>(dst + 8), vmovl_u8(vget_high_u8(vec)));
+                    it += 16;
+                    dst += 16;
+                }
+#endif
+
+                for (; it != last && *it < 0x80; ++it, ++dst)
+                {
+                    *dst = *it;
+                }
+
+                // Decode the following run of non-ASCII characters.
+                while (it != last && *it >= 0x80)
+                {
+                    const auto avail = last - it;
+                    const auto b0 = it[0];
+
+                    if (b0 >= 0xC2 && b0 <= 0xDF && avail >= 2)
+                    {
+                        const auto b1 = it[1];
+                        if ((b1 & 0xC0) == 0x80)
+                        {
+                            *dst++ = static_cast<wchar_t>(((b0 & 0x1F) << 6) | (b1 & 0x3F));
+                            it += 2;
+                            continue;
+                        }
+                    }
+                    else if (b0 >= 0xE0 && b0 <= 0xEF && avail >= 3)
+                    {
+                        // E0 must be followed by A0..BF (no overlong encodings) and ED by 80..9F (no surrogates).
+                        const auto b1 = it[1];
+                        const auto b2 = it[2];
+                        const uint8_t lo = b0 == 0xE0 ? 0xA0 : 0x80;
+                        const uint8_t hi = b0 == 0xED ? 0x9F : 0xBF;
+                        if (b1 >= lo && b1 <= hi && (b2 & 0xC0) == 0x80)
+                        {
+                            *dst++ = static_cast<wchar_t>(((b0 & 0x0F) << 12) | ((b1 & 0x3F) << 6) | (b2 & 0x3F));
+                            it += 3;
+                            continue;
+                        }
+                    }
+                    else if (b0 >= 0xF0 && b0 <= 0xF4 && avail >= 4)
+                    {
+                        // F0 must be followed by 90..BF (no overlong encodings) and F4 by 80..8F (nothing past U+10FFFF).
+                        const auto b1 = it[1];
+                        const auto b2 = it[2];
+                        const auto b3 = it[3];
+                        const uint8_t lo = b0 == 0xF0 ? 0x90 : 0x80;
+                        const uint8_t hi = b0 == 0xF4 ? 0x8F : 0xBF;
+                        if (b1 >= lo && b1 <= hi && (b2 & 0xC0) == 0x80 && (b3 & 0xC0) == 0x80)
+                        {
+                            const auto cp = (static_cast<uint32_t>(b0 & 0x07) << 18) | ((b1 & 0x3F) << 12) | ((b2 & 0x3F) << 6) | (b3 & 0x3F);
+                            *dst++ = static_cast<wchar_t>(0xD7C0 + (cp >> 10));
+                            *dst++ = static_cast<wchar_t>(0xDC00 | (cp & 0x3FF));
+                            it += 4;
+                            continue;
+                        }
+                    }
+
+                    auto next = it + 1;
+                    while (next != last && *next >= 0x80)
+                    {
+                        ++next;
+                    }
+
+                    const auto len = gsl::narrow_cast<int>(next - it);
+                    const auto written = MultiByteToWideChar(CP_UTF8, 0UL, reinterpret_cast<const char*>(it), len, dst, len);
+                    if (!written)
+                    {
+                        return nullptr;
+                    }
+
+                    it = next;
+                    dst += written;
+                }
+            }
+
+            return dst;
+        }
+#pragma warning(pop)
+    }
+
     // Routine Description:
     // - Takes a UTF-8 string and performs the conversion to UTF-16. NOTE: The function relies on getting complete UTF-8 characters at the string boundaries.
     // Arguments:
@@ -69,8 +208,9 @@ namespace til // Terminal Implementation Library. Also: "Today I Learned"
             int lengthRequired{};
             // The worst ratio of UTF-8 code units to UTF-16 code units is 1 to 1 if UTF-8 consists of ASCII only.
             RETURN_HR_IF(E_ABORT, !base::MakeCheckedNum(in.length()).AssignIfValid(&lengthRequired));
-            out.resize(in.length()); // avoid to call MultiByteToWideChar twice only to get the required size
-            const int lengthOut = MultiByteToWideChar(CP_UTF8, 0ul, in.data(), lengthRequired, out.data(), lengthRequired);
+            out.resize(in.length());
+            const auto end = details::u8u16_decode(in.data(), in.data() + lengthRequired, out.data());
+            const auto lengthOut = end ? end - out.data() : 0;
             out.resize(gsl::narrow_cast<size_t>(lengthOut));
 
             return lengthOut == 0 ? E_UNEXPECTED : S_OK;
@@ -80,6 +220,90 @@ namespace til // Terminal Implementation Library. Also: "Today I Learned"
 
 #pragma warning(push)
 #pragma warning(disable : 26429 26446 26459 26481 26482) // use not_null, subscript operator, use span, pointer arithmetic, dynamic array indexing
+    // Routine Description:
+    // - Takes a UTF-8 string, complements and/or caches partials, and performs the conversion to UTF-16.
+    // - The result is written into a caller-provided buffer, which allows callers that convert
+    //   a stream of chunks (like the ConPTY output) to reuse a single allocation for all of them.
+    // Arguments:
+    // - in - UTF-8 string to be converted
+    // - buffer - the buffer to convert into, which must have room for at least in.size() + state.have code units
+    // - out - reference to the resulting UTF-16 string, which points into buffer
+    // - state - reference to a til::u8state holding the status of the current partials handling
+    // Return Value:
+    // - S_OK                    - the conversion succeeded
+    // - E_NOT_SUFFICIENT_BUFFER - the buffer is too small to hold the worst case result
+    // - E_ABORT                 - the resulting string length would exceed the upper boundary of an int and thus, the conversion was aborted before the conversion has been completed
+    // - E_UNEXPECTED            - the underlying conversion function failed
+    [[nodiscard]] inline HRESULT u8u16(const std::string_view& in, const std::span<wchar_t>& buffer, std::wstring_view& out, u8state& state) noexcept
+    {
+        out = {};
+        RETURN_HR_IF(S_OK, in.empty());
+
+        int capa16{};
+        // The worst ratio of UTF-8 code units to UTF-16 code units is 1 to 1 if UTF-8 consists of ASCII only.
+        RETURN_HR_IF(E_ABORT, !base::CheckAdd(in.length(), state.have).AssignIfValid(&capa16));
+        RETURN_HR_IF(E_NOT_SUFFICIENT_BUFFER, buffer.size() < gsl::narrow_cast<size_t>(capa16));
+
+        auto len8{ in.length() };
+        auto cursor8{ in.data() };
+        auto cursor16{ buffer.data() };
+        if (state.have)
+        {
+            const auto copyable{ std::min<size_t>(state.want, len8) };
+            std::move(cursor8, cursor8 + copyable, &state.partials[state.have]);
+            state.have += gsl::narrow_cast<uint8_t>(copyable);
+            state.want -= gsl::narrow_cast<uint8_t>(copyable);
+            if (state.want) // we still didn't get enough data to complete the code point, however this is not an error
+            {
+                return S_OK;
+            }
+
+            cursor16 = details::u8u16_decode(&state.partials[0], &state.partials[state.have], cursor16);
+            RETURN_HR_IF(E_UNEXPECTED, !cursor16);
+
+            len8 -= copyable;
+            cursor8 += copyable;
+            // state.want is already zero at this point
+            state.have = 0;
+        }
+
+        if (len8)
+        {
+            auto backIter{ cursor8 + len8 - 1 };
+            size_t sequenceLen{ 1 };
+
+            // skip UTF8 continuation bytes
+            while (backIter != cursor8 && (*backIter & 0b11'000000) == 0b10'000000)
+            {
+                --backIter;
+                ++sequenceLen;
+            }
+
+            // credits go to Christopher Wellons for this algorithm to determine the length of a UTF-8 code point
+            // it is released into the Public Domain. https://github.com/skeeto/branchless-utf8
+            static constexpr uint8_t lengths[]{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0 };
+            const size_t codePointLen{ lengths[gsl::narrow_cast<uint8_t>(*backIter) >> 3] };
+
+            if (codePointLen > sequenceLen)
+            {
+                std::move(backIter, backIter + sequenceLen, &state.partials[0]);
+                len8 -= sequenceLen;
+                state.have = gsl::narrow_cast<uint8_t>(sequenceLen);
+                state.want = gsl::narrow_cast<uint8_t>(codePointLen - sequenceLen);
+            }
+        }
+
+        if (len8)
+        {
+            cursor16 = details::u8u16_decode(cursor8, cursor8 + len8, cursor16);
+            RETURN_HR_IF(E_UNEXPECTED, !cursor16);
+        }
+
+        out = { buffer.data(), gsl::narrow_cast<size_t>(cursor16 - buffer.data()) };
+        return S_OK;
+    }
+#pragma warning(pop)
+
     // Routine Description:
     // - Takes a UTF-8 string, complements and/or caches partials, and performs the conversion to UTF-16.
     // Arguments:
@@ -101,75 +325,16 @@ namespace til // Terminal Implementation Library. Also: "Today I Learned"
             RETURN_HR_IF(S_OK, in.empty());
 
             int capa16{};
-            // The worst ratio of UTF-8 code units to UTF-16 code units is 1 to 1 if UTF-8 consists of ASCII only.
             RETURN_HR_IF(E_ABORT, !base::CheckAdd(in.length(), state.have).AssignIfValid(&capa16));
 
             out.resize(gsl::narrow_cast<size_t>(capa16));
-            auto len8{ gsl::narrow_cast<int>(in.length()) };
-            int len16{};
-            auto cursor8{ in.data() };
-            if (state.have)
-            {
-                const auto copyable{ std::min<int>(state.want, len8) };
-                std::move(cursor8, cursor8 + copyable, &state.partials[state.have]);
-                state.have += gsl::narrow_cast<uint8_t>(copyable);
-                state.want -= gsl::narrow_cast<uint8_t>(copyable);
-                if (state.want) // we still didn't get enough data to complete the code point, however this is not an error
-                {
-                    out.clear();
-                    return S_OK;
-                }
-
-                len16 = MultiByteToWideChar(CP_UTF8, 0UL, &state.partials[0], gsl::narrow_cast<int>(state.have), out.data(), capa16);
-                RETURN_HR_IF(E_UNEXPECTED, !len16);
-
-                capa16 -= len16;
-                len8 -= copyable;
-                cursor8 += copyable;
-                // state.want is already zero at this point
-                state.have = 0;
-            }
-
-            if (len8)
-            {
-                auto backIter{ cursor8 + len8 - 1 };
-                int sequenceLen{ 1 };
-
-                // skip UTF8 continuation bytes
-                while (backIter != cursor8 && (*backIter & 0b11'000000) == 0b10'000000)
-                {
-                    --backIter;
-                    ++sequenceLen;
-                }
-
-                // credits go to Christopher Wellons for this algorithm to determine the length of a UTF-8 code point
-                // it is released into the Public Domain. https://github.com/skeeto/branchless-utf8
-                static constexpr uint8_t lengths[]{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0 };
-                const auto codePointLen{ lengths[gsl::narrow_cast<uint8_t>(*backIter) >> 3] };
-
-                if (codePointLen > sequenceLen)
-                {
-                    std::move(backIter, backIter + sequenceLen, &state.partials[0]);
-                    len8 -= sequenceLen;
-                    state.have = gsl::narrow_cast<uint8_t>(sequenceLen);
-                    state.want = gsl::narrow_cast<uint8_t>(codePointLen - sequenceLen);
-                }
-            }
-
-            if (len8)
-            {
-                const auto convLen{ MultiByteToWideChar(CP_UTF8, 0UL, cursor8, len8, out.data() + len16, capa16) };
-                RETURN_HR_IF(E_UNEXPECTED, !convLen);
-
-                len16 += convLen;
-            }
-
-            out.resize(gsl::narrow_cast<size_t>(len16));
-            return S_OK;
+            std::wstring_view result;
+            const auto hr = u8u16(in, std::span{ out.data(), out.size() }, result, state);
+            out.resize(result.size());
+            return hr;
         }
         CATCH_RETURN();
     }
-#pragma warning(pop)
 
     // Routine Description:
     // - Takes a UTF-16 string and performs the conversion to UTF-8. NOTE: The function relies on getting complete UTF-16 characters at the string boundaries.
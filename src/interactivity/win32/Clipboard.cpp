@@ -344,7 +344,6 @@ void Clipboard::StoreSelectionToClipboard(const bool copyFormatting)
     const auto& [selectionStart, selectionEnd] = selection.GetSelectionAnchors();
 
     const auto req = TextBuffer::CopyRequest::FromConfig(buffer, selectionStart, selectionEnd, singleLine, !selection.IsLineSelection(), false);
-    text = buffer.GetPlainText(req);
 
     if (copyFormatting)
     {
@@ -354,8 +353,14 @@ void Clipboard::StoreSelectionToClipboard(const bool copyFormatting)
         const auto bgColor = renderSettings.GetAttributeColors({}).second;
         const auto isIntenseBold = renderSettings.GetRenderMode(::Microsoft::Console::Render::RenderSettings::Mode::IntenseIsBold);
 
-        htmlData = buffer.GenHTML(req, fontSizePt, fontName, bgColor, isIntenseBold, GetAttributeColors);
-        rtfData = buffer.GenRTF(req, fontSizePt, fontName, bgColor, isIntenseBold, GetAttributeColors);
+        auto formats = buffer.GenCopyFormats(req, true, true, fontSizePt, fontName, bgColor, isIntenseBold, GetAttributeColors);
+        text = std::move(formats.plainText);
+        htmlData = std::move(formats.html);
+        rtfData = std::move(formats.rtf);
+    }
+    else
+    {
+        text = buffer.GetPlainText(req);
     }
 
     const auto clipboard = _openClipboard(ServiceLocator::LocateConsoleWindow()->GetWindowHandle());
@@ -21,6 +21,12 @@ static constexpr auto renderBackoffBaseTimeMilliseconds{ 150 };
             break;            \
         else
 
+#define FOREACH_PAINTING_ENGINE(var)  \
+    for (auto var : _paintingEngines) \
+        if (!var)                     \
+            break;                    \
+        else
+
 // Routine Description:
 // - Creates a new renderer controller for a console.
 // Arguments:
@@ -110,8 +116,23 @@ IRenderData* Renderer::GetRenderData() const noexcept
     return S_OK;
 }
 
+// Routine Description:
+// - Paints a frame in three phases, so that the console lock is only held while
+//   the state of the console is being read and the engines are being (in)validated:
+//   1. With the console locked, start painting on every engine and capture the dirty rows
+//      and everything else the engines need into _frame.
+//   2. With the console unlocked, paint the text and selection from _frame.
+//      Invalidations that arrive during this phase are deferred.
+//   3. With the console locked again, paint the cursor and title, finish painting
+//      and forward the invalidations that were deferred during phase 2.
+// Arguments:
+// - <none>
+// Return Value:
+// - HRESULT S_OK, GDI error, Safe Math error, or state/argument errors.
 [[nodiscard]] HRESULT Renderer::_PaintFrame() noexcept
 {
+    auto hr = S_OK;
+
     {
         _pData->LockConsole();
         auto unlock = wil::scope_exit([&]() {
@@ -120,6 +141,7 @@ IRenderData* Renderer::GetRenderData() const noexcept
 
         // Last chance check if anything scrolled without an explicit invalidate notification since the last frame.
         _CheckViewportAndScroll();
+        _InvalidateMutatedRows();
 
         _invalidateCurrentCursor(); // Invalidate the previous cursor position.
         _invalidateOldComposition();
@@ -130,57 +152,131 @@ IRenderData* Renderer::GetRenderData() const noexcept
         _invalidateCurrentCursor(); // Invalidate the new cursor position.
         _prepareNewComposition();
 
+        RETURN_IF_FAILED(_CaptureFrame());
+
+        _paintingEngines = {};
+        size_t paintingCount = 0;
+
         FOREACH_ENGINE(pEngine)
         {
-            RETURN_IF_FAILED(_PaintFrameForEngine(pEngine));
+            // Try to start painting a frame
+            hr = pEngine->StartPaint();
+            if (FAILED(hr))
+            {
+                break;
+            }
+
+            // The renderer itself tracks if there's something to do with the title, the
+            // engine won't know that. S_FALSE means that there's nothing to paint.
+            if (hr == S_OK)
+            {
+                til::at(_paintingEngines, paintingCount++) = pEngine;
+                hr = _PrepareFrameForEngine(pEngine);
+                if (FAILED(hr))
+                {
+                    break;
+                }
+            }
+        }
+
+        if (SUCCEEDED(hr) && paintingCount)
+        {
+            hr = _CaptureFrameRows();
+        }
+        if (SUCCEEDED(hr) && paintingCount)
+        {
+            FOREACH_PAINTING_ENGINE(pEngine)
+            {
+                // C. Prepare the engine with additional information before we start drawing.
+                hr = _PrepareRenderInfo(pEngine);
+                if (FAILED(hr))
+                {
+                    break;
+                }
+            }
+        }
+
+        if (!paintingCount)
+        {
+            RETURN_IF_FAILED(hr);
+        }
+        else if (SUCCEEDED(hr))
+        {
+            _deferInvalidation = true;
+            _paintMutex.lock();
         }
     }
 
-    FOREACH_ENGINE(pEngine)
+    if (_deferInvalidation)
     {
-        RETURN_IF_FAILED(pEngine->Present());
+        FOREACH_PAINTING_ENGINE(pEngine)
+        {
+            hr = _PaintFrameForEngine(pEngine);
+            if (FAILED(hr))
+            {
+                break;
+            }
+        }
+
+        // This must happen before locking the console again, because calls that
+        // wait on _paintMutex may be holding the console lock.
+        _paintMutex.unlock();
     }
 
-    return S_OK;
-}
+    if (_paintingEngines[0])
+    {
+        _pData->LockConsole();
+        auto unlock = wil::scope_exit([&]() {
+            _pData->UnlockConsole();
+        });
 
-[[nodiscard]] HRESULT Renderer::_PaintFrameForEngine(_In_ IRenderEngine* const pEngine) noexcept
-try
-{
-    FAIL_FAST_IF_NULL(pEngine); // This is a programming error. Fail fast.
+        const auto painted = SUCCEEDED(hr);
+        FOREACH_PAINTING_ENGINE(pEngine)
+        {
+            const auto endHr = _EndFrameForEngine(pEngine, painted);
+            if (SUCCEEDED(hr))
+            {
+                hr = endHr;
+            }
+        }
+
+        _paintingEngines = {};
+        _FlushPendingInvalidation();
+    }
 
-    // Try to start painting a frame
-    const auto hr = pEngine->StartPaint();
     RETURN_IF_FAILED(hr);
 
-    // Return early if there's nothing to paint.
-    // The renderer itself tracks if there's something to do with the title, the
-    //      engine won't know that.
-    if (S_FALSE == hr)
+    FOREACH_ENGINE(pEngine)
     {
-        return S_OK;
+        RETURN_IF_FAILED(pEngine->Present());
     }
 
-    auto endPaint = wil::scope_exit([&]() {
-        LOG_IF_FAILED(pEngine->EndPaint());
-
-        // If the engine tells us it really wants to redraw immediately,
-        // tell the thread so it doesn't go to sleep and ticks again
-        // at the next opportunity.
-        if (pEngine->RequiresContinuousRedraw())
-        {
-            NotifyPaintFrame();
-        }
-    });
+    return S_OK;
+}
 
+// Routine Description:
+// - Prepares an engine that has started painting for the upcoming frame.
+// - Called with the console locked.
+[[nodiscard]] HRESULT Renderer::_PrepareFrameForEngine(_In_ IRenderEngine* const pEngine) noexcept
+try
+{
     // A. Prep Colors
     RETURN_IF_FAILED(_UpdateDrawingBrushes(pEngine, {}, false, true));
 
     // B. Perform Scroll Operations
     RETURN_IF_FAILED(_PerformScrolling(pEngine));
 
-    // C. Prepare the engine with additional information before we start drawing.
-    RETURN_IF_FAILED(_PrepareRenderInfo(pEngine));
+    return S_OK;
+}
+CATCH_RETURN()
+
+// Routine Description:
+// - Paints the contents of the captured frame.
+// - Called with the console unlocked. Everything in here must only read from _frame.
+[[nodiscard]] HRESULT Renderer::_PaintFrameForEngine(_In_ IRenderEngine* const pEngine) noexcept
+try
+{
+    FAIL_FAST_IF_NULL(pEngine); // This is a programming error. Fail fast.
 
     // 1. Paint Background
     RETURN_IF_FAILED(_PaintBackground(pEngine));
@@ -191,20 +287,334 @@ try
     // 4. Paint Selection
     _PaintSelection(pEngine);
 
-    // 5. Paint Cursor
-    _PaintCursor(pEngine);
+    return S_OK;
+}
+CATCH_RETURN()
 
-    // 6. Paint window title
-    RETURN_IF_FAILED(_PaintTitle(pEngine));
+// Routine Description:
+// - Finishes the frame of an engine that has started painting.
+// - Called with the console locked.
+// Arguments:
+// - pEngine - The engine to finish painting on.
+// - painted - false if painting the frame failed and it should only be ended.
+[[nodiscard]] HRESULT Renderer::_EndFrameForEngine(_In_ IRenderEngine* const pEngine, const bool painted) noexcept
+{
+    auto hr = S_OK;
 
-    // Force scope exit end paint to finish up collecting information and possibly painting
-    endPaint.reset();
+    if (painted)
+    {
+        try
+        {
+            // 5. Paint Cursor
+            _PaintCursor(pEngine);
 
-    // As we leave the scope, EndPaint will be called (declared above)
+            // 6. Paint window title
+            hr = _PaintTitle(pEngine);
+        }
+        catch (...)
+        {
+            hr = LOG_CAUGHT_EXCEPTION();
+        }
+    }
+
+    LOG_IF_FAILED(pEngine->EndPaint());
+
+    // If the engine tells us it really wants to redraw immediately,
+    // tell the thread so it doesn't go to sleep and ticks again
+    // at the next opportunity.
+    if (pEngine->RequiresContinuousRedraw())
+    {
+        NotifyPaintFrame();
+    }
+
+    return hr;
+}
+
+// Routine Description:
+// - Copies the state that's needed to paint the next frame into _frame, except for the rows of text.
+// - Called with the console locked, before the engines start painting.
+[[nodiscard]] HRESULT Renderer::_CaptureFrame() noexcept
+try
+{
+    const auto& buffer = _pData->GetTextBuffer();
+    const auto view = _pData->GetViewport();
+    const til::size frameSize{ buffer.GetSize().Width(), std::max(1, view.Height()) };
+
+    if (!_frame.buffer || _frame.buffer->GetSize().Dimensions() != frameSize)
+    {
+        _frame.buffer = std::make_unique<TextBuffer>(frameSize, TextAttribute{}, 0, false, nullptr);
+    }
+
+    _frame.view = view;
+    _frame.renderSettings = _renderSettings;
+    _frame.selectionRects = _GetSelectionRects();
+    const auto highlights = _pData->GetSearchHighlights();
+    _frame.searchHighlights.assign(highlights.begin(), highlights.end());
+    const auto focused = _pData->GetSearchHighlightFocused();
+    _frame.searchHighlightFocused = focused ? std::optional{ *focused } : std::nullopt;
+    _frame.patterns.clear();
+    _frame.hoveredInterval = _hoveredInterval;
+    _frame.hyperlinkHoveredId = _hyperlinkHoveredId;
+    _frame.gridLinesAllowed = _pData->IsGridLineDrawingAllowed();
     return S_OK;
 }
 CATCH_RETURN()
 
+// Routine Description:
+// - Copies the rows of the viewport that are going to be painted into _frame.
+// - Called with the console locked, after the engines have started painting.
+[[nodiscard]] HRESULT Renderer::_CaptureFrameRows() noexcept
+try
+{
+    const auto& buffer = _pData->GetTextBuffer();
+    const auto& view = _frame.view;
+    const auto width = _frame.buffer->GetSize().Width();
+
+    // Only the rows that at least one of the engines is going to paint need to be copied.
+    til::CoordType top = til::CoordTypeMax;
+    til::CoordType bottom = til::CoordTypeMin;
+    FOREACH_PAINTING_ENGINE(pEngine)
+    {
+        std::span<const til::rect> dirtyAreas;
+        LOG_IF_FAILED(pEngine->GetDirtyArea(dirtyAreas));
+
+        for (const auto& dirtyRect : dirtyAreas)
+        {
+            if (dirtyRect)
+            {
+                top = std::min(top, dirtyRect.top);
+                bottom = std::max(bottom, dirtyRect.bottom);
+            }
+        }
+    }
+
+    top = std::max(top, 0);
+    bottom = std::min(bottom, view.Height());
+
+    const auto compositionRow = _compositionCache ? _compositionCache->absoluteOrigin.y - view.Top() : -1;
+    const auto& activeComposition = _pData->GetActiveComposition();
+
+    for (auto row = top; row < bottom; ++row)
+    {
+        const auto& source = buffer.GetRowByOffset(view.Top() + row);
+        auto& r = _frame.buffer->GetMutableRowByOffset(row);
+        r.CopyFrom(source);
+        ImageSlice::CopyRow(source, r);
+
+        // Draw the active composition into the copy of the row.
+        if (row == compositionRow)
+        {
+            std::wstring_view text{ activeComposition.text };
+            RowWriteState state{
+                .columnLimit = r.GetReadableColumnCount(),
+                .columnEnd = _compositionCache->absoluteOrigin.x,
+            };
+
+            size_t off = 0;
+            for (const auto& range : activeComposition.attributes)
+            {
+                const auto len = range.len;
+                auto attr = range.attr;
+
+                // Use the color at the cursor if TSF didn't specify any explicit color.
+                if (attr.GetBackground().IsDefault())
+                {
+                    attr.SetBackground(_compositionCache->baseAttribute.GetBackground());
+                }
+                if (attr.GetForeground().IsDefault())
+                {
+                    attr.SetForeground(_compositionCache->baseAttribute.GetForeground());
+                }
+
+                state.text = text.substr(off, len);
+                state.columnBegin = state.columnEnd;
+                r.ReplaceText(state);
+                r.ReplaceAttributes(state.columnBegin, state.columnEnd, attr);
+                off += len;
+            }
+        }
+
+        // Pattern IDs are looked up in viewport-relative coordinates, just like they're painted.
+        auto& runs = _frame.patterns;
+        for (til::CoordType x = 0; x < width; ++x)
+        {
+            auto ids = _pData->GetPatternId({ x, row });
+            if (ids.empty())
+            {
+                continue;
+            }
+
+            if (!runs.empty() && runs.back().row == row && runs.back().end == x && runs.back().ids == ids)
+            {
+                runs.back().end = x + 1;
+            }
+            else
+            {
+                runs.emplace_back(PatternRun{ row, x, x + 1, std::move(ids) });
+            }
+        }
+    }
+
+    return S_OK;
+}
+CATCH_RETURN()
+
+// Routine Description:
+// - Returns the pattern IDs of the given viewport-relative position in the captured frame.
+const std::vector<size_t>& Renderer::_GetPatternIds(const til::point target) const noexcept
+{
+    static const std::vector<size_t> none;
+
+    for (const auto& run : _frame.patterns)
+    {
+        if (run.row == target.y && target.x >= run.begin && target.x < run.end)
+        {
+            return run.ids;
+        }
+    }
+
+    return none;
+}
+
+// Routine Description:
+// - Forwards the invalidations that were deferred while the engines were painting without the console lock.
+// - Called with the console locked, after the engines have finished painting.
+void Renderer::_FlushPendingInvalidation() noexcept
+try
+{
+    _deferInvalidation = false;
+
+    auto pending = std::exchange(_pendingInvalidation, {});
+
+    if (pending.scrollDelta != til::point{})
+    {
+        TriggerScroll(&pending.scrollDelta);
+    }
+    if (pending.scroll)
+    {
+        TriggerScroll();
+    }
+    if (pending.redraw)
+    {
+        _InvalidateRegion(pending.redraw);
+    }
+    if (pending.system)
+    {
+        TriggerSystemRedraw(&pending.system);
+    }
+    if (pending.all)
+    {
+        FOREACH_ENGINE(pEngine)
+        {
+            LOG_IF_FAILED(pEngine->InvalidateAll());
+        }
+        NotifyPaintFrame();
+    }
+    if (pending.selection)
+    {
+        _InvalidateSelection();
+    }
+    if (pending.highlights)
+    {
+        TriggerSearchHighlight(pending.oldHighlights);
+    }
+    if (pending.title)
+    {
+        TriggerTitleChange();
+    }
+    if (!pending.newText.empty())
+    {
+        TriggerNewTextNotification(pending.newText);
+    }
+    if (pending.hyperlinkHoveredId)
+    {
+        UpdateHyperlinkHoveredId(*pending.hyperlinkHoveredId);
+    }
+}
+CATCH_LOG()
+
+// Routine Description:
+// - Invalidates every viewport row that was modified since the last frame.
+// - The text buffer doesn't report the regions it modifies. Instead, every modification
+//   of a row assigns it a new ROW::GetMutationId() and we compare them with the ones we saw last.
+//   That way a frame costs one Invalidate() call per contiguous range of modified rows,
+//   no matter how many times the rows were written to.
+// Arguments:
+// - <none>
+// Return Value:
+// - <none>
+void Renderer::_InvalidateMutatedRows()
+{
+    const auto& buffer = _pData->GetTextBuffer();
+    const auto view = _pData->GetViewport();
+    const auto height = view.Height();
+
+    _rowMutationIds.resize(gsl::narrow_cast<size_t>(std::max(0, height)));
+
+    const auto invalidate = [&](const til::CoordType top, const til::CoordType bottom) {
+        const til::rect region{ 0, top, view.Width(), bottom };
+        FOREACH_ENGINE(pEngine)
+        {
+            LOG_IF_FAILED(pEngine->Invalidate(&region));
+        }
+    };
+
+    til::CoordType dirtyTop = -1;
+
+    for (til::CoordType y = 0; y < height; ++y)
+    {
+        const auto id = buffer.GetRowByOffset(view.Top() + y).GetMutationId();
+        auto& painted = til::at(_rowMutationIds, y);
+
+        if (id != painted)
+        {
+            painted = id;
+            if (dirtyTop < 0)
+            {
+                dirtyTop = y;
+            }
+        }
+        else if (dirtyTop >= 0)
+        {
+            invalidate(dirtyTop, y);
+            dirtyTop = -1;
+        }
+    }
+
+    if (dirtyTop >= 0)
+    {
+        invalidate(dirtyTop, height);
+    }
+}
+
+// Routine Description:
+// - Moves the mutation IDs of the viewport rows along with their contents, so that
+//   rows which were only scrolled aren't mistaken for modified ones by _InvalidateMutatedRows.
+// Arguments:
+// - delta - The distance the contents moved by. Negative values move them up.
+// Return Value:
+// - <none>
+void Renderer::_ScrollRowMutationIds(const til::CoordType delta) noexcept
+{
+    const auto size = gsl::narrow_cast<til::CoordType>(_rowMutationIds.size());
+    const auto beg = _rowMutationIds.begin();
+    const auto end = _rowMutationIds.end();
+
+    // The rows that scrolled into view are treated as modified.
+    if (delta <= -size || delta >= size)
+    {
+        std::fill(beg, end, 0);
+    }
+    else if (delta < 0)
+    {
+        std::fill(std::move(beg - delta, end, beg), end, 0);
+    }
+    else if (delta > 0)
+    {
+        std::fill(beg, std::move_backward(beg, end - delta, end), 0);
+    }
+}
+
 void Renderer::NotifyPaintFrame() noexcept
 {
     // If we're running in the unittests, we might not have a render thread.
@@ -223,6 +633,14 @@ void Renderer::NotifyPaintFrame() noexcept
 // - <none>
 void Renderer::TriggerSystemRedraw(const til::rect* const prcDirtyClient)
 {
+    if (_deferInvalidation)
+    {
+        _pendingInvalidation.system |= *prcDirtyClient;
+        return;
+    }
+
+    _FlushPendingScroll();
+
     FOREACH_ENGINE(pEngine)
     {
         LOG_IF_FAILED(pEngine->InvalidateSystem(prcDirtyClient));
@@ -239,7 +657,6 @@ void Renderer::TriggerSystemRedraw(const til::rect* const prcDirtyClient)
 // - <none>
 void Renderer::TriggerRedraw(const Viewport& region)
 {
-    auto view = _pData->GetViewport();
     auto srUpdateRegion = region.ToExclusive();
 
     // If the dirty region has double width lines, we need to double the size of
@@ -254,12 +671,33 @@ void Renderer::TriggerRedraw(const Viewport& region)
         }
     }
 
-    if (view.TrimToViewport(&srUpdateRegion))
+    if (_deferInvalidation)
     {
-        view.ConvertToOrigin(&srUpdateRegion);
+        _pendingInvalidation.redraw |= srUpdateRegion;
+        return;
+    }
+
+    _InvalidateRegion(srUpdateRegion);
+}
+
+// Routine Description:
+// - Invalidates the part of the given buffer region that's within the viewport.
+// Arguments:
+// - region: The region in buffer coordinates.
+// Return Value:
+// - <none>
+void Renderer::_InvalidateRegion(til::rect region)
+{
+    const auto view = _pData->GetViewport();
+
+    if (view.TrimToViewport(&region))
+    {
+        _FlushPendingScroll();
+
+        view.ConvertToOrigin(&region);
         FOREACH_ENGINE(pEngine)
         {
-            LOG_IF_FAILED(pEngine->Invalidate(&srUpdateRegion));
+            LOG_IF_FAILED(pEngine->Invalidate(&region));
         }
 
         NotifyPaintFrame();
@@ -287,12 +725,19 @@ void Renderer::TriggerRedraw(const til::point* const pcoord)
 // - <none>
 void Renderer::TriggerRedrawAll(const bool backgroundChanged, const bool frameChanged)
 {
-    FOREACH_ENGINE(pEngine)
+    if (_deferInvalidation)
     {
-        LOG_IF_FAILED(pEngine->InvalidateAll());
+        _pendingInvalidation.all = true;
     }
+    else
+    {
+        FOREACH_ENGINE(pEngine)
+        {
+            LOG_IF_FAILED(pEngine->InvalidateAll());
+        }
 
-    NotifyPaintFrame();
+        NotifyPaintFrame();
+    }
 
     if (backgroundChanged && _pfnBackgroundColorChanged)
     {
@@ -325,6 +770,23 @@ void Renderer::TriggerTeardown() noexcept
 // Return Value:
 // - <none>
 void Renderer::TriggerSelection()
+{
+    if (_deferInvalidation)
+    {
+        _pendingInvalidation.selection = true;
+        return;
+    }
+
+    _InvalidateSelection();
+}
+
+// Routine Description:
+// - Invalidates the previous and the current selection.
+// Arguments:
+// - <none>
+// Return Value:
+// - <none>
+void Renderer::_InvalidateSelection()
 {
     try
     {
@@ -340,6 +802,8 @@ void Renderer::TriggerSelection()
             sr &= viewport;
         }
 
+        _FlushPendingScroll();
+
         FOREACH_ENGINE(pEngine)
         {
             LOG_IF_FAILED(pEngine->InvalidateSelection(_previousSelection));
@@ -357,6 +821,14 @@ void Renderer::TriggerSelection()
 void Renderer::TriggerSearchHighlight(const std::vector<til::point_span>& oldHighlights)
 try
 {
+    if (_deferInvalidation)
+    {
+        auto& pending = _pendingInvalidation;
+        pending.oldHighlights.insert(pending.oldHighlights.end(), oldHighlights.begin(), oldHighlights.end());
+        pending.highlights = true;
+        return;
+    }
+
     // no need to invalidate focused search highlight separately as they are
     // included in (all) search highlights.
     const auto newHighlights = _pData->GetSearchHighlights();
@@ -368,6 +840,8 @@ try
 
     const auto& buffer = _pData->GetTextBuffer();
 
+    _FlushPendingScroll();
+
     FOREACH_ENGINE(pEngine)
     {
         LOG_IF_FAILED(pEngine->InvalidateHighlight(oldHighlights, buffer));
@@ -386,6 +860,8 @@ CATCH_LOG()
 // - True if something changed and we scrolled. False otherwise.
 bool Renderer::_CheckViewportAndScroll()
 {
+    _FlushPendingScroll();
+
     const auto srOldViewport = _viewport.ToInclusive();
     const auto srNewViewport = _pData->GetViewport().ToInclusive();
 
@@ -408,6 +884,7 @@ bool Renderer::_CheckViewportAndScroll()
     }
 
     _ScrollPreviousSelection(coordDelta);
+    _ScrollRowMutationIds(coordDelta.y);
 
     // The cursor may have moved out of or into the viewport. Update the .inViewport property.
     {
@@ -439,6 +916,12 @@ bool Renderer::_CheckViewportAndScroll()
 // - <none>
 void Renderer::TriggerScroll()
 {
+    if (_deferInvalidation)
+    {
+        _pendingInvalidation.scroll = true;
+        return;
+    }
+
     if (_CheckViewportAndScroll())
     {
         NotifyPaintFrame();
@@ -450,22 +933,57 @@ void Renderer::TriggerScroll()
 // - This is a special case as calling out scrolls explicitly drastically improves performance.
 // - This should only be used when the viewport is not modified. It lets us know we can "scroll anyway" to save perf,
 //   because the backing circular buffer rotated out from behind the viewport.
+// - Consecutive scrolls are summed up and forwarded to the engines as one, either at the start of the
+//   next frame or before anything else is invalidated. That way a burst of thousands of line feeds
+//   at the bottom of the buffer costs a single InvalidateScroll() call per engine and frame.
 // Arguments:
 // - <none>
 // Return Value:
 // - <none>
 void Renderer::TriggerScroll(const til::point* const pcoordDelta)
 {
-    FOREACH_ENGINE(pEngine)
+    if (_deferInvalidation)
     {
-        LOG_IF_FAILED(pEngine->InvalidateScroll(pcoordDelta));
+        // The contents of the buffer moved, and so did the regions that were invalidated so far.
+        auto& pending = _pendingInvalidation;
+        pending.scrollDelta += *pcoordDelta;
+        if (pending.redraw)
+        {
+            pending.redraw += *pcoordDelta;
+        }
+        return;
     }
 
-    _ScrollPreviousSelection(*pcoordDelta);
-
+    _pendingScrollDelta += *pcoordDelta;
     NotifyPaintFrame();
 }
 
+// Routine Description:
+// - Forwards the scrolls accumulated by TriggerScroll(const til::point*) to the engines.
+// - Needs to be called before the engines are invalidated in any other way,
+//   because they expect invalidations to be relative to the already scrolled contents.
+// Arguments:
+// - <none>
+// Return Value:
+// - <none>
+void Renderer::_FlushPendingScroll()
+{
+    if (_pendingScrollDelta == til::point{})
+    {
+        return;
+    }
+
+    const auto delta = std::exchange(_pendingScrollDelta, {});
+
+    FOREACH_ENGINE(pEngine)
+    {
+        LOG_IF_FAILED(pEngine->InvalidateScroll(&delta));
+    }
+
+    _ScrollPreviousSelection(delta);
+    _ScrollRowMutationIds(delta.y);
+}
+
 // Routine Description:
 // - Called when the title of the console window has changed. Indicates that we
 //      should update the title on the next frame.
@@ -475,6 +993,12 @@ void Renderer::TriggerScroll(const til::point* const pcoordDelta)
 // - <none>
 void Renderer::TriggerTitleChange()
 {
+    if (_deferInvalidation)
+    {
+        _pendingInvalidation.title = true;
+        return;
+    }
+
     const auto newTitle = _pData->GetConsoleTitle();
     FOREACH_ENGINE(pEngine)
     {
@@ -485,6 +1009,12 @@ void Renderer::TriggerTitleChange()
 
 void Renderer::TriggerNewTextNotification(const std::wstring_view newText)
 {
+    if (_deferInvalidation)
+    {
+        _pendingInvalidation.newText.append(newText);
+        return;
+    }
+
     FOREACH_ENGINE(pEngine)
     {
         LOG_IF_FAILED(pEngine->NotifyNewText(newText));
@@ -513,6 +1043,8 @@ HRESULT Renderer::_PaintTitle(IRenderEngine* const pEngine)
 // - <none>
 void Renderer::TriggerFontChange(const int iDpi, const FontInfoDesired& FontInfoDesired, _Out_ FontInfo& FontInfo)
 {
+    const std::lock_guard paintLock{ _paintMutex };
+
     FOREACH_ENGINE(pEngine)
     {
         LOG_IF_FAILED(pEngine->UpdateDpi(iDpi));
@@ -532,6 +1064,8 @@ void Renderer::TriggerFontChange(const int iDpi, const FontInfoDesired& FontInfo
 // - <none>
 void Renderer::UpdateSoftFont(const std::span<const uint16_t> bitPattern, const til::size cellSize, const size_t centeringHint)
 {
+    const std::lock_guard paintLock{ _paintMutex };
+
     // We reserve PUA code points U+EF20 to U+EF7F for soft fonts, but the range
     // that we test for in _IsSoftFontChar will depend on the size of the active
     // bitPattern. If it's empty (i.e. no soft font is set), then nothing will
@@ -594,6 +1128,7 @@ bool Renderer::s_IsSoftFontChar(const std::wstring_view& v, const size_t firstSo
 // - True if the codepoint is full-width (two wide), false if it is half-width (one wide).
 bool Renderer::IsGlyphWideByFont(const std::wstring_view glyph)
 {
+    const std::lock_guard paintLock{ _paintMutex };
     auto fIsFullWidth = false;
 
     // There will only every really be two engines - the real head and the VT
@@ -668,10 +1203,13 @@ void Renderer::_PaintBufferOutput(_In_ IRenderEngine* const pEngine)
 {
     // This is the subsection of the entire screen buffer that is currently being presented.
     // It can move left/right or top/bottom depending on how the viewport is scrolled
-    // relative to the entire buffer.
-    const auto view = _pData->GetViewport();
-    const auto compositionRow = _compositionCache ? _compositionCache->absoluteOrigin.y : -1;
-    const auto& activeComposition = _pData->GetActiveComposition();
+    // relative to the entire buffer. The rows of the frame buffer start at the top of
+    // the viewport, but it has the full width of the screen buffer.
+    const auto& view = _frame.view;
+    const auto frameView = Viewport::FromDimensions({ view.Left(), 0 }, view.Dimensions());
+
+    // Retrieve the captured text buffer so we can read information out of it.
+    const auto& buffer = *_frame.buffer;
 
     // This is effectively the number of cells on the visible screen that need to be redrawn.
     // The origin is always 0, 0 because it represents the screen itself, not the underlying buffer.
@@ -692,17 +1230,15 @@ void Renderer::_PaintBufferOutput(_In_ IRenderEngine* const pEngine)
 
         auto dirty = Viewport::FromExclusive(dirtyRect);
 
-        // Shift the origin of the dirty region to match the underlying buffer so we can
+        // Shift the origin of the dirty region to match the frame buffer so we can
         // compare the two regions directly for intersection.
-        dirty = Viewport::Offset(dirty, view.Origin());
+        dirty = Viewport::Offset(dirty, frameView.Origin());
 
         // The intersection between what is dirty on the screen (in need of repaint)
         // and what is supposed to be visible on the screen (the viewport) is what
         // we need to walk through line-by-line and repaint onto the screen.
-        const auto redraw = Viewport::Intersect(dirty, view);
+        const auto redraw = Viewport::Intersect(dirty, frameView);
 
-        // Retrieve the text buffer so we can read information out of it.
-        auto& buffer = _pData->GetTextBuffer();
         // Now walk through each row of text that we need to redraw.
         for (auto row = redraw.Top(); row < redraw.BottomExclusive(); row++)
         {
@@ -711,63 +1247,14 @@ void Renderer::_PaintBufferOutput(_In_ IRenderEngine* const pEngine)
             const auto screenLine = til::inclusive_rect{ redraw.Left(), row, redraw.RightInclusive(), row };
             const auto& r = buffer.GetRowByOffset(row);
 
-            // Draw the active composition.
-            // We have to use some tricks here with const_cast, because the code after it relies on TextBufferCellIterator,
-            // which isn't compatible with the scratchpad row. This forces us to back up and modify the actual row `r`.
-            ROW* rowBackup = nullptr;
-            if (row == compositionRow)
-            {
-                auto& scratch = buffer.GetScratchpadRow();
-                scratch.CopyFrom(r);
-                rowBackup = &scratch;
-
-                std::wstring_view text{ activeComposition.text };
-                RowWriteState state{
-                    .columnLimit = r.GetReadableColumnCount(),
-                    .columnEnd = _compositionCache->absoluteOrigin.x,
-                };
-
-                size_t off = 0;
-                for (const auto& range : activeComposition.attributes)
-                {
-                    const auto len = range.len;
-                    auto attr = range.attr;
-
-                    // Use the color at the cursor if TSF didn't specify any explicit color.
-                    if (attr.GetBackground().IsDefault())
-                    {
-                        attr.SetBackground(_compositionCache->baseAttribute.GetBackground());
-                    }
-                    if (attr.GetForeground().IsDefault())
-                    {
-                        attr.SetForeground(_compositionCache->baseAttribute.GetForeground());
-                    }
-
-                    state.text = text.substr(off, len);
-                    state.columnBegin = state.columnEnd;
-                    const_cast<ROW&>(r).ReplaceText(state);
-                    const_cast<ROW&>(r).ReplaceAttributes(state.columnBegin, state.columnEnd, attr);
-                    off += len;
-                }
-            }
-            const auto restore = wil::scope_exit([&] {
-                if (rowBackup)
-                {
-                    const_cast<ROW&>(r).CopyFrom(*rowBackup);
-                }
-            });
-
             // Convert the screen coordinates of the line to an equivalent
             // range of buffer cells, taking line rendition into account.
-            const auto lineRendition = buffer.GetLineRendition(row);
+            const auto lineRendition = r.GetLineRendition();
             const auto bufferLine = Viewport::FromInclusive(ScreenToBufferLine(screenLine, lineRendition));
 
-            // Find where on the screen we should place this line information. This requires us to re-map
-            // the buffer-based origin of the line back onto the screen-based origin of the line.
-            // For example, the screen might say we need to paint line 1 because it is dirty but the viewport
-            // is actually looking at line 26 relative to the buffer. This means that we need line 27 out
-            // of the backing buffer to fill in line 1 of the screen.
-            const auto screenPosition = bufferLine.Origin() - til::point{ 0, view.Top() };
+            // Since the frame buffer starts at the top of the viewport, the buffer-based origin
+            // of the line is also where on the screen we should place this line information.
+            const auto screenPosition = bufferLine.Origin();
 
             // Retrieve the cell information iterator limited to just this line we want to redraw.
             auto it = buffer.GetCellDataAt(bufferLine.Origin(), bufferLine);
@@ -776,8 +1263,7 @@ void Renderer::_PaintBufferOutput(_In_ IRenderEngine* const pEngine)
             // 1. this row wrapped
             // 2. We're painting the last col of the row.
             // In that case, set lineWrapped=true for the _PaintBufferOutputHelper call.
-            const auto lineWrapped = (buffer.GetRowByOffset(bufferLine.Origin().y).WasWrapForced()) &&
-                                     (bufferLine.RightExclusive() == buffer.GetSize().Width());
+            const auto lineWrapped = r.WasWrapForced() && bufferLine.RightExclusive() == buffer.GetSize().Width();
 
             // Prepare the appropriate line transform for the current row and viewport offset.
             LOG_IF_FAILED(pEngine->PrepareLineTransform(lineRendition, screenPosition.y, view.Left()));
@@ -786,7 +1272,7 @@ void Renderer::_PaintBufferOutput(_In_ IRenderEngine* const pEngine)
             _PaintBufferOutputHelper(pEngine, it, screenPosition, lineWrapped);
 
             // Paint any image content on top of the text.
-            const auto imageSlice = buffer.GetRowByOffset(row).GetImageSlice();
+            const auto imageSlice = r.GetImageSlice();
             if (imageSlice) [[unlikely]]
             {
                 LOG_IF_FAILED(pEngine->PaintImageSlice(*imageSlice, screenPosition.y, view.Left()));
@@ -806,7 +1292,7 @@ void Renderer::_PaintBufferOutputHelper(_In_ IRenderEngine* const pEngine,
                                         const til::point target,
                                         const bool lineWrapped)
 {
-    auto globalInvert{ _renderSettings.GetRenderMode(RenderSettings::Mode::ScreenReversed) };
+    auto globalInvert{ _frame.renderSettings.GetRenderMode(RenderSettings::Mode::ScreenReversed) };
 
     // If we have valid data, let's figure out how to draw it.
     if (it)
@@ -820,7 +1306,7 @@ void Renderer::_PaintBufferOutputHelper(_In_ IRenderEngine* const pEngine,
         // Retrieve the first color.
         auto color = it->TextAttr();
         // Retrieve the first pattern id
-        auto patternIds = _pData->GetPatternId(target);
+        auto patternIds = _GetPatternIds(target);
         // Determine whether we're using a soft font.
         auto usingSoftFont = s_IsSoftFontChar(it->Chars(), _firstSoftFontChar, _lastSoftFontChar);
 
@@ -868,7 +1354,7 @@ void Renderer::_PaintBufferOutputHelper(_In_ IRenderEngine* const pEngine,
             do
             {
                 til::point thisPoint{ screenPoint.x + cols, screenPoint.y };
-                const auto thisPointPatterns = _pData->GetPatternId(thisPoint);
+                const auto& thisPointPatterns = _GetPatternIds(thisPoint);
                 const auto thisUsingSoftFont = s_IsSoftFontChar(it->Chars(), _firstSoftFontChar, _lastSoftFontChar);
                 const auto changedPatternOrFont = patternIds != thisPointPatterns || usingSoftFont != thisUsingSoftFont;
                 if (color != it->TextAttr() || changedPatternOrFont)
@@ -918,7 +1404,7 @@ void Renderer::_PaintBufferOutputHelper(_In_ IRenderEngine* const pEngine,
 
             // If we're allowed to do grid drawing, draw that now too (since it will be coupled with the color data)
             // We're only allowed to draw the grid lines under certain circumstances.
-            if (_pData->IsGridLineDrawingAllowed())
+            if (_frame.gridLinesAllowed)
             {
                 // See GH: 803
                 // If we found a wide character while we looped above, it's possible we skipped over the right half
@@ -1051,8 +1537,8 @@ void Renderer::_PaintBufferOutputGridLineHelper(_In_ IRenderEngine* const pEngin
     if (lines.any())
     {
         // Get the current foreground and underline colors to render the lines.
-        const auto fg = _renderSettings.GetAttributeColors(textAttribute).first;
-        const auto underlineColor = _renderSettings.GetAttributeUnderlineColor(textAttribute);
+        const auto fg = _frame.renderSettings.GetAttributeColors(textAttribute).first;
+        const auto underlineColor = _frame.renderSettings.GetAttributeUnderlineColor(textAttribute);
         // Draw the lines
         LOG_IF_FAILED(pEngine->PaintBufferGridLines(lines, fg, underlineColor, cchLine, coordTarget));
     }
@@ -1060,14 +1546,15 @@ void Renderer::_PaintBufferOutputGridLineHelper(_In_ IRenderEngine* const pEngin
 
 bool Renderer::_isHoveredHyperlink(const TextAttribute& textAttribute) const noexcept
 {
-    return _hyperlinkHoveredId && _hyperlinkHoveredId == textAttribute.GetHyperlinkId();
+    return _frame.hyperlinkHoveredId && _frame.hyperlinkHoveredId == textAttribute.GetHyperlinkId();
 }
 
 bool Renderer::_isInHoveredInterval(const til::point coordTarget) const noexcept
 {
-    return _hoveredInterval &&
-           _hoveredInterval->start <= coordTarget && coordTarget <= _hoveredInterval->stop &&
-           _pData->GetPatternId(coordTarget).size() > 0;
+    const auto& interval = _frame.hoveredInterval;
+    return interval &&
+           interval->start <= coordTarget && coordTarget <= interval->stop &&
+           !_GetPatternIds(coordTarget).empty();
 }
 
 // Routine Description:
@@ -1259,8 +1746,8 @@ void Renderer::_PaintCursor(_In_ IRenderEngine* const pEngine)
 [[nodiscard]] HRESULT Renderer::_PrepareRenderInfo(_In_ IRenderEngine* const pEngine)
 {
     RenderFrameInfo info;
-    info.searchHighlights = _pData->GetSearchHighlights();
-    info.searchHighlightFocused = _pData->GetSearchHighlightFocused();
+    info.searchHighlights = _frame.searchHighlights;
+    info.searchHighlightFocused = _frame.searchHighlightFocused ? &*_frame.searchHighlightFocused : nullptr;
     return pEngine->PrepareRenderInfo(std::move(info));
 }
 
@@ -1277,10 +1764,8 @@ void Renderer::_PaintSelection(_In_ IRenderEngine* const pEngine)
         std::span<const til::rect> dirtyAreas;
         LOG_IF_FAILED(pEngine->GetDirtyArea(dirtyAreas));
 
-        // Get selection rectangles
-        const auto rectangles = _GetSelectionRects();
+        const auto& rectangles = _frame.selectionRects;
 
-        std::vector<til::rect> dirtySearchRectangles;
         for (auto& dirtyRect : dirtyAreas)
         {
             for (const auto& rect : rectangles)
@@ -1314,7 +1799,7 @@ void Renderer::_PaintSelection(_In_ IRenderEngine* const pEngine)
 {
     // The last color needs to be each engine's responsibility. If it's local to this function,
     //      then on the next engine we might not update the color.
-    return pEngine->UpdateDrawingBrushes(textAttributes, _renderSettings, _pData, usingSoftFont, isSettingDefaultBrushes);
+    return pEngine->UpdateDrawingBrushes(textAttributes, _frame.renderSettings, _pData, usingSoftFont, isSettingDefaultBrushes);
 }
 
 // Routine Description:
@@ -1390,6 +1875,7 @@ void Renderer::_ScrollPreviousSelection(const til::point delta)
 void Renderer::AddRenderEngine(_In_ IRenderEngine* const pEngine)
 {
     THROW_HR_IF_NULL(E_INVALIDARG, pEngine);
+    const std::lock_guard paintLock{ _paintMutex };
 
     for (auto& p : _engines)
     {
@@ -1407,6 +1893,7 @@ void Renderer::AddRenderEngine(_In_ IRenderEngine* const pEngine)
 void Renderer::RemoveRenderEngine(_In_ IRenderEngine* const pEngine)
 {
     THROW_HR_IF_NULL(E_INVALIDARG, pEngine);
+    const std::lock_guard paintLock{ _paintMutex };
 
     for (auto& p : _engines)
     {
@@ -1463,6 +1950,13 @@ void Renderer::ResetErrorStateAndResume()
 void Renderer::UpdateHyperlinkHoveredId(uint16_t id) noexcept
 {
     _hyperlinkHoveredId = id;
+
+    if (_deferInvalidation)
+    {
+        _pendingInvalidation.hyperlinkHoveredId = id;
+        return;
+    }
+
     FOREACH_ENGINE(pEngine)
     {
         pEngine->UpdateHyperlinkHoveredId(id);
@@ -94,12 +94,68 @@ namespace Microsoft::Console::Render
             TextAttribute baseAttribute;
         };
 
+        // A run of cells within a row of the frame that share the same pattern IDs.
+        struct PatternRun
+        {
+            til::CoordType row = 0;
+            til::CoordType begin = 0;
+            til::CoordType end = 0;
+            std::vector<size_t> ids;
+        };
+
+        // A copy of everything the engines need to paint the dirty parts of a frame.
+        // It's captured by _CaptureFrame() while the console is locked, so that
+        // the text can then be painted without holding the console lock.
+        // Row 0 of the buffer corresponds to the top of the viewport.
+        struct FrameSnapshot
+        {
+            std::unique_ptr<TextBuffer> buffer;
+            Microsoft::Console::Types::Viewport view;
+            RenderSettings renderSettings;
+            std::vector<til::rect> selectionRects;
+            std::vector<til::point_span> searchHighlights;
+            std::optional<til::point_span> searchHighlightFocused;
+            std::vector<PatternRun> patterns;
+            std::optional<interval_tree::IntervalTree<til::point, size_t>::interval> hoveredInterval;
+            uint16_t hyperlinkHoveredId = 0;
+            bool gridLinesAllowed = false;
+        };
+
+        // Invalidations that arrive while the engines are painting without the console lock
+        // can't be forwarded to them right away. They're accumulated here instead and
+        // flushed by _FlushPendingInvalidation() once the frame has been completed.
+        struct PendingInvalidation
+        {
+            til::rect redraw; // in buffer coordinates
+            til::rect system;
+            til::point scrollDelta;
+            std::vector<til::point_span> oldHighlights;
+            std::wstring newText;
+            std::optional<uint16_t> hyperlinkHoveredId;
+            bool all = false;
+            bool scroll = false;
+            bool selection = false;
+            bool highlights = false;
+            bool title = false;
+        };
+
         static GridLineSet s_GetGridlines(const TextAttribute& textAttribute) noexcept;
         static bool s_IsSoftFontChar(const std::wstring_view& v, const size_t firstSoftFontChar, const size_t lastSoftFontChar);
 
         [[nodiscard]] HRESULT _PaintFrame() noexcept;
+        [[nodiscard]] HRESULT _PrepareFrameForEngine(_In_ IRenderEngine* const pEngine) noexcept;
         [[nodiscard]] HRESULT _PaintFrameForEngine(_In_ IRenderEngine* const pEngine) noexcept;
+        [[nodiscard]] HRESULT _EndFrameForEngine(_In_ IRenderEngine* const pEngine, const bool painted) noexcept;
+        [[nodiscard]] HRESULT _CaptureFrame() noexcept;
+        [[nodiscard]] HRESULT _CaptureFrameRows() noexcept;
+        void _FlushPendingInvalidation() noexcept;
+        void _InvalidateRegion(til::rect region);
+        void _InvalidateSelection();
+        void _InvalidateMutatedRows();
+        void _ScrollRowMutationIds(const til::CoordType delta) noexcept;
+        const std::vector<size_t>& _GetPatternIds(const til::point target) const noexcept;
         bool _CheckViewportAndScroll();
+        void _FlushPendingScroll();
         [[nodiscard]] HRESULT _PaintBackground(_In_ IRenderEngine* const pEngine);
         void _PaintBufferOutput(_In_ IRenderEngine* const pEngine);
         void _PaintBufferOutputHelper(_In_ IRenderEngine* const pEngine, TextBufferCellIterator it, const til::point target, const bool lineWrapped);
@@ -121,6 +177,7 @@ namespace Microsoft::Console::Render
 
         const RenderSettings& _renderSettings;
         std::array<IRenderEngine*, 2> _engines{};
+        std::array<IRenderEngine*, 2> _paintingEngines{};
         IRenderData* _pData = nullptr; // Non-ownership pointer
         std::unique_ptr<RenderThread> _pThread;
         static constexpr size_t _firstSoftFontChar = 0xEF20;
@@ -132,10 +189,22 @@ namespace Microsoft::Console::Render
         std::optional<CompositionCache> _compositionCache;
         std::vector<Cluster> _clusterBuffer;
         std::vector<til::rect> _previousSelection;
+        FrameSnapshot _frame;
+        PendingInvalidation _pendingInvalidation;
+        // The ROW::GetMutationId() of each viewport row as of the last frame. Rows whose ID
+        // changed since then are invalidated at the start of the next frame, which is how
+        // modifications of the text buffer reach the engines (see _InvalidateMutatedRows).
+        std::vector<uint64_t> _rowMutationIds;
+        // The sum of the TriggerScroll() deltas that haven't been forwarded to the engines yet.
+        til::point _pendingScrollDelta;
+        // Held while the engines paint without the console lock. Calls that modify
+        // the engines in ways that can't be deferred (like font changes) wait on it.
+        std::mutex _paintMutex;
         std::function<void()> _pfnBackgroundColorChanged;
         std::function<void()> _pfnFrameColorChanged;
         std::function<void()> _pfnRendererEnteredErrorState;
         bool _destructing = false;
         bool _forceUpdateViewport = false;
+        bool _deferInvalidation = false;
     };
 }
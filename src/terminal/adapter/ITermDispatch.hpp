@@ -23,7 +23,9 @@ namespace Microsoft::Console::VirtualTerminal
 class Microsoft::Console::VirtualTerminal::ITermDispatch
 {
 public:
-    using StringHandler = std::function<bool(const wchar_t)>;
+    // Receives the data string of a DCS sequence in chunks of arbitrary size, followed by a lone ESC
+    // once the string has ended. Returning false means that the rest of the string should be ignored.
+    using StringHandler = std::function<bool(const std::wstring_view)>;
 
 #pragma warning(push)
 #pragma warning(disable : 26432) // suppress rule of 5 violation on interface because tampering with this is fraught with peril
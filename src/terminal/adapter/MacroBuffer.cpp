@@ -113,7 +113,41 @@ bool MacroBuffer::InitParser(const size_t macroId, const DispatchTypes::MacroDel
     return false;
 }
 
-bool MacroBuffer::ParseDefinition(const wchar_t ch)
+bool MacroBuffer::ParseDefinition(const std::wstring_view data)
+{
+    for (size_t i = 0; i < data.size();)
+    {
+        // The content of text encoded macros is stored as is, which means that
+        // we can append entire runs of printable characters in one go.
+        if (_parseState == State::ExpectingText)
+        {
+            const auto text = data.substr(i);
+            const auto length = gsl::narrow_cast<size_t>(std::find_if(text.begin(), text.end(), [](const auto ch) { return ch < L' '; }) - text.begin());
+            if (length > 0)
+            {
+                // If there isn't enough space for all of it, the definition is
+                // invalid, and we clear everything received so far.
+                if (length > GetSpaceAvailable())
+                {
+                    _deleteMacro(_activeMacro());
+                    return false;
+                }
+                _activeMacro().append(text.substr(0, length));
+                _spaceUsed += length;
+                i += length;
+                continue;
+            }
+        }
+
+        if (!_parseDefinitionChar(til::at(data, i++)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MacroBuffer::_parseDefinitionChar(const wchar_t ch)
 {
     // Once we receive an ESC, that marks the end of the definition, but if
     // an unterminated repeat is still pending, we should apply that now.
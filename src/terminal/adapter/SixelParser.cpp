@@ -80,7 +80,7 @@ void SixelParser::SetDisplayMode(const bool enabled) noexcept
     }
 }
 
-std::function<bool(wchar_t)> SixelParser::DefineImage(const VTInt macroParameter, const DispatchTypes::SixelBackground backgroundSelect, const VTParameter backgroundColor)
+std::function<bool(std::wstring_view)> SixelParser::DefineImage(const VTInt macroParameter, const DispatchTypes::SixelBackground backgroundSelect, const VTParameter backgroundColor)
 {
     if (_initTextBufferBoundaries())
     {
@@ -89,8 +89,25 @@ std::function<bool(wchar_t)> SixelParser::DefineImage(const VTInt macroParameter
         _initImageBuffer();
         _state = States::Normal;
         _parameters.clear();
-        return [&](const auto ch) {
-            _parseCommandChar(ch);
+        return [&](const std::wstring_view string) {
+            const auto isSixelValue = [](const wchar_t ch) noexcept {
+                return ch >= L'?' && ch <= L'~';
+            };
+            for (auto it = string.begin(); it != string.end();)
+            {
+                // Runs of sixel values with no pending command in front of them
+                // make up the bulk of any image, so we decode those in one go.
+                if (_state == States::Normal && isSixelValue(*it))
+                {
+                    const auto runEnd = std::find_if_not(it, string.end(), isSixelValue);
+                    _writeToImageBuffer(std::wstring_view{ it, runEnd });
+                    it = runEnd;
+                }
+                else
+                {
+                    _parseCommandChar(*it++);
+                }
+            }
             return true;
         };
     }
@@ -710,6 +727,52 @@ void SixelParser::_writeToImageBuffer(int sixelValue, int repeatCount)
     _imageCursor.x += repeatCount;
 }
 
+void SixelParser::_writeToImageBuffer(const std::wstring_view sixelValues)
+{
+    _fillImageBackground();
+
+    // This is equivalent to calling the method above for each of the values
+    // with a repeat count of 1, but rather than writing one 6-pixel column at a
+    // time, we write the whole run one pixel row at a time. That keeps the
+    // writes sequential, and the inner loop simple enough to be vectorized.
+    const auto availableWidth = gsl::narrow_cast<size_t>(_imageMaxWidth - _imageCursor.x);
+    const auto count = gsl::narrow_cast<til::CoordType>(std::min(sixelValues.size(), availableWidth));
+    const auto srcIterator = sixelValues.begin();
+
+    // Any pixel row that isn't set in any of the values can be skipped.
+    auto bitsUsed = 0;
+    for (auto i = 0; i < count; i++)
+    {
+        bitsUsed |= til::at(srcIterator, i) - L'?';
+    }
+
+    const auto foregroundPixel = _foregroundPixel;
+    const auto targetOffset = _imageCursor.y * _imageMaxWidth + _imageCursor.x;
+    auto imageBufferPtr = std::next(_imageBuffer.data(), targetOffset);
+    for (auto bit = 1; bit < 0x40; bit <<= 1)
+    {
+        if (bitsUsed & bit)
+        {
+            for (auto i = 0; i < _pixelAspectRatio; i++)
+            {
+                for (auto j = 0; j < count; j++)
+                {
+                    if ((til::at(srcIterator, j) - L'?') & bit)
+                    {
+                        til::at(imageBufferPtr, j) = foregroundPixel;
+                    }
+                }
+                std::advance(imageBufferPtr, _imageMaxWidth);
+            }
+        }
+        else
+        {
+            std::advance(imageBufferPtr, _imageMaxWidth * _pixelAspectRatio);
+        }
+    }
+    _imageCursor.x += count;
+}
+
 void SixelParser::_eraseImageBufferRows(const int rowCount, const til::CoordType rowOffset) noexcept
 {
     const auto pixelCount = rowCount * _cellSize.height;
@@ -771,6 +834,11 @@ void SixelParser::_maybeFlushImageBuffer(const bool endOfSequence)
         // so the only visible change will be the scrolling.
         if (_imageWidth > 0)
         {
+            // The color table can't change while we're flushing, so we convert
+            // it up front, and each pixel is then just a lookup into the table.
+            std::array<RGBQUAD, MAX_COLORS> palette = {};
+            std::transform(_colorTable.begin(), _colorTable.end(), palette.begin(), _makeRGBQUAD);
+
             const auto columnBegin = _imageOriginCell.x;
             const auto columnEnd = _imageOriginCell.x + (_imageWidth + _cellSize.width - 1) / _cellSize.width;
             auto rowOffset = _imageOriginCell.y;
@@ -794,8 +862,7 @@ void SixelParser::_maybeFlushImageBuffer(const bool endOfSequence)
                             const auto srcPixel = til::at(srcIterator, pixelColumn);
                             if (!srcPixel.transparent)
                             {
-                                const auto srcColor = _colorFromIndex(srcPixel.colorIndex);
-                                til::at(dstIterator, pixelColumn) = _makeRGBQUAD(srcColor);
+                                til::at(dstIterator, pixelColumn) = til::at(palette, srcPixel.colorIndex);
                             }
                         }
                         std::advance(srcIterator, _imageMaxWidth);
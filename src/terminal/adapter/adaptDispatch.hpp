@@ -272,6 +272,23 @@ namespace Microsoft::Console::VirtualTerminal
         void _ClearAllTabStops() noexcept;
         void _InitTabStopsForWidth(const VTInt width);
 
+        // Adapts a lambda that parses a data string one character at a time to the StringHandler
+        // interface, which receives the string in chunks. The lambda returns false to stop parsing.
+        template<typename TLambda>
+        static StringHandler _CharacterHandler(TLambda&& lambda)
+        {
+            return [lambda = std::forward<TLambda>(lambda)](const std::wstring_view string) mutable {
+                for (const auto ch : string)
+                {
+                    if (!lambda(ch))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            };
+        }
+
         StringHandler _RestoreColorTable();
 
         void _ReportSGRSetting() const;
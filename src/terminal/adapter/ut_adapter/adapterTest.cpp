@@ -8,6 +8,7 @@
 #include "../../../renderer/inc/DummyRenderer.hpp"
 
 #include "adaptDispatch.hpp"
+#include "SixelParser.hpp"
 
 using namespace WEX::Common;
 using namespace WEX::Logging;
@@ -1846,11 +1847,8 @@ public:
     {
         const auto requestSetting = [=](const std::wstring_view settingId = {}) {
             const auto stringHandler = _pDispatch->RequestSetting();
-            for (auto ch : settingId)
-            {
-                stringHandler(ch);
-            }
-            stringHandler(L'\033'); // String terminator
+            stringHandler(settingId);
+            stringHandler(L"\033"); // String terminator
         };
 
         Log::Comment(L"Requesting DECSTBM margins (5 to 10).");
@@ -2941,11 +2939,8 @@ public:
             RETURN_BOOL_IF_FALSE(fontBuffer.SetAttributes(cellMatrix, cmh, ss, u));
             RETURN_BOOL_IF_FALSE(fontBuffer.SetStartChar(0, DispatchTypes::CharsetSize::Size94));
 
-            fontBuffer.AddSixelData(L'B'); // Charset identifier
-            for (auto ch : data)
-            {
-                fontBuffer.AddSixelData(ch);
-            }
+            fontBuffer.AddSixelData(L"B"); // Charset identifier
+            fontBuffer.AddSixelData(data);
             RETURN_BOOL_IF_FALSE(fontBuffer.FinalizeSixelData());
 
             const auto cellSize = fontBuffer.GetCellSize();
@@ -3186,11 +3181,8 @@ public:
     {
         const auto assignCharset = [=](const auto charsetSize, const std::wstring_view charsetId = {}) {
             const auto stringHandler = _pDispatch->AssignUserPreferenceCharset(charsetSize);
-            for (auto ch : charsetId)
-            {
-                stringHandler(ch);
-            }
-            stringHandler(L'\033'); // String terminator
+            stringHandler(charsetId);
+            stringHandler(L"\033"); // String terminator
         };
         auto& termOutput = _pDispatch->_termOutput;
         termOutput.SoftReset();
@@ -3602,6 +3594,75 @@ public:
         _pDispatch->PagePositionAbsolute(1);
     }
 
+    TEST_METHOD(SixelDecoding)
+    {
+        // Sixel values that arrive in a run are written to the image buffer in
+        // bulk, while values preceded by a repeat count are written one at a
+        // time. Both paths should produce exactly the same image.
+        using ImageRows = std::vector<std::tuple<til::CoordType, til::CoordType, std::vector<uint32_t>>>;
+        const auto decode = [&](const std::wstring_view introducer, const std::wstring_view data) {
+            _testGetSet->PrepData(CursorX::LEFT, CursorY::TOP);
+            _stateMachine->ProcessString(introducer);
+            _stateMachine->ProcessString(data);
+            _stateMachine->ProcessString(L"\033\\");
+
+            auto imageRows = ImageRows{};
+            const auto& textBuffer = *_testGetSet->_textBuffer;
+            const auto height = textBuffer.GetSize().Height();
+            for (auto y = 0; y < height; y++)
+            {
+                if (const auto imageSlice = textBuffer.GetRowByOffset(y).GetImageSlice())
+                {
+                    auto pixels = std::vector<uint32_t>{};
+                    for (const auto pixel : imageSlice->Pixels())
+                    {
+                        pixels.push_back(std::bit_cast<uint32_t>(pixel));
+                    }
+                    imageRows.emplace_back(y, imageSlice->ColumnOffset(), std::move(pixels));
+                }
+            }
+            return imageRows;
+        };
+        const auto separate = [](const std::wstring_view run) {
+            auto separated = std::wstring{};
+            for (const auto ch : run)
+            {
+                separated += L"!1";
+                separated += ch;
+            }
+            return separated;
+        };
+
+        // The cursor starts in the leftmost column, so the image can extend
+        // across the full width of the page. The first run starts a little
+        // before that limit, so part of it will need to be clipped.
+        _testGetSet->PrepData(CursorX::LEFT, CursorY::TOP);
+        const auto maxWidth = _pDispatch->_pages.ActivePage().Width() * SixelParser::CellSizeForLevel().width;
+        const auto offset = fmt::format(L"!{}?", maxWidth - 10);
+        const auto run1 = std::wstring_view{ L"~^NFBA@?_ow{}~~@A~NN^~??@@{{" };
+        const auto run2 = std::wstring_view{ L"?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~" };
+        const auto run3 = std::wstring_view{ L"~}|{zyxwvutsrqponmlkjihgfedcba`_" };
+        const auto colors = std::wstring_view{ L"#1;2;100;0;0#2;2;0;100;0#3;2;0;0;100" };
+
+        const auto runData = fmt::format(L"{}#1{}{}$#2{}-#3{}", colors, offset, run1, run2, run3);
+        const auto separatedData = fmt::format(L"{}#1{}{}$#2{}-#3{}", colors, offset, separate(run1), separate(run2), separate(run3));
+
+        Log::Comment(L"Default aspect ratio of 2:1");
+        auto expected = decode(L"\033Pq", separatedData);
+        VERIFY_IS_FALSE(expected.empty());
+        VERIFY_IS_TRUE(expected == decode(L"\033Pq", runData));
+
+        Log::Comment(L"Aspect ratio of 5:1");
+        expected = decode(L"\033P2q", separatedData);
+        VERIFY_IS_FALSE(expected.empty());
+        VERIFY_IS_TRUE(expected == decode(L"\033P2q", runData));
+
+        Log::Comment(L"Aspect ratio of 1:1");
+        expected = decode(L"\033Pq\"1;1", separatedData);
+        VERIFY_IS_FALSE(expected.empty());
+        VERIFY_IS_TRUE(expected == decode(L"\033Pq\"1;1", runData));
+    }
+
 private:
     TerminalInput _terminalInput;
     std::unique_ptr<TestGetSet> _testGetSet;
@@ -371,6 +371,73 @@ static constexpr bool _isApcIndicator(const wchar_t wch) noexcept
 
 #pragma warning(pop)
 
+// All of the CSI states classify a character the same way, so instead of testing each
+// character against a chain of the predicates above, its class is looked up in a table.
+// The table is derived from those predicates, which keeps the two in agreement.
+// CAN, SUB and ESC are classified as final characters here, but those are handled
+// before any of the CSI states get to see them (see ProcessCharacter).
+enum class CsiCharClass : uint8_t
+{
+    Execute, // C0 control characters
+    Ignore, // DEL
+    Intermediate, // 0x20 - 0x2F
+    Digit, // 0x30 - 0x39
+    SubParameterDelimiter, // 0x3A
+    ParameterDelimiter, // 0x3B
+    PrivateMarker, // 0x3C - 0x3F
+    Final, // Everything else
+};
+
+static constexpr auto s_csiCharClasses = []() {
+    std::array<CsiCharClass, 128> classes{};
+    for (size_t i = 0; i < classes.size(); i++)
+    {
+        const auto wch = static_cast<wchar_t>(i);
+        auto charClass = CsiCharClass::Final;
+        if (_isC0Code(wch))
+        {
+            charClass = CsiCharClass::Execute;
+        }
+        else if (_isDelete(wch))
+        {
+            charClass = CsiCharClass::Ignore;
+        }
+        else if (_isIntermediate(wch))
+        {
+            charClass = CsiCharClass::Intermediate;
+        }
+        else if (_isNumericParamValue(wch))
+        {
+            charClass = CsiCharClass::Digit;
+        }
+        else if (_isSubParameterDelimiter(wch))
+        {
+            charClass = CsiCharClass::SubParameterDelimiter;
+        }
+        else if (_isParameterDelimiter(wch))
+        {
+            charClass = CsiCharClass::ParameterDelimiter;
+        }
+        else if (_isCsiPrivateMarker(wch))
+        {
+            charClass = CsiCharClass::PrivateMarker;
+        }
+        til::at(classes, i) = charClass;
+    }
+    return classes;
+}();
+
+// Routine Description:
+// - Determines the class of a character in one of the CSI states.
+// Arguments:
+// - wch - Character to check.
+// Return Value:
+// - The class of the character. Anything outside of ASCII is a final character.
+static constexpr CsiCharClass _csiCharClass(const wchar_t wch) noexcept
+{
+    return wch < s_csiCharClasses.size() ? til::at(s_csiCharClasses, wch) : CsiCharClass::Final;
+}
+
 // Routine Description:
 // - Triggers the Execute action to indicate that the listener should immediately respond to a C0 control character.
 // Arguments:
@@ -654,7 +721,7 @@ void StateMachine::_ActionInterrupt()
     if (_state == VTStates::DcsPassThrough)
     {
         // The ESC signals the end of the data string.
-        _dcsStringHandler(AsciiChars::ESC);
+        _dcsStringHandler(L"\x1b");
         _dcsStringHandler = nullptr;
     }
 }
@@ -1218,39 +1285,36 @@ void StateMachine::_EventEscapeIntermediate(const wchar_t wch)
 void StateMachine::_EventCsiEntry(const wchar_t wch)
 {
     _trace.TraceOnEvent(L"CsiEntry");
-    if (_isC0Code(wch))
+    switch (_csiCharClass(wch))
     {
+    case CsiCharClass::Execute:
         _ActionExecute(wch);
-    }
-    else if (_isDelete(wch))
-    {
+        break;
+    case CsiCharClass::Ignore:
         _ActionIgnore();
-    }
-    else if (_isIntermediate(wch))
-    {
+        break;
+    case CsiCharClass::Intermediate:
         _ActionCollect(wch);
         _EnterCsiIntermediate();
-    }
-    else if (_isNumericParamValue(wch) || _isParameterDelimiter(wch))
-    {
+        break;
+    case CsiCharClass::Digit:
+    case CsiCharClass::ParameterDelimiter:
         _ActionParam(wch);
         _EnterCsiParam();
-    }
-    else if (_isSubParameterDelimiter(wch))
-    {
+        break;
+    case CsiCharClass::SubParameterDelimiter:
         _ActionSubParam(wch);
         _EnterCsiSubParam();
-    }
-    else if (_isCsiPrivateMarker(wch))
-    {
+        break;
+    case CsiCharClass::PrivateMarker:
         _ActionCollect(wch);
         _EnterCsiParam();
-    }
-    else
-    {
+        break;
+    default:
         _ActionCsiDispatch(wch);
         _EnterGround();
         _ExecuteCsiCompleteCallback();
+        break;
     }
 }
 
@@ -1269,27 +1333,28 @@ void StateMachine::_EventCsiEntry(const wchar_t wch)
 void StateMachine::_EventCsiIntermediate(const wchar_t wch)
 {
     _trace.TraceOnEvent(L"CsiIntermediate");
-    if (_isC0Code(wch))
+    switch (_csiCharClass(wch))
     {
+    case CsiCharClass::Execute:
         _ActionExecute(wch);
-    }
-    else if (_isIntermediate(wch))
-    {
+        break;
+    case CsiCharClass::Intermediate:
         _ActionCollect(wch);
-    }
-    else if (_isDelete(wch))
-    {
+        break;
+    case CsiCharClass::Ignore:
         _ActionIgnore();
-    }
-    else if (_isIntermediateInvalid(wch))
-    {
+        break;
+    case CsiCharClass::Digit:
+    case CsiCharClass::SubParameterDelimiter:
+    case CsiCharClass::ParameterDelimiter:
+    case CsiCharClass::PrivateMarker:
         _EnterCsiIgnore();
-    }
-    else
-    {
+        break;
+    default:
         _ActionCsiDispatch(wch);
         _EnterGround();
         _ExecuteCsiCompleteCallback();
+        break;
     }
 }
 
@@ -1308,25 +1373,17 @@ void StateMachine::_EventCsiIntermediate(const wchar_t wch)
 void StateMachine::_EventCsiIgnore(const wchar_t wch)
 {
     _trace.TraceOnEvent(L"CsiIgnore");
-    if (_isC0Code(wch))
+    switch (_csiCharClass(wch))
     {
+    case CsiCharClass::Execute:
         _ActionExecute(wch);
-    }
-    else if (_isDelete(wch))
-    {
-        _ActionIgnore();
-    }
-    else if (_isIntermediate(wch))
-    {
-        _ActionIgnore();
-    }
-    else if (_isIntermediateInvalid(wch))
-    {
-        _ActionIgnore();
-    }
-    else
-    {
+        break;
+    case CsiCharClass::Final:
         _EnterGround();
+        break;
+    default:
+        _ActionIgnore();
+        break;
     }
 }
 
@@ -1347,37 +1404,34 @@ void StateMachine::_EventCsiIgnore(const wchar_t wch)
 void StateMachine::_EventCsiParam(const wchar_t wch)
 {
     _trace.TraceOnEvent(L"CsiParam");
-    if (_isC0Code(wch))
+    switch (_csiCharClass(wch))
     {
+    case CsiCharClass::Execute:
         _ActionExecute(wch);
-    }
-    else if (_isDelete(wch))
-    {
+        break;
+    case CsiCharClass::Ignore:
         _ActionIgnore();
-    }
-    else if (_isNumericParamValue(wch) || _isParameterDelimiter(wch))
-    {
+        break;
+    case CsiCharClass::Digit:
+    case CsiCharClass::ParameterDelimiter:
         _ActionParam(wch);
-    }
-    else if (_isSubParameterDelimiter(wch))
-    {
+        break;
+    case CsiCharClass::SubParameterDelimiter:
         _ActionSubParam(wch);
         _EnterCsiSubParam();
-    }
-    else if (_isIntermediate(wch))
-    {
+        break;
+    case CsiCharClass::Intermediate:
         _ActionCollect(wch);
         _EnterCsiIntermediate();
-    }
-    else if (_isParameterInvalid(wch))
-    {
+        break;
+    case CsiCharClass::PrivateMarker:
         _EnterCsiIgnore();
-    }
-    else
-    {
+        break;
+    default:
         _ActionCsiDispatch(wch);
         _EnterGround();
         _ExecuteCsiCompleteCallback();
+        break;
     }
 }
 
@@ -1398,37 +1452,34 @@ void StateMachine::_EventCsiParam(const wchar_t wch)
 void StateMachine::_EventCsiSubParam(const wchar_t wch)
 {
     _trace.TraceOnEvent(L"CsiSubParam");
-    if (_isC0Code(wch))
+    switch (_csiCharClass(wch))
     {
+    case CsiCharClass::Execute:
         _ActionExecute(wch);
-    }
-    else if (_isDelete(wch))
-    {
+        break;
+    case CsiCharClass::Ignore:
         _ActionIgnore();
-    }
-    else if (_isNumericParamValue(wch) || _isSubParameterDelimiter(wch))
-    {
+        break;
+    case CsiCharClass::Digit:
+    case CsiCharClass::SubParameterDelimiter:
         _ActionSubParam(wch);
-    }
-    else if (_isParameterDelimiter(wch))
-    {
+        break;
+    case CsiCharClass::ParameterDelimiter:
         _ActionParam(wch);
         _EnterCsiParam();
-    }
-    else if (_isIntermediate(wch))
-    {
+        break;
+    case CsiCharClass::Intermediate:
         _ActionCollect(wch);
         _EnterCsiIntermediate();
-    }
-    else if (_isParameterInvalid(wch))
-    {
+        break;
+    case CsiCharClass::PrivateMarker:
         _EnterCsiIgnore();
-    }
-    else
-    {
+        break;
+    default:
         _ActionCsiDispatch(wch);
         _EnterGround();
         _ExecuteCsiCompleteCallback();
+        break;
     }
 }
 
@@ -1788,6 +1839,23 @@ void StateMachine::_EventDcsParam(const wchar_t wch)
     }
 }
 
+// Routine Description:
+// - Passes a part of the data string of a DCS sequence to the handler that was returned
+//   by the engine. If the handler doesn't want any more data, the rest is ignored.
+// Arguments:
+// - string - The characters to pass through.
+// Return Value:
+// - <none>
+void StateMachine::_ActionDcsPassThrough(const std::wstring_view string)
+{
+    _trace.TraceOnAction(L"DcsPassThrough");
+
+    if (!_dcsStringHandler(string))
+    {
+        _EnterDcsIgnore();
+    }
+}
+
 // Routine Description:
 // - Processes a character event into an Action that occurs while in the DcsPassThrough state.
 //   Events in this state will:
@@ -1803,10 +1871,7 @@ void StateMachine::_EventDcsPassThrough(const wchar_t wch)
     _trace.TraceOnEvent(L"DcsPassThrough");
     if (_isC0Code(wch) || _isDcsPassThroughValid(wch))
     {
-        if (!_dcsStringHandler(wch))
-        {
-            _EnterDcsIgnore();
-        }
+        _ActionDcsPassThrough({ &wch, 1 });
     }
     else
     {
@@ -2017,6 +2082,39 @@ void StateMachine::ProcessString(const std::wstring_view string)
 
         do
         {
+            // We only get here in the ground state when the printable run above has ended at
+            // a control character, which is usually the start of a control sequence.
+            if (_state == VTStates::Ground)
+            {
+                const auto len = _ParseCsiFastPath(string.substr(i));
+                if (len)
+                {
+                    _runSize += len;
+                    i += len;
+                    _processingLastCharacter = i >= string.size();
+                    _ActionCsiDispatchFromGround(til::at(string, i - 1));
+                    continue;
+                }
+            }
+
+            // DCS data strings like sixel images or soft fonts can be megabytes long and consist almost
+            // entirely of printable ASCII, which is passed through as-is. Instead of feeding such runs
+            // to ProcessCharacter() one by one, they're handed to the string handler all at once.
+            if (_state == VTStates::DcsPassThrough)
+            {
+#pragma warning(suppress : 26481) // Don't use pointer arithmetic. Use span instead (bounds.1).)
+                const auto beg = string.data() + i;
+                const auto len = gsl::narrow_cast<size_t>(Microsoft::Console::Utils::FindNonPrintableAscii(beg, string.size() - i) - beg);
+                if (len)
+                {
+                    _runSize += len;
+                    i += len;
+                    _processingLastCharacter = i >= string.size();
+                    _ActionDcsPassThrough({ beg, len });
+                    continue;
+                }
+            }
+
             _runSize++;
             _processingLastCharacter = i + 1 >= string.size();
             // If we're processing characters individually, send it to the state machine.
@@ -2086,6 +2184,99 @@ void StateMachine::ProcessString(const std::wstring_view string)
     }
 }
 
+// Routine Description:
+// - A fast path for the control sequences that make up most of the output of TUIs:
+//   CSI sequences with nothing but numeric parameters and a final character, like
+//   SGR, CUP, EL and ED. If the given string starts with such a sequence in its
+//   entirety, its parameters are parsed directly into _parameters, skipping the
+//   per-character trips through ProcessCharacter and the CSI states. Anything
+//   else (sub parameters, private markers, intermediates, embedded controls,
+//   too many parameters, or an incomplete sequence) is left to the state machine.
+// - The caller must be in the ground state, and must dispatch the sequence with
+//   _ActionCsiDispatchFromGround() if this returns a non-zero length.
+// Arguments:
+// - string - The remaining input, which is expected to start with ESC.
+// Return Value:
+// - The length of the sequence, or 0 if it needs to go through the state machine.
+size_t StateMachine::_ParseCsiFastPath(const std::wstring_view string)
+{
+    if (_isEngineForInput || !_parserMode.test(Mode::Ansi) || string.size() < 3 || til::at(string, 0) != AsciiChars::ESC || til::at(string, 1) != L'[')
+    {
+        return 0;
+    }
+
+    // This is what entering the Escape and CsiEntry states would do. If we bail
+    // out below, the state machine will simply do it again.
+    _ActionClear();
+    _trace.ClearSequenceTrace();
+
+    VTInt value = 0;
+    auto hasValue = false;
+    auto hasParameters = false;
+    size_t i = 2;
+    for (; i < string.size(); ++i)
+    {
+        const auto ch = til::at(string, i);
+        const auto digit = static_cast<unsigned int>(ch) - '0';
+        if (digit <= 9)
+        {
+            // Same as _AccumulateTo(), which clamps after every digit.
+            value = std::min(value * 10 + gsl::narrow_cast<VTInt>(digit), MAX_PARAMETER_VALUE);
+            hasValue = true;
+        }
+        else if (ch == L';')
+        {
+            // The state machine would ignore any parameters past the limit.
+            // That's rare enough that we don't bother handling it here.
+            if (_parameters.size() + 1 >= MAX_PARAMETER_COUNT)
+            {
+                return 0;
+            }
+            _parameters.emplace_back(hasValue ? VTParameter{ value } : VTParameter{});
+            value = 0;
+            hasValue = false;
+        }
+        else
+        {
+            break;
+        }
+        hasParameters = true;
+    }
+
+    if (i >= string.size())
+    {
+        return 0;
+    }
+
+    const auto ch = til::at(string, i);
+    if (ch < L'@' || ch > L'~')
+    {
+        return 0;
+    }
+
+    if (hasParameters)
+    {
+        _parameters.emplace_back(hasValue ? VTParameter{ value } : VTParameter{});
+    }
+    // There are no sub parameters, so every parameter gets an empty range.
+    _subParameterRanges.resize(_parameters.size());
+    return i + 1;
+}
+
+// Routine Description:
+// - Dispatches a sequence that was parsed by _ParseCsiFastPath(), exactly as
+//   the CSI states would have done it, and returns to the ground state.
+// Arguments:
+// - wch - The final character of the sequence.
+// Return Value:
+// - <none>
+void StateMachine::_ActionCsiDispatchFromGround(const wchar_t wch)
+{
+    _ActionCsiDispatch(wch);
+    _EnterGround();
+    _ExecuteCsiCompleteCallback();
+}
+
 // Routine Description:
 // - Determines whether the character being processed is the last in the
 //   current output fragment, or there are more still to come. Other parts
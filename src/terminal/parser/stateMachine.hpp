@@ -115,6 +115,7 @@ namespace Microsoft::Console::VirtualTerminal
         void _ActionOscDispatch();
         void _ActionSs3Dispatch(const wchar_t wch);
         void _ActionDcsDispatch(const wchar_t wch);
+        void _ActionDcsPassThrough(const std::wstring_view string);
 
         void _ActionClear();
         void _ActionIgnore() noexcept;
@@ -164,6 +165,9 @@ namespace Microsoft::Console::VirtualTerminal
 
         void _AccumulateTo(const wchar_t wch, VTInt& value) noexcept;
 
+        size_t _ParseCsiFastPath(const std::wstring_view string);
+        void _ActionCsiDispatchFromGround(const wchar_t wch);
+
         template<typename TLambda>
         bool _SafeExecute(TLambda&& lambda);
 
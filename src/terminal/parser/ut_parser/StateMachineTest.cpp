@@ -38,6 +38,7 @@ public:
         dcsId = 0;
         dcsParams.clear();
         dcsDataString.clear();
+        dcsDataChunks.clear();
     }
 
     bool EncounteredWin32InputModeSequence() const noexcept override
@@ -113,7 +114,12 @@ public:
             dcsParams.push_back(parameters.at(i).value_or(0));
         }
         dcsDataString.clear();
-        return [=](const auto ch) { dcsDataString += ch; return true; };
+        dcsDataChunks.clear();
+        return [=](const auto string) {
+            dcsDataString += string;
+            dcsDataChunks.emplace_back(string);
+            return true;
+        };
     }
 
     // These will only be populated if ActionCsiDispatch is called.
@@ -136,6 +142,7 @@ public:
     uint64_t dcsId = 0;
     std::vector<size_t> dcsParams;
     std::wstring dcsDataString;
+    std::vector<std::wstring> dcsDataChunks;
 };
 
 class Microsoft::Console::VirtualTerminal::StateMachineTest
@@ -160,6 +167,8 @@ class Microsoft::Console::VirtualTerminal::StateMachineTest
     TEST_METHOD(PassThroughUnhandledSplitAcrossWrites);
 
     TEST_METHOD(DcsDataStringsReceivedByHandler);
+    TEST_METHOD(DcsDataStringsReceivedInBulk);
+    TEST_METHOD(SimpleCsiSequencesMatchStateMachine);
 
     TEST_METHOD(VtParameterSubspanTest);
 };
@@ -343,6 +352,92 @@ void StateMachineTest::DcsDataStringsReceivedByHandler()
     VERIFY_ARE_EQUAL(expectedExecuted, engine.executed);
 }
 
+void StateMachineTest::DcsDataStringsReceivedInBulk()
+{
+    auto enginePtr{ std::make_unique<TestStateMachineEngine>() };
+    // this dance is required because StateMachine presumes to take ownership of its engine.
+    auto& engine{ *enginePtr.get() };
+    StateMachine machine{ std::move(enginePtr) };
+
+    // Runs of printable ASCII are passed to the handler at once, other control
+    // characters individually, and the end of the string is signaled with an ESC.
+    // Characters that aren't valid in a data string are dropped.
+    const std::vector<std::wstring> expected{ L"#0;2;0;0;0#0!10~-", L"\n", L"~~", L"@", L"\033" };
+
+    Log::Comment(L"Single write");
+    machine.ProcessString(L"\033Pq#0;2;0;0;0#0!10~-\n~~\x00e9@\033\\");
+    VERIFY_ARE_EQUAL(VTID("q"), engine.dcsId);
+    VERIFY_IS_TRUE(expected == engine.dcsDataChunks);
+
+    Log::Comment(L"Split across writes");
+    machine.ProcessString(L"\033Pq#0;2;0;0;0#0!10~-\n~");
+    machine.ProcessString(L"~\x00e9@\033\\");
+    const std::vector<std::wstring> split{ L"#0;2;0;0;0#0!10~-", L"\n", L"~", L"~", L"@", L"\033" };
+    VERIFY_IS_TRUE(split == engine.dcsDataChunks);
+}
+
+void StateMachineTest::SimpleCsiSequencesMatchStateMachine()
+{
+    auto enginePtr{ std::make_unique<TestStateMachineEngine>() };
+    // this dance is required because StateMachine presumes to take ownership of its engine.
+    auto& engine{ *enginePtr.get() };
+    StateMachine machine{ std::move(enginePtr) };
+
+    struct TestCase
+    {
+        std::wstring_view sequence;
+        uint64_t id;
+        std::vector<size_t> parameters;
+        std::wstring executed;
+    };
+
+    // The first half is handled by the fast path in ProcessString, the second
+    // half has to fall back to the state machine. Both must give the same result.
+    const std::vector<TestCase> testCases{
+        { L"\x1b[m", VTID("m"), {}, L"" },
+        { L"\x1b[1;31m", VTID("m"), { 1, 31 }, L"" },
+        { L"\x1b[;5H", VTID("H"), { 0, 5 }, L"" },
+        { L"\x1b[12;;K", VTID("K"), { 12, 0, 0 }, L"" },
+        { L"\x1b[99999J", VTID("J"), { 65535 }, L"" },
+        { L"\x1b[38:2::1:2:3m", VTID("m"), { 38 }, L"" },
+        { L"\x1b[?25h", VTID("?h"), { 25 }, L"" },
+        { L"\x1b[2 q", VTID(" q"), { 2 }, L"" },
+        { L"\x1b[1\n2J", VTID("J"), { 12 }, L"\n" },
+    };
+
+    for (const auto& testCase : testCases)
+    {
+        const auto text = std::wstring{ L"a" }.append(testCase.sequence).append(L"b");
+
+        Log::Comment(NoThrowString().Format(L"Sequence: %s", text.c_str()));
+        engine.ResetTestState();
+        machine.ProcessString(text);
+        VERIFY_ARE_EQUAL(testCase.id, engine.csiId);
+        VERIFY_ARE_EQUAL(testCase.parameters, engine.csiParams);
+        VERIFY_ARE_EQUAL(testCase.executed, engine.executed);
+        VERIFY_ARE_EQUAL(L"ab", engine.printed);
+    }
+
+    Log::Comment(L"Too many parameters");
+    engine.ResetTestState();
+    std::wstring text = L"\x1b[";
+    for (auto i = 0; i < 40; i++)
+    {
+        text += L"1;";
+    }
+    text += L"m";
+    machine.ProcessString(text);
+    VERIFY_ARE_EQUAL(VTID("m"), engine.csiId);
+    VERIFY_ARE_EQUAL(MAX_PARAMETER_COUNT, engine.csiParams.size());
+
+    Log::Comment(L"Split across writes");
+    engine.ResetTestState();
+    machine.ProcessString(L"\x1b[1;3");
+    machine.ProcessString(L"1m");
+    VERIFY_ARE_EQUAL(VTID("m"), engine.csiId);
+    VERIFY_ARE_EQUAL((std::vector<size_t>{ 1u, 31u }), engine.csiParams);
+}
+
 void StateMachineTest::VtParameterSubspanTest()
 {
     const auto parameterList = std::vector<VTParameter>{ 12, 34, 56, 78 };
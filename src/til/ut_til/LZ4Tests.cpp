@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "precomp.h"
+
+#include <til/lz4.h>
+
+using namespace WEX::Common;
+using namespace WEX::Logging;
+using namespace WEX::TestExecution;
+
+class LZ4Tests
+{
+    TEST_CLASS(LZ4Tests);
+
+    static std::span<const uint8_t> bytes(const std::string_view& str) noexcept
+    {
+        return { reinterpret_cast<const uint8_t*>(str.data()), str.size() };
+    }
+
+    static void roundtrip(const std::span<const uint8_t> input)
+    {
+        std::vector<uint8_t> compressed;
+        til::lz4::compress(input, compressed);
+
+        std::vector<uint8_t> decompressed(input.size());
+        VERIFY_IS_TRUE(til::lz4::decompress(compressed, decompressed));
+        VERIFY_IS_TRUE(std::ranges::equal(input, decompressed));
+    }
+
+    TEST_METHOD(DecompressReference)
+    {
+        // Produced by the reference implementation (lz4 -l) from the string below.
+        static constexpr std::array<uint8_t, 17> compressed{
+            0x6f, 0x68, 0x65, 0x6c, 0x6c, 0x6f, 0x20, 0x06, 0x00, 0x05, 0x60, 0x77, 0x6f, 0x72, 0x6c, 0x64, 0x21
+        };
+        static constexpr std::string_view expected{ "hello hello hello hello hello world!" };
+
+        std::string actual(expected.size(), '\0');
+        VERIFY_IS_TRUE(til::lz4::decompress(compressed, { reinterpret_cast<uint8_t*>(actual.data()), actual.size() }));
+        VERIFY_ARE_EQUAL(expected, actual);
+    }
+
+    TEST_METHOD(Roundtrip)
+    {
+        roundtrip({});
+        roundtrip(bytes("a"));
+        roundtrip(bytes("hello hello hello hello hello world!"));
+
+        // Long runs need length continuation bytes and overlapping matches.
+        std::vector<uint8_t> run(100000, 'x');
+        roundtrip(run);
+
+        // Mostly incompressible data.
+        std::vector<uint8_t> noise(100000);
+        uint32_t state = 1;
+        for (auto& b : noise)
+        {
+            state = state * 1664525 + 1013904223;
+            b = static_cast<uint8_t>(state >> 24);
+        }
+        roundtrip(noise);
+
+        std::vector<uint8_t> compressed;
+        til::lz4::compress(run, compressed);
+        VERIFY_IS_LESS_THAN(compressed.size(), 1000u);
+    }
+
+    TEST_METHOD(RejectsMalformedInput)
+    {
+        std::vector<uint8_t> compressed;
+        til::lz4::compress(bytes("hello hello hello hello hello world!"), compressed);
+
+        std::array<uint8_t, 36> output{};
+        // Any output size other than the original one must fail.
+        VERIFY_IS_FALSE(til::lz4::decompress(compressed, std::span{ output }.first(35)));
+        VERIFY_IS_FALSE(til::lz4::decompress(compressed, std::span{ output }.first(0)));
+        // So must truncated input.
+        for (size_t i = 0; i < compressed.size(); ++i)
+        {
+            VERIFY_IS_FALSE(til::lz4::decompress(std::span{ compressed }.first(i), output));
+        }
+
+        // An offset pointing before the start of the output.
+        static constexpr std::array<uint8_t, 9> badOffset{ 0x10, 'a', 0x02, 0x00, 0x50, 'a', 'a', 'a', 'a' };
+        VERIFY_IS_FALSE(til::lz4::decompress(badOffset, output));
+    }
+};
@@ -17,6 +17,9 @@ class Utf8Utf16ConvertTests
     TEST_METHOD(TestU8ToU16Partials);
     TEST_METHOD(TestU16ToU8Partials);
     TEST_METHOD(TestU8ToU16OneByOne);
+    TEST_METHOD(TestU8ToU16Mixed);
+    TEST_METHOD(TestU8ToU16Invalid);
+    TEST_METHOD(TestU8ToU16Buffer);
 };
 
 void Utf8Utf16ConvertTests::TestU8ToU16()
@@ -191,3 +194,94 @@ void Utf8Utf16ConvertTests::TestU8ToU16OneByOne()
     VERIFY_SUCCEEDED(til::u8u16(u8String1_4, u16Out1, state));
     VERIFY_ARE_EQUAL(u16StringComp1, u16Out1);
 }
+
+// The conversion widens ASCII in blocks of 16 bytes. Place a non-ASCII character at
+// every offset in and around such a block to make sure that each position is handled.
+void Utf8Utf16ConvertTests::TestU8ToU16Mixed()
+{
+    static constexpr std::string_view needles[]{
+        "\xC3\xB6", // LATIN SMALL LETTER O WITH DIAERESIS (2 bytes)
+        "\xE2\x82\xAC", // EURO SIGN (3 bytes)
+        "\xF0\x9F\x93\xB7", // U+1F4F7 CAMERA (4 bytes)
+    };
+    static constexpr std::wstring_view needlesComp[]{
+        L"\x00f6",
+        L"\x20ac",
+        L"\xD83D\xDCF7",
+    };
+
+    for (size_t i = 0; i < std::size(needles); ++i)
+    {
+        for (size_t offset = 0; offset < 40; ++offset)
+        {
+            std::string u8String(offset, 'a');
+            u8String.append(needles[i]);
+            u8String.append(40 - offset, 'b');
+
+            std::wstring u16StringComp(offset, L'a');
+            u16StringComp.append(needlesComp[i]);
+            u16StringComp.append(40 - offset, L'b');
+
+            std::wstring u16Out{};
+            VERIFY_SUCCEEDED(til::u8u16(u8String, u16Out));
+            VERIFY_ARE_EQUAL(u16StringComp, u16Out);
+        }
+    }
+}
+
+// Ill-formed input must be replaced exactly like MultiByteToWideChar does it.
+void Utf8Utf16ConvertTests::TestU8ToU16Invalid()
+{
+    static constexpr std::string_view tests[]{
+        "\x80", // lone continuation byte
+        "\xC0\xAF", // overlong encoding of '/'
+        "\xC3", // truncated 2 byte sequence
+        "\xE0\x80\xAF", // overlong 3 byte sequence
+        "\xED\xA0\x80", // encoded surrogate
+        "\xE2\x82", // truncated 3 byte sequence
+        "\xF0\x9F\x93", // truncated 4 byte sequence
+        "\xF4\x90\x80\x80", // beyond U+10FFFF
+        "\xFF", // never valid
+        "\xC3\xB6\xFF\xE2\x82\xAC", // valid, invalid, valid
+    };
+
+    for (const auto test : tests)
+    {
+        for (size_t offset = 0; offset < 20; offset += 3)
+        {
+            std::string u8String(offset, 'a');
+            u8String.append(test);
+            u8String.append(20, 'b');
+
+            std::wstring u16StringComp(u8String.size(), L'\0');
+            const auto len = MultiByteToWideChar(CP_UTF8, 0, u8String.data(), gsl::narrow_cast<int>(u8String.size()), u16StringComp.data(), gsl::narrow_cast<int>(u16StringComp.size()));
+            u16StringComp.resize(gsl::narrow_cast<size_t>(len));
+
+            std::wstring u16Out{};
+            VERIFY_SUCCEEDED(til::u8u16(u8String, u16Out));
+            VERIFY_ARE_EQUAL(u16StringComp, u16Out);
+        }
+    }
+}
+
+void Utf8Utf16ConvertTests::TestU8ToU16Buffer()
+{
+    const std::string u8String1{ "abc\xE2\x82" }; // the EURO SIGN is split across the two chunks
+    const std::string u8String2{ "\xAC" "defghijklmnopqrstuvwxyz" };
+
+    til::u8state state{};
+    std::wstring_view u16Out{};
+
+    // The buffer must be able to hold the worst case result.
+    std::wstring buffer(u8String1.size() - 1, L'\0');
+    VERIFY_ARE_EQUAL(E_NOT_SUFFICIENT_BUFFER, til::u8u16(u8String1, buffer, u16Out, state));
+
+    buffer.resize(32);
+    VERIFY_SUCCEEDED(til::u8u16(u8String1, buffer, u16Out, state));
+    VERIFY_ARE_EQUAL(L"abc", u16Out);
+    VERIFY_IS_TRUE(u16Out.data() == buffer.data());
+
+    VERIFY_SUCCEEDED(til::u8u16(u8String2, buffer, u16Out, state));
+    VERIFY_ARE_EQUAL(L"\x20ac" L"defghijklmnopqrstuvwxyz", u16Out);
+    VERIFY_IS_TRUE(u16Out.data() == buffer.data());
+}
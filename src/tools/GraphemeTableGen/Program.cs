@@ -102,10 +102,13 @@ var ucd = ExtractValuesFromUcd(args[0]);
 // More stages = Less size. The trajectory roughly follows a+b*c^stages, where c < 1.
 // 4 still gives ~30% savings over 3 stages and going beyond 5 gives diminishing returns (<10%).
 var trie = BuildBestTrie(ucd.Values, 2, 8, 4);
+// The trie is optimized for size, but each lookup costs 4 dependent loads. Virtually all text is found in the
+// first two planes, which is why we additionally emit a plain two-stage table with 64-byte pages for them.
+var pageTable = BuildPageTable(ucd.Values, 0x20000, 6);
 // The joinRules above has 2 bits per value. This packs it into 32-bit integers to save space.
 var rules = PrepareRulesTable(joinRules);
 // Each rules item has the same length. Each item is 32 bits = 4 bytes.
-var totalSize = trie.TotalSize + rules.Length * rules[0].Length * sizeof(TrieType);
+var totalSize = trie.TotalSize + pageTable.TotalSize + rules.Length * rules[0].Length * sizeof(TrieType);
 
 // Run a quick sanity check to ensure that the trie works as expected.
 foreach (var (expected, cp) in ucd.Values.Select((v, i) => (v, i)))
@@ -120,6 +123,11 @@ foreach (var (expected, cp) in ucd.Values.Select((v, i) => (v, i)))
     {
         throw new Exception($"trie sanity check failed for {cp:X}");
     }
+
+    if (cp < pageTable.Limit && pageTable.Pages[(int)pageTable.Index[cp >> pageTable.Shift] + (cp & pageTable.Mask)] != expected)
+    {
+        throw new Exception($"page table sanity check failed for {cp:X}");
+    }
 }
 
 // All the remaining code starting here simply generates the C++ output.
@@ -149,6 +157,9 @@ foreach (var stage in trie.Stages)
     buf.Append("\n};\n");
 }
 
+AppendArray(buf, "static constexpr uint16_t s_pageIndex[]", " 0x{0:x4},", pageTable.Index);
+AppendArray(buf, "alignas(64) static constexpr uint8_t s_pages[]", " 0x{0:x2},", pageTable.Pages);
+
 buf.Append($"static constexpr uint32_t s_joinRules[{rules.Length}][{rules[0].Length}] = {{\n");
 foreach (var table in rules)
 {
@@ -161,7 +172,7 @@ foreach (var table in rules)
 }
 buf.Append("};\n");
 
-buf.Append($"constexpr uint{trie.Stages[^1].Bits}_t ucdLookup(const char32_t cp) noexcept\n");
+buf.Append($"constexpr uint{trie.Stages[^1].Bits}_t ucdLookupTrie(const char32_t cp) noexcept\n");
 buf.Append("{\n");
 foreach (var stage in trie.Stages)
 {
@@ -180,6 +191,15 @@ foreach (var stage in trie.Stages)
 buf.Append($"    return s{trie.Stages.Count - 1};\n");
 buf.Append("}\n");
 
+buf.Append($"constexpr uint{trie.Stages[^1].Bits}_t ucdLookup(const char32_t cp) noexcept\n");
+buf.Append("{\n");
+buf.Append($"    if (cp < 0x{pageTable.Limit:x})\n");
+buf.Append("    {\n");
+buf.Append($"        return s_pages[s_pageIndex[cp >> {pageTable.Shift}] + (cp & {pageTable.Mask})];\n");
+buf.Append("    }\n");
+buf.Append("    return ucdLookupTrie(cp);\n");
+buf.Append("}\n");
+
 buf.Append("constexpr int ucdGraphemeJoins(const int state, const int lead, const int trail) noexcept\n");
 buf.Append("{\n");
 buf.Append("    const auto l = lead & 15;\n");
@@ -198,6 +218,20 @@ buf.Append("// clang-format on\n");
 
 Console.Write(buf);
 
+static void AppendArray(StringBuilder buf, string declaration, string fmt, List<TrieType> values)
+{
+    buf.Append($"{declaration} = {{");
+    foreach (var (value, j) in values.Select((v, j) => (v, j)))
+    {
+        if (j % 16 == 0)
+        {
+            buf.Append("\n   ");
+        }
+        buf.AppendFormat(fmt, value);
+    }
+    buf.Append("\n};\n");
+}
+
 // This reads the given ucd.nounihan.grouped.xml file and extracts the
 // CharacterWidth and ClusterBreak properties for all codepoints.
 static Ucd ExtractValuesFromUcd(string path)
@@ -486,6 +520,45 @@ static Trie BuildTrie(List<TrieType> uncompressed, Span<int> shifts)
     };
 }
 
+// Builds a two-stage table for the codepoints below `limit`. Unlike BuildTrie() this doesn't overlap the deduplicated
+// pages with each other, which ensures that each page of 2^shift values stays aligned to its size.
+// The offsets in the first stage are pre-multiplied by the page size.
+static PageTable BuildPageTable(List<TrieType> uncompressed, int limit, int shift)
+{
+    var pageSize = 1 << shift;
+    var cache = new Dictionary<ReadOnlyTrieTypeSpan, TrieType>();
+    var index = new List<TrieType>();
+    var pages = new List<TrieType>();
+
+    for (var off = 0; off < limit; off += pageSize)
+    {
+        var key = new ReadOnlyTrieTypeSpan(uncompressed, off, pageSize);
+        if (!cache.TryGetValue(key, out var offset))
+        {
+            offset = (TrieType)pages.Count;
+            pages.AddRange(key.AsSpan());
+            cache[key] = offset;
+        }
+
+        index.Add(offset);
+    }
+
+    if (pages.Max() > 0xff || index.Max() > 0xffff)
+    {
+        throw new Exception("page table values don't fit into uint8_t/uint16_t");
+    }
+
+    return new PageTable
+    {
+        Index = index,
+        Pages = pages,
+        Limit = limit,
+        Shift = shift,
+        Mask = pageSize - 1,
+        TotalSize = index.Count * sizeof(ushort) + pages.Count * sizeof(byte),
+    };
+}
+
 // Finds needle in haystack. Returns -1 if it couldn't be found.
 static int FindExisting(ReadOnlySpan<TrieType> haystack, ReadOnlySpan<TrieType> needle)
 {
@@ -555,6 +628,16 @@ class Trie
     public required int TotalSize;
 }
 
+class PageTable
+{
+    public required List<TrieType> Index;
+    public required List<TrieType> Pages;
+    public required int Limit;
+    public required int Shift;
+    public required int Mask;
+    public required int TotalSize;
+}
+
 // Because you can't put a Span<TrieType> into a Dictionary.
 // This works around that by simply keeping a reference to the List<TrieType> around.
 struct ReadOnlyTrieTypeSpan(List<TrieType> list, int start, int length)
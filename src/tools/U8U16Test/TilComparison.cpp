@@ -0,0 +1,200 @@
+// TEST TOOL U8U16Test
+// Compares til::u8u16 against the MultiByteToWideChar based implementation it replaced.
+// The input is converted in chunks of 128 KiB carrying a til::u8state, just like ConptyConnection does it.
+// This file is kept separate from the rest of the tool, because U8U16Test.hpp has its own u8state and u8u16.
+
+#include <LibraryIncludes.h>
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include "TilComparison.hpp"
+
+namespace
+{
+    constexpr size_t chunkSize{ 128u * 1024u };
+    constexpr int iterations{ 100 };
+
+#pragma warning(push)
+#pragma warning(disable : 26429 26446 26459 26481 26482) // use not_null, subscript operator, use span, pointer arithmetic, dynamic array indexing
+    // This is til::u8u16 with til::u8state as it was before it got its own decoder.
+    [[nodiscard]] HRESULT legacyU8U16(const std::string_view& in, std::wstring& out, til::u8state& state) noexcept
+    {
+        try
+        {
+            out.clear();
+            RETURN_HR_IF(S_OK, in.empty());
+
+            int capa16{};
+            RETURN_HR_IF(E_ABORT, !base::CheckAdd(in.length(), state.have).AssignIfValid(&capa16));
+
+            out.resize(gsl::narrow_cast<size_t>(capa16));
+            auto len8{ gsl::narrow_cast<int>(in.length()) };
+            int len16{};
+            auto cursor8{ in.data() };
+            if (state.have)
+            {
+                const auto copyable{ std::min<int>(state.want, len8) };
+                std::move(cursor8, cursor8 + copyable, &state.partials[state.have]);
+                state.have += gsl::narrow_cast<uint8_t>(copyable);
+                state.want -= gsl::narrow_cast<uint8_t>(copyable);
+                if (state.want)
+                {
+                    out.clear();
+                    return S_OK;
+                }
+
+                len16 = MultiByteToWideChar(CP_UTF8, 0UL, &state.partials[0], gsl::narrow_cast<int>(state.have), out.data(), capa16);
+                RETURN_HR_IF(E_UNEXPECTED, !len16);
+
+                capa16 -= len16;
+                len8 -= copyable;
+                cursor8 += copyable;
+                state.have = 0;
+            }
+
+            if (len8)
+            {
+                auto backIter{ cursor8 + len8 - 1 };
+                int sequenceLen{ 1 };
+
+                while (backIter != cursor8 && (*backIter & 0b11'000000) == 0b10'000000)
+                {
+                    --backIter;
+                    ++sequenceLen;
+                }
+
+                static constexpr uint8_t lengths[]{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0 };
+                const auto codePointLen{ lengths[gsl::narrow_cast<uint8_t>(*backIter) >> 3] };
+
+                if (codePointLen > sequenceLen)
+                {
+                    std::move(backIter, backIter + sequenceLen, &state.partials[0]);
+                    len8 -= sequenceLen;
+                    state.have = gsl::narrow_cast<uint8_t>(sequenceLen);
+                    state.want = gsl::narrow_cast<uint8_t>(codePointLen - sequenceLen);
+                }
+            }
+
+            if (len8)
+            {
+                const auto convLen{ MultiByteToWideChar(CP_UTF8, 0UL, cursor8, len8, out.data() + len16, capa16) };
+                RETURN_HR_IF(E_UNEXPECTED, !convLen);
+
+                len16 += convLen;
+            }
+
+            out.resize(gsl::narrow_cast<size_t>(len16));
+            return S_OK;
+        }
+        CATCH_RETURN();
+    }
+#pragma warning(pop)
+
+    // Calls func(chunk) for every chunk of the input and returns
+    // the total number of UTF-16 code units and the elapsed seconds.
+    template<typename Func>
+    std::pair<size_t, double> measure(const std::string_view input, Func&& func)
+    {
+        const auto beg = std::chrono::high_resolution_clock::now();
+        size_t length{};
+
+        for (int i = 0; i < iterations; ++i)
+        {
+            for (size_t offset = 0; offset < input.size(); offset += chunkSize)
+            {
+                length += func(input.substr(offset, chunkSize));
+            }
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - beg;
+        return { length, elapsed.count() };
+    }
+
+    // Converts the input in chunks, just like measure() does,
+    // and returns the concatenation of all the outputs.
+    template<typename Func>
+    std::wstring convertChunked(const std::string_view input, Func&& func)
+    {
+        std::wstring result;
+        for (size_t offset = 0; offset < input.size(); offset += chunkSize)
+        {
+            result.append(func(input.substr(offset, chunkSize)));
+        }
+        return result;
+    }
+
+    void print(const char* name, const std::pair<size_t, double>& result, const size_t bytes)
+    {
+        const auto mbps = static_cast<double>(bytes) * iterations / result.second / (1024.0 * 1024.0);
+        std::cout << " " << name << " length " << result.first << " elapsed " << result.second << " (" << mbps << " MB/s)" << std::endl;
+    }
+}
+
+void CompTilU8U16_Chunks(const std::string& fileName)
+{
+    std::cout << "\n~~~\ntest \"" << __func__ << " - " << fileName << "\"" << std::endl;
+
+    std::ostringstream buf{};
+    buf << std::ifstream{ fileName }.rdbuf();
+    const auto text = buf.str();
+    if (text.empty())
+    {
+        std::cout << " unable to read the file" << std::endl;
+        return;
+    }
+
+    // Roughly 8 MiB of text. The files are short, so this is mostly
+    // about the steady state of the conversion, not about caching.
+    std::string u8Str{};
+    while (u8Str.size() < 8u * 1024u * 1024u)
+    {
+        u8Str.append(text);
+    }
+
+    til::u8state legacyState{};
+    std::wstring legacyOut{};
+    print("MultiByteToWideChar    ", measure(u8Str, [&](const std::string_view chunk) {
+              LOG_IF_FAILED(legacyU8U16(chunk, legacyOut, legacyState));
+              return legacyOut.size();
+          }),
+          u8Str.size());
+
+    til::u8state stringState{};
+    std::wstring stringOut{};
+    print("til::u8u16 (wstring)   ", measure(u8Str, [&](const std::string_view chunk) {
+              LOG_IF_FAILED(til::u8u16(chunk, stringOut, stringState));
+              return stringOut.size();
+          }),
+          u8Str.size());
+
+    til::u8state bufferState{};
+    std::wstring buffer(chunkSize + std::size(bufferState.partials), L'\0');
+    std::wstring_view bufferOut{};
+    print("til::u8u16 (buffer)    ", measure(u8Str, [&](const std::string_view chunk) {
+              LOG_IF_FAILED(til::u8u16(chunk, buffer, bufferOut, bufferState));
+              return bufferOut.size();
+          }),
+          u8Str.size());
+
+    // All implementations must agree on the result, including code points
+    // that are split across chunks and carried over in the u8state.
+    legacyState.reset();
+    const auto expected = convertChunked(u8Str, [&](const std::string_view chunk) {
+        LOG_IF_FAILED(legacyU8U16(chunk, legacyOut, legacyState));
+        return std::wstring_view{ legacyOut };
+    });
+    stringState.reset();
+    const auto actualString = convertChunked(u8Str, [&](const std::string_view chunk) {
+        LOG_IF_FAILED(til::u8u16(chunk, stringOut, stringState));
+        return std::wstring_view{ stringOut };
+    });
+    bufferState.reset();
+    const auto actualBuffer = convertChunked(u8Str, [&](const std::string_view chunk) {
+        LOG_IF_FAILED(til::u8u16(chunk, buffer, bufferOut, bufferState));
+        return bufferOut;
+    });
+    const auto match = actualString == expected && actualBuffer == expected;
+    std::cout << " results " << (match ? "match" : "DIFFER") << std::endl;
+}
@@ -0,0 +1,8 @@
+// TEST TOOL U8U16Test
+// Compares til::u8u16 against the MultiByteToWideChar based implementation it replaced.
+
+#pragma once
+
+#include <string>
+
+void CompTilU8U16_Chunks(const std::string& fileName);
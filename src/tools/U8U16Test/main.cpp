@@ -12,6 +12,7 @@
 #include <sstream>
 
 #include "U8U16Test.hpp"
+#include "TilComparison.hpp"
 
 typedef NTSTATUS(WINAPI* t_RtlUTF8ToUnicodeN)(PWSTR, ULONG, PULONG, PCCH, ULONG);
 typedef NTSTATUS(WINAPI* t_RtlUnicodeToUTF8N)(PCHAR, ULONG, PULONG, PCWSTR, ULONG);
@@ -519,6 +520,13 @@ int main()
     CompNaturalLang_Chunks("ru.txt");
     CompNaturalLang_Chunks("zh.txt");
 
+    std::cout << "\n\n### til::u8u16 ###" << std::endl;
+
+    CompTilU8U16_Chunks("en.txt");
+    CompTilU8U16_Chunks("fr.txt");
+    CompTilU8U16_Chunks("ru.txt");
+    CompTilU8U16_Chunks("zh.txt");
+
     FreeLibrary(ntdll);
     return 0;
 }
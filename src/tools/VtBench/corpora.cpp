@@ -0,0 +1,270 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "pch.h"
+#include "corpora.h"
+
+namespace
+{
+    struct Rng
+    {
+        // A PCG-style LCG. We don't need a good RNG, just a fast and deterministic one.
+        uint32_t next() noexcept
+        {
+            state = state * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+            return static_cast<uint32_t>(state >> 32);
+        }
+
+        uint32_t next(uint32_t max) noexcept
+        {
+            return next() % max;
+        }
+
+        uint64_t state = 0x853c49e6748fea9b;
+    };
+
+    void appendCodepoint(std::wstring& str, char32_t cp)
+    {
+        if (cp < 0x10000)
+        {
+            str.push_back(static_cast<wchar_t>(cp));
+        }
+        else
+        {
+            cp -= 0x10000;
+            str.push_back(static_cast<wchar_t>(0xD800 | (cp >> 10)));
+            str.push_back(static_cast<wchar_t>(0xDC00 | (cp & 0x3ff)));
+        }
+    }
+
+    void appendNumber(std::wstring& str, uint32_t value)
+    {
+        wchar_t buffer[16];
+        const auto end = std::end(buffer);
+        auto it = end;
+        do
+        {
+            *--it = static_cast<wchar_t>(L'0' + value % 10);
+            value /= 10;
+        } while (value);
+        str.append(it, end);
+    }
+
+    // Plain build-log style text: printable ASCII with CRLF line endings.
+    std::wstring generateAscii(Rng& rng, size_t targetSize)
+    {
+        static constexpr std::wstring_view words[]{
+            L"Compiling", L"Linking", L"warning", L"note:", L"src/buffer/out/textBuffer.cpp", L"the", L"of",
+            L"(line", L"42)", L"-O2", L"-Wall", L"std::vector<int>", L"obj/x64/Release/", L"[100%]", L"done.",
+        };
+
+        std::wstring str;
+        str.reserve(targetSize + 256);
+
+        while (str.size() < targetSize)
+        {
+            const auto wordCount = 3 + rng.next(15);
+            for (uint32_t i = 0; i < wordCount; ++i)
+            {
+                if (i)
+                {
+                    str.push_back(L' ');
+                }
+                str.append(words[rng.next(static_cast<uint32_t>(std::size(words)))]);
+            }
+            str.append(L"\r\n");
+        }
+
+        return str;
+    }
+
+    // Wide CJK ideographs interspersed with ASCII punctuation.
+    std::wstring generateCjk(Rng& rng, size_t targetSize)
+    {
+        std::wstring str;
+        str.reserve(targetSize + 256);
+
+        while (str.size() < targetSize)
+        {
+            const auto charCount = 10 + rng.next(50);
+            for (uint32_t i = 0; i < charCount; ++i)
+            {
+                appendCodepoint(str, 0x4E00 + rng.next(0x5000));
+                if (rng.next(8) == 0)
+                {
+                    str.append(L"\x3001");
+                }
+            }
+            str.append(L"\r\n");
+        }
+
+        return str;
+    }
+
+    // Emoji including modifiers, ZWJ sequences and regional indicator pairs.
+    // This is the worst case for grapheme cluster segmentation.
+    std::wstring generateEmoji(Rng& rng, size_t targetSize)
+    {
+        static constexpr std::wstring_view clusters[]{
+            L"\U0001F600",
+            L"\U0001F44D\U0001F3FD",
+            L"\U0001F468\u200D\U0001F469\u200D\U0001F467\u200D\U0001F466",
+            L"\U0001F3F3\uFE0F\u200D\U0001F308",
+            L"\U0001F1E9\U0001F1EA",
+            L"\u2764\uFE0F",
+            L"\U0001F9D1\u200D\U0001F4BB",
+            L" ",
+        };
+
+        std::wstring str;
+        str.reserve(targetSize + 256);
+
+        while (str.size() < targetSize)
+        {
+            const auto clusterCount = 5 + rng.next(30);
+            for (uint32_t i = 0; i < clusterCount; ++i)
+            {
+                str.append(clusters[rng.next(static_cast<uint32_t>(std::size(clusters)))]);
+            }
+            str.append(L"\r\n");
+        }
+
+        return str;
+    }
+
+    // Output similar to `ls --color`: short runs of text separated by SGR sequences.
+    std::wstring generateSgr(Rng& rng, size_t targetSize)
+    {
+        static constexpr std::wstring_view colors[]{
+            L"\x1b[0m",
+            L"\x1b[01;34m",
+            L"\x1b[01;32m",
+            L"\x1b[01;36m",
+            L"\x1b[40;33;01m",
+            L"\x1b[38;5;208m",
+            L"\x1b[38;2;255;128;0m",
+            L"\x1b[1;4;31m",
+        };
+        static constexpr std::wstring_view names[]{
+            L"bin", L"build.cmd", L"node_modules", L"README.md", L"libfoo.so.1", L"main.cpp", L"a.out", L"tmp",
+        };
+
+        std::wstring str;
+        str.reserve(targetSize + 256);
+
+        while (str.size() < targetSize)
+        {
+            for (auto i = 0; i < 6; ++i)
+            {
+                str.append(colors[rng.next(static_cast<uint32_t>(std::size(colors)))]);
+                str.append(names[rng.next(static_cast<uint32_t>(std::size(names)))]);
+                str.append(L"\x1b[0m  ");
+            }
+            str.append(L"\r\n");
+        }
+
+        return str;
+    }
+
+    // A full-screen TUI redraw similar to `htop`: every row is cursor-addressed,
+    // colored, and the remainder of the line erased.
+    std::wstring generateHtop(Rng& rng, size_t targetSize, int height)
+    {
+        std::wstring str;
+        str.reserve(targetSize + 256);
+
+        while (str.size() < targetSize)
+        {
+            str.append(L"\x1b[?25l\x1b[H");
+
+            for (auto y = 1; y <= height; ++y)
+            {
+                str.append(L"\x1b[");
+                appendNumber(str, static_cast<uint32_t>(y));
+                str.append(L";1H\x1b[30;42m  PID USER \x1b[m ");
+                appendNumber(str, rng.next(100000));
+                str.append(L" \x1b[1;31m");
+                appendNumber(str, rng.next(100));
+                str.append(L".");
+                appendNumber(str, rng.next(10));
+                str.append(L"%\x1b[m \x1b[36m/usr/bin/process --flag\x1b[m\x1b[K");
+            }
+
+            str.append(L"\x1b[?25h");
+        }
+
+        return str;
+    }
+
+    // A sequence of sixel images with a small palette, using both plain
+    // data bytes and repeat introducers.
+    std::wstring generateSixel(Rng& rng, size_t targetSize)
+    {
+        std::wstring str;
+        str.reserve(targetSize + 256);
+
+        while (str.size() < targetSize)
+        {
+            str.append(L"\x1bPq\"1;1;200;60");
+
+            for (uint32_t color = 0; color < 4; ++color)
+            {
+                str.append(L"#");
+                appendNumber(str, color);
+                str.append(L";2;");
+                appendNumber(str, rng.next(101));
+                str.append(L";");
+                appendNumber(str, rng.next(101));
+                str.append(L";");
+                appendNumber(str, rng.next(101));
+            }
+
+            for (auto band = 0; band < 10; ++band)
+            {
+                for (uint32_t color = 0; color < 4; ++color)
+                {
+                    str.append(L"#");
+                    appendNumber(str, color);
+
+                    for (auto x = 0; x < 200;)
+                    {
+                        const auto ch = static_cast<wchar_t>(L'?' + rng.next(64));
+                        if (rng.next(4) == 0)
+                        {
+                            const auto count = 2 + rng.next(20);
+                            str.append(L"!");
+                            appendNumber(str, count);
+                            str.push_back(ch);
+                            x += count;
+                        }
+                        else
+                        {
+                            str.push_back(ch);
+                            x++;
+                        }
+                    }
+
+                    str.append(L"$");
+                }
+                str.append(L"-");
+            }
+
+            str.append(L"\x1b\\");
+        }
+
+        return str;
+    }
+}
+
+std::vector<corpora::Corpus> corpora::Generate(size_t targetSize)
+{
+    Rng rng;
+    std::vector<Corpus> result;
+    result.emplace_back("ascii", generateAscii(rng, targetSize));
+    result.emplace_back("cjk", generateCjk(rng, targetSize));
+    result.emplace_back("emoji", generateEmoji(rng, targetSize));
+    result.emplace_back("sgr (ls --color)", generateSgr(rng, targetSize));
+    result.emplace_back("cup (htop)", generateHtop(rng, targetSize, 30));
+    result.emplace_back("sixel", generateSixel(rng, targetSize));
+    return result;
+}
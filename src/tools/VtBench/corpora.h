@@ -0,0 +1,17 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+namespace corpora
+{
+    struct Corpus
+    {
+        const char* title;
+        std::wstring text;
+    };
+
+    // Returns the canned benchmark inputs, each roughly targetSize UTF-16 code units long.
+    // The generators are seeded with a constant so that the results are comparable across runs.
+    std::vector<Corpus> Generate(size_t targetSize);
+}
@@ -0,0 +1,184 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// VtBench measures the throughput of the VT output path without a console:
+//   StateMachine::ProcessString -> OutputStateMachineEngine -> AdaptDispatch -> TextBuffer
+// Every side effect that would normally reach conhost or Terminal is stubbed out
+// by HeadlessTerminal below, which makes the numbers independent of any window,
+// renderer or pipe and thus comparable across machines and runs.
+// The "scan" entry measures Utils::FindActionableControlCharacter on its own.
+//
+// Usage: vtbench [seconds per corpus] [corpus name filter]
+
+#include "pch.h"
+
+#include "corpora.h"
+
+#include "../../terminal/adapter/adaptDispatch.hpp"
+#include "../../terminal/parser/OutputStateMachineEngine.hpp"
+#include "../../renderer/inc/DummyRenderer.hpp"
+#include "../../types/inc/utils.hpp"
+
+using namespace Microsoft::Console::VirtualTerminal;
+
+namespace
+{
+    constexpr til::CoordType s_width = 120;
+    constexpr til::CoordType s_height = 30;
+    constexpr til::CoordType s_scrollback = 9001;
+    constexpr size_t s_corpusSize = 1024 * 1024;
+
+    // An ITerminalApi that owns a TextBuffer and otherwise does nothing.
+    // The viewport follows the output just like it does in conhost and Terminal,
+    // so that the benchmark covers both viewport panning and circular buffer rotation.
+    class HeadlessTerminal final : public ITerminalApi
+    {
+    public:
+        HeadlessTerminal() :
+            _textBuffer{ til::size{ s_width, s_scrollback }, TextAttribute{}, 0, false, &_renderer }
+        {
+            auto dispatch = std::make_unique<AdaptDispatch>(*this, &_renderer, _renderer._renderSettings, _terminalInput);
+            auto engine = std::make_unique<OutputStateMachineEngine>(std::move(dispatch));
+            _stateMachine = std::make_unique<StateMachine>(std::move(engine));
+        }
+
+        void ReturnResponse(const std::wstring_view) override {}
+        StateMachine& GetStateMachine() override { return *_stateMachine; }
+        BufferState GetBufferAndViewport() override { return { _textBuffer, _viewport, true }; }
+        void SetViewportPosition(const til::point position) override
+        {
+            _viewport = { position.x, position.y, position.x + s_width, position.y + s_height };
+        }
+        bool IsVtInputEnabled() const override { return false; }
+        void SetSystemMode(const Mode mode, const bool enabled) override { _systemMode.set(mode, enabled); }
+        bool GetSystemMode(const Mode mode) const override { return _systemMode.test(mode); }
+        void ReturnAnswerback() override {}
+        void WarningBell() override {}
+        void SetWindowTitle(const std::wstring_view) override {}
+        void UseAlternateScreenBuffer(const TextAttribute&) override {}
+        void UseMainScreenBuffer() override {}
+        CursorType GetUserDefaultCursorStyle() const override { return CursorType::Legacy; }
+        void ShowWindow(bool) override {}
+        void SetConsoleOutputCP(const unsigned int) override {}
+        unsigned int GetConsoleOutputCP() const override { return CP_UTF8; }
+        void CopyToClipboard(const wil::zwstring_view) override {}
+        void SetTaskbarProgress(const DispatchTypes::TaskbarState, const size_t) override {}
+        void SetWorkingDirectory(const std::wstring_view) override {}
+        void PlayMidiNote(const int, const int, const std::chrono::microseconds) override {}
+        bool ResizeWindow(const til::CoordType, const til::CoordType) override { return true; }
+        void NotifyAccessibilityChange(const til::rect&) override {}
+        void NotifyBufferRotation(const int) override {}
+        void InvokeCompletions(std::wstring_view, unsigned int) override {}
+        void SearchMissingCommand(const std::wstring_view) override {}
+
+        void Write(const std::wstring_view text)
+        {
+            _stateMachine->ProcessString(text);
+        }
+
+    private:
+        DummyRenderer _renderer;
+        TerminalInput _terminalInput;
+        TextBuffer _textBuffer;
+        std::unique_ptr<StateMachine> _stateMachine;
+        til::rect _viewport{ 0, 0, s_width, s_height };
+        til::enumset<Mode> _systemMode{ Mode::AutoWrap };
+    };
+
+    struct Result
+    {
+        size_t chars = 0;
+        std::chrono::nanoseconds elapsed{};
+    };
+
+    Result measure(const std::wstring_view text, const std::chrono::nanoseconds duration)
+    {
+        using clock = std::chrono::steady_clock;
+
+        // A fresh terminal per corpus, so that one corpus cannot leave
+        // modes or a partial sequence behind that affect the next one.
+        const auto terminal = std::make_unique<HeadlessTerminal>();
+
+        // Warm up the caches and fill the scrollback, so that we measure
+        // the steady state with a rotating circular buffer.
+        terminal->Write(text);
+
+        Result result;
+        const auto beg = clock::now();
+        do
+        {
+            terminal->Write(text);
+            result.chars += text.size();
+            result.elapsed = clock::now() - beg;
+        } while (result.elapsed < duration);
+
+        return result;
+    }
+
+    // A microbenchmark for the ground state fast path of the parser.
+    // The input contains no control characters, so every call scans the entire string.
+    Result measureScan(const std::wstring_view text, const std::chrono::nanoseconds duration)
+    {
+        using clock = std::chrono::steady_clock;
+
+        Result result;
+        const auto beg = clock::now();
+        do
+        {
+            const auto it = Microsoft::Console::Utils::FindActionableControlCharacter(text.data(), text.size());
+            result.chars += it - text.data();
+            result.elapsed = clock::now() - beg;
+        } while (result.elapsed < duration);
+
+        return result;
+    }
+
+    void print(const char* title, const Result& result)
+    {
+        const auto ns = static_cast<double>(result.elapsed.count());
+        const auto chars = static_cast<double>(result.chars);
+        // Throughput is reported in terms of UTF-16 input, because that's what the parser consumes.
+        const auto mbps = chars * sizeof(wchar_t) / ns * 1e9 / (1024.0 * 1024.0);
+        const auto nsPerChar = ns / chars;
+
+        printf("%-20s %12.2f %12.3f\n", title, mbps, nsPerChar);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto seconds = 1.0;
+    std::string_view filter;
+
+    if (argc > 1)
+    {
+        seconds = std::max(0.01, std::atof(argv[1]));
+    }
+    if (argc > 2)
+    {
+        filter = argv[2];
+    }
+
+    const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>{ seconds });
+    const auto corpora = corpora::Generate(s_corpusSize);
+
+    printf("%-20s %12s %12s\n", "corpus", "MB/s", "ns/char");
+
+    for (const auto& corpus : corpora)
+    {
+        if (!filter.empty() && std::string_view{ corpus.title }.find(filter) == std::string_view::npos)
+        {
+            continue;
+        }
+
+        print(corpus.title, measure(corpus.text, duration));
+    }
+
+    if (filter.empty() || std::string_view{ "scan" }.find(filter) != std::string_view::npos)
+    {
+        const std::wstring printable(s_corpusSize, L'a');
+        print("scan", measureScan(printable, duration));
+    }
+
+    return 0;
+}
@@ -67,9 +67,25 @@ private:
     bool _graphemeNextConsole(GraphemeState& s, const std::wstring_view& str) noexcept;
     bool _graphemePrevConsole(GraphemeState& s, const std::wstring_view& str) noexcept;
     __declspec(noinline) int _checkFallbackViaCache(char32_t codepoint) noexcept;
+    static int _ucdLookup(char32_t codepoint) noexcept;
+    static int _ucdLookupTrie(char32_t codepoint) noexcept;
 
-    std::unordered_map<char32_t, int> _fallbackCache;
+    // A direct-mapped cache for the results of _pfnFallbackMethod. Each codepoint maps to exactly one slot,
+    // which turns lookups into a single comparison. Collisions simply evict the previous entry.
+    struct FallbackCacheEntry
+    {
+        // 0xffffffff isn't a valid codepoint and marks the slot as empty.
+        char32_t codepoint = 0xffffffff;
+        int width = 0;
+    };
+    static constexpr size_t FallbackCacheSizeLog2 = 8;
+
+    std::array<FallbackCacheEntry, size_t{ 1 } << FallbackCacheSizeLog2> _fallbackCache{};
     std::function<bool(const std::wstring_view&)> _pfnFallbackMethod;
     TextMeasurementMode _mode = TextMeasurementMode::Graphemes;
     int _ambiguousWidth = 1;
+
+#ifdef UNIT_TESTING
+    friend class CodepointWidthDetectorTests;
+#endif
 };
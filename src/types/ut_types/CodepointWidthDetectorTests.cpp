@@ -1331,6 +1331,63 @@ class CodepointWidthDetectorTests
         VERIFY_ARE_EQUAL(expectedWidths, actualWidths);
     }
 
+    TEST_METHOD(PageTableMatchesTrie)
+    {
+        // ucdLookup() uses a two-stage table for U+0000 to U+1FFFF and the trie for everything above.
+        // Both are supposed to hold the same values, which is what this ensures.
+        for (char32_t cp = 0; cp < 0x20000; ++cp)
+        {
+            const auto expected = CodepointWidthDetector::_ucdLookupTrie(cp);
+            const auto actual = CodepointWidthDetector::_ucdLookup(cp);
+            if (expected != actual)
+            {
+                VERIFY_FAIL(WEX::Common::NoThrowString().Format(L"U+%04X: expected 0x%02x, got 0x%02x", cp, expected, actual));
+            }
+        }
+    }
+
+    TEST_METHOD(FallbackCache)
+    {
+        // U+00B1 and U+2460 are ambiguous width characters, which in the Console mode are
+        // measured via the fallback method. The results must be cached until the next Reset().
+        static constexpr std::wstring_view text{ L"\u00B1\u2460\u00B1\u2460" };
+
+        CodepointWidthDetector cwd;
+        cwd.Reset(TextMeasurementMode::Console);
+
+        int calls = 0;
+        cwd.SetFallbackMethod([&](const std::wstring_view& glyph) {
+            calls++;
+            return glyph == L"\u2460";
+        });
+
+        const auto measure = [&]() {
+            std::vector<int> widths;
+            for (GraphemeState state;;)
+            {
+                const auto ok = cwd.GraphemeNext(state, text);
+                widths.emplace_back(state.width);
+                if (!ok)
+                {
+                    break;
+                }
+            }
+            return widths;
+        };
+
+        const std::vector<int> expectedWidths{ 1, 2, 1, 2 };
+
+        VERIFY_ARE_EQUAL(expectedWidths, measure());
+        VERIFY_ARE_EQUAL(2, calls);
+
+        VERIFY_ARE_EQUAL(expectedWidths, measure());
+        VERIFY_ARE_EQUAL(2, calls);
+
+        cwd.Reset(TextMeasurementMode::Console);
+        VERIFY_ARE_EQUAL(expectedWidths, measure());
+        VERIFY_ARE_EQUAL(4, calls);
+    }
+
     TEST_METHOD(ChunkedText)
     {
         struct Test
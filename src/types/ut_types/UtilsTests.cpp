@@ -35,6 +35,9 @@ class UtilsTests
 
     TEST_METHOD(TestEvaluateStartingDirectory);
 
+    TEST_METHOD(TestFindActionableControlCharacter);
+    TEST_METHOD(TestFindNonPrintableAscii);
+
     void _VerifyXTermColorResult(const std::wstring_view wstr, DWORD colorValue);
     void _VerifyXTermColorInvalid(const std::wstring_view wstr);
 };
@@ -618,3 +621,63 @@ void UtilsTests::TestEvaluateStartingDirectory()
         test(L"/dev", cwd, L"/dev");
     }
 }
+
+void UtilsTests::TestFindActionableControlCharacter()
+{
+    // FindActionableControlCharacter has vectorized kernels of different widths (8, 16 and 32 characters).
+    // Placing a single control character at every possible offset in strings of varying lengths
+    // ensures that the wide loops, their remainder handling and the scalar tail all agree.
+    static constexpr wchar_t actionable[]{ L'\0', L'\x1b', L'\x1f', L'\x7f', L'\x9b', L'\x9f' };
+    static constexpr wchar_t printable[]{ L' ', L'~', L'\xa0', L'\x3000', L'\xffff' };
+
+    for (size_t len = 0; len <= 80; ++len)
+    {
+        for (const auto ch : printable)
+        {
+            const std::wstring str(len, ch);
+            VERIFY_ARE_EQUAL(len, gsl::narrow_cast<size_t>(FindActionableControlCharacter(str.data(), len) - str.data()));
+        }
+
+        for (size_t pos = 0; pos < len; ++pos)
+        {
+            for (const auto ch : actionable)
+            {
+                std::wstring str(len, L'a');
+                str[pos] = ch;
+                if (pos + 1 < len)
+                {
+                    // A second control character must not be found before the first one.
+                    str[len - 1] = L'\n';
+                }
+                VERIFY_ARE_EQUAL(pos, gsl::narrow_cast<size_t>(FindActionableControlCharacter(str.data(), len) - str.data()));
+            }
+        }
+    }
+}
+
+void UtilsTests::TestFindNonPrintableAscii()
+{
+    // Just like TestFindActionableControlCharacter, this places a single character at every possible
+    // offset in strings of varying lengths, so that the vectorized loops and the scalar tail agree.
+    static constexpr wchar_t nonPrintable[]{ L'\0', L'\n', L'\x1b', L'\x1f', L'\x7f', L'\x80', L'\xa0', L'\xffff' };
+    static constexpr wchar_t printable[]{ L' ', L'?', L'~' };
+
+    for (size_t len = 0; len <= 40; ++len)
+    {
+        for (const auto ch : printable)
+        {
+            const std::wstring str(len, ch);
+            VERIFY_ARE_EQUAL(len, gsl::narrow_cast<size_t>(FindNonPrintableAscii(str.data(), len) - str.data()));
+        }
+
+        for (size_t pos = 0; pos < len; ++pos)
+        {
+            for (const auto ch : nonPrintable)
+            {
+                std::wstring str(len, L'a');
+                str[pos] = ch;
+                VERIFY_ARE_EQUAL(pos, gsl::narrow_cast<size_t>(FindNonPrintableAscii(str.data(), len) - str.data()));
+            }
+        }
+    }
+}
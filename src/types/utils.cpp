@@ -4,6 +4,7 @@
 #include "precomp.h"
 #include "inc/utils.hpp"
 
+#include <isa_availability.h>
 #include <til/string.h>
 #include <wil/token_helpers.h>
 
@@ -11,6 +12,8 @@
 
 using namespace Microsoft::Console;
 
+extern "C" int __isa_available;
+
 // Routine Description:
 // - Determines if a character is a valid number character, 0-9.
 // Arguments:
@@ -1075,6 +1078,62 @@ const wchar_t* Utils::FindActionableControlCharacter(const wchar_t* beg, const s
     //   (wch <= 0x1f) | ((wch - 0x7f) <= 0x20)
 #if defined(TIL_SSE_INTRINSICS)
 
+    // __isa_available is initialized once by the CRT on startup via CPUID,
+    // so this is effectively a one-time dispatch to the widest kernel available.
+    // Both wide loops leave `it` at a multiple of 8 from `beg`, so the SSE2 loop
+    // below can pick up the remainder without any further adjustment.
+    if (__isa_available >= __ISA_AVAILABLE_AVX512)
+    {
+        const auto max0 = _mm512_set1_epi16(0x1f);
+        const auto off1 = _mm512_set1_epi16(0x7f);
+        const auto max1 = _mm512_set1_epi16(0x20);
+
+        for (const auto end = beg + (len & ~size_t{ 31 }); it < end; it += 32)
+        {
+            const auto wch = _mm512_loadu_si512(it);
+            // AVX512BW has proper unsigned comparisons, which makes this a direct translation of isActionableFromGround.
+            const auto a = _mm512_cmple_epu16_mask(wch, max0);
+            const auto b = _mm512_cmple_epu16_mask(_mm512_sub_epi16(wch, off1), max1);
+            const auto mask = static_cast<unsigned long>(a | b);
+
+            if (mask)
+            {
+                unsigned long offset;
+                _BitScanForward(&offset, mask);
+                it += offset;
+                return it;
+            }
+        }
+    }
+    else if (__isa_available >= __ISA_AVAILABLE_AVX2)
+    {
+        const auto z = _mm256_setzero_si256();
+        const auto max0 = _mm256_set1_epi16(0x1f);
+        const auto off1 = _mm256_set1_epi16(static_cast<short>(0xff81));
+        const auto max1 = _mm256_set1_epi16(0x20);
+
+        for (const auto end = beg + (len & ~size_t{ 15 }); it < end; it += 16)
+        {
+            // This is the same as the SSE2 version below, just twice as wide.
+            const auto wch = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+            auto a = _mm256_subs_epu16(wch, max0);
+            auto b = _mm256_subs_epu16(_mm256_add_epi16(wch, off1), max1);
+            a = _mm256_cmpeq_epi16(a, z);
+            b = _mm256_cmpeq_epi16(b, z);
+
+            const auto c = _mm256_or_si256(a, b);
+            const auto mask = static_cast<unsigned long>(_mm256_movemask_epi8(c));
+
+            if (mask)
+            {
+                unsigned long offset;
+                _BitScanForward(&offset, mask);
+                it += offset / 2;
+                return it;
+            }
+        }
+    }
+
     for (const auto end = beg + (len & ~size_t{ 7 }); it < end; it += 8)
     {
         const auto wch = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
@@ -1153,6 +1212,64 @@ plainSearch:
     return it;
 }
 
+// Returns true for anything outside of printable ASCII (0x20-0x7E). Just like isActionableFromGround
+// this relies on the subtraction wrapping around for wch < 0x20, so that a single comparison suffices.
+constexpr bool isNonPrintableAscii(const wchar_t wch) noexcept
+{
+    return static_cast<wchar_t>(wch - 0x20) > 0x5e;
+}
+
+// Returns a pointer to the first character that isn't printable ASCII (0x20-0x7E).
+// The parser uses this to hand the bulk of a DCS data string to its handler at once.
+const wchar_t* Utils::FindNonPrintableAscii(const wchar_t* beg, const size_t len) noexcept
+{
+    auto it = beg;
+
+#if defined(TIL_SSE_INTRINSICS)
+
+    const auto off = _mm_set1_epi16(-0x20);
+    const auto max = _mm_set1_epi16(0x5e);
+    const auto z = _mm_setzero_si128();
+
+    for (const auto end = beg + (len & ~size_t{ 7 }); it < end; it += 8)
+    {
+        const auto wch = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+        // See FindActionableControlCharacter: "max(0, a - b) == 0" is an unsigned "a <= b".
+        const auto printable = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_add_epi16(wch, off), max), z);
+        const auto mask = static_cast<unsigned long>(~_mm_movemask_epi8(printable) & 0xffff);
+
+        if (mask)
+        {
+            unsigned long offset;
+            _BitScanForward(&offset, mask);
+            return it + offset / 2;
+        }
+    }
+
+#elif defined(TIL_ARM_NEON_INTRINSICS)
+
+    for (const auto end = beg + (len & ~size_t{ 7 }); it < end; it += 8)
+    {
+        const auto wch = vld1q_u16(it);
+        const auto a = vreinterpretq_u64_u16(vcgtq_u16(vsubq_u16(wch, vdupq_n_u16(0x20)), vdupq_n_u16(0x5e)));
+
+        if (vgetq_lane_u64(a, 0) | vgetq_lane_u64(a, 1))
+        {
+            // The plain search below will find the exact position.
+            break;
+        }
+    }
+
+#endif
+
+#pragma loop(no_vector)
+    for (const auto end = beg + len; it < end && !isNonPrintableAscii(*it); ++it)
+    {
+    }
+
+    return it;
+}
+
 #pragma warning(pop)
 
 std::wstring Utils::EvaluateStartingDirectory(